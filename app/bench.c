@@ -0,0 +1,109 @@
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <pthread.h>
+#include <sched.h>
+#include <string.h>
+#include <math.h>
+#include "bench.h"
+#include "../src/clock.h"
+
+uint64_t bench_now_ns(void)
+{
+     return clock_now_ns();
+}
+
+void bench_spin_ns(uint64_t ns)
+{
+     uint64_t end = bench_now_ns() + ns;
+     while (bench_now_ns() < end)
+          ;
+}
+
+uint64_t bench_exp_ns(unsigned int *seedp, uint64_t mean)
+{
+     /*inverse transform sampling, u in (0, 1]*/
+     double u = (rand_r(seedp) + 1.0) / ((double)RAND_MAX + 1.0);
+     return (uint64_t)(-log(u) * (double)mean);
+}
+
+int bench_cpus(int *cpus, int max)
+{
+     cpu_set_t set;
+     int n = 0;
+     if (sched_getaffinity(0, sizeof(set), &set) != 0)
+     {
+          perror("sched_getaffinity");
+          return 0;
+     }
+     for (int c = 0; c < CPU_SETSIZE && n < max; c++)
+          if (CPU_ISSET(c, &set))
+               cpus[n++] = c;
+     return n;
+}
+
+int bench_pin_cpu(int cpu)
+{
+     cpu_set_t set;
+     CPU_ZERO(&set);
+     CPU_SET(cpu, &set);
+     return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0 ? 0 : -1;
+}
+
+void latency_init(struct latency *l)
+{
+     l->samples = NULL;
+     l->n = 0;
+     l->cap = 0;
+}
+
+void latency_add(struct latency *l, uint64_t ns)
+{
+     if (l->n == l->cap)
+     {
+          size_t cap = l->cap ? l->cap * 2 : 1024;
+          uint64_t *s = (uint64_t *)realloc(l->samples, cap * sizeof(uint64_t));
+          if (!s)
+               return; /*drop the sample rather than abort the run*/
+          l->samples = s;
+          l->cap = cap;
+     }
+     l->samples[l->n++] = ns;
+}
+
+void latency_merge(struct latency *dst, const struct latency *src)
+{
+     for (size_t i = 0; i < src->n; i++)
+          latency_add(dst, src->samples[i]);
+}
+
+void latency_free(struct latency *l)
+{
+     free(l->samples);
+     latency_init(l);
+}
+
+static int cmp_u64(const void *a, const void *b)
+{
+     uint64_t x = *(const uint64_t *)a;
+     uint64_t y = *(const uint64_t *)b;
+     return (x > y) - (x < y);
+}
+
+uint64_t latency_percentile(struct latency *l, double p)
+{
+     if (l->n == 0)
+          return 0;
+     qsort(l->samples, l->n, sizeof(uint64_t), cmp_u64);
+     size_t i = (size_t)(p / 100.0 * (double)(l->n - 1));
+     return l->samples[i];
+}
+
+double latency_mean(const struct latency *l)
+{
+     if (l->n == 0)
+          return 0.0;
+     double sum = 0.0;
+     for (size_t i = 0; i < l->n; i++)
+          sum += (double)l->samples[i];
+     return sum / (double)l->n;
+}
@@ -0,0 +1,100 @@
+#ifndef BENCH_H
+#define BENCH_H
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+/**
+ * @brief Command line settings shared by all benchmarks
+ */
+struct bench_opts
+{
+     int nump;       /*number of producer threads*/
+     int numc;       /*number of consumer threads*/
+     int numitems;   /*total number of items to move*/
+     int queue_size; /*capacity of each queue*/
+     int batch;      /*consumer batch size, 0 disables*/
+     bool delay;     /*add random delays between operations*/
+     const char *file; /*input file for benchmarks that read one*/
+};
+
+/**
+ * @brief A growable array of latency samples in nanoseconds
+ */
+struct latency
+{
+     uint64_t *samples;
+     size_t n;
+     size_t cap;
+};
+
+/**
+ * @brief Returns a monotonic timestamp in nanoseconds, see clock_now_ns()
+ */
+uint64_t bench_now_ns(void);
+
+/**
+ * @brief Busy waits for roughly ns nanoseconds
+ */
+void bench_spin_ns(uint64_t ns);
+
+/**
+ * @brief Returns an exponentially distributed value with the given mean
+ */
+uint64_t bench_exp_ns(unsigned int *seedp, uint64_t mean);
+
+/**
+ * @brief Fills cpus with the CPUs this process may run on
+ *
+ * @return the number of CPUs written, at most max
+ */
+int bench_cpus(int *cpus, int max);
+
+/**
+ * @brief Pins the calling thread to one CPU
+ *
+ * @return 0 on success, -1 if the CPU is not available
+ */
+int bench_pin_cpu(int cpu);
+
+void latency_init(struct latency *l);
+void latency_add(struct latency *l, uint64_t ns);
+void latency_merge(struct latency *dst, const struct latency *src);
+void latency_free(struct latency *l);
+
+/**
+ * @brief Returns the p-th percentile (0-100) of the samples, sorting them in place
+ */
+uint64_t latency_percentile(struct latency *l, double p);
+
+/**
+ * @brief Returns the mean of the samples
+ */
+double latency_mean(const struct latency *l);
+
+/**
+ * @brief Runs a named scenario from the scenario pack, or every one for "all"
+ */
+int scenario_run(const char *name, const struct bench_opts *o);
+
+/**
+ * @brief Prints the scenario names and descriptions for the usage message
+ */
+void scenario_list(FILE *f);
+
+/*Benchmarks selectable with -b*/
+int bench_dispatch(const struct bench_opts *o);
+int bench_multiqueue(const struct bench_opts *o);
+int bench_replay(const struct bench_opts *o);
+int bench_observe(const struct bench_opts *o);
+int bench_aimd(const struct bench_opts *o);
+int bench_cores(const struct bench_opts *o);
+int bench_ipc(const struct bench_opts *o);
+int bench_pool(const struct bench_opts *o);
+int bench_mesh(const struct bench_opts *o);
+int bench_rpc(const struct bench_opts *o);
+int bench_arena(const struct bench_opts *o);
+int bench_lanes(const struct bench_opts *o);
+int bench_overload(const struct bench_opts *o);
+
+#endif
@@ -0,0 +1,142 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include "bench.h"
+#include "../src/lab.h"
+
+/*
+ * Batch size benchmark. Producers group items into batches before calling
+ * enqueue_batch and consumers drain with dequeue_batch. A fixed small batch,
+ * a fixed large batch and the AIMD controller are each run at low load
+ * (paced arrivals) and at high load (producers run flat out). Latency is
+ * measured from item creation, so time spent filling a producer batch
+ * counts against large batches at low load.
+ */
+
+#define MAX_BATCH 64
+#define LOW_LOAD_GAP_NS 20000 /*mean gap between items per producer at low load*/
+#define TARGET_NS 50000       /*sojourn target for the controller*/
+
+struct aimd_run
+{
+     queue_t q;
+     int per_thread;
+     int fixed;     /*fixed batch size, 0 uses the controller*/
+     uint64_t gap_ns;
+};
+
+struct aimd_consumer
+{
+     struct aimd_run *run;
+     struct latency lat;
+};
+
+static int batch_for(struct aimd_run *r)
+{
+     return r->fixed ? r->fixed : queue_batch_size(r->q);
+}
+
+static void *aimd_producer(void *args)
+{
+     struct aimd_run *r = (struct aimd_run *)args;
+     unsigned int seed = (unsigned int)(uintptr_t)&seed;
+     void *pending[MAX_BATCH];
+     int n = 0;
+     for (int i = 0; i < r->per_thread; i++)
+     {
+          if (r->gap_ns)
+               bench_spin_ns(bench_exp_ns(&seed, r->gap_ns));
+          uint64_t *stamp = (uint64_t *)malloc(sizeof(uint64_t));
+          *stamp = bench_now_ns();
+          pending[n++] = stamp;
+          if (n >= batch_for(r))
+          {
+               enqueue_batch(r->q, pending, n);
+               n = 0;
+          }
+     }
+     enqueue_batch(r->q, pending, n);
+     return NULL;
+}
+
+static void *aimd_consumer(void *args)
+{
+     struct aimd_consumer *c = (struct aimd_consumer *)args;
+     void *items[MAX_BATCH];
+     int n;
+     while ((n = dequeue_batch(c->run->q, items, c->run->fixed ? c->run->fixed : MAX_BATCH)) > 0)
+     {
+          uint64_t now = bench_now_ns();
+          for (int i = 0; i < n; i++)
+          {
+               latency_add(&c->lat, now - *(uint64_t *)items[i]);
+               free(items[i]);
+          }
+     }
+     return NULL;
+}
+
+static void run_aimd(const struct bench_opts *o, const char *load, uint64_t gap_ns,
+                     int fixed, const char *name)
+{
+     int nump = o->nump;
+     int numc = o->numc;
+     struct aimd_run r = {queue_init(o->queue_size), o->numitems / nump, fixed, gap_ns};
+     if (!fixed)
+          queue_set_batch_target(r.q, TARGET_NS, MAX_BATCH);
+
+     pthread_t producers[nump];
+     pthread_t consumers[numc];
+     struct aimd_consumer cargs[numc];
+     uint64_t start = bench_now_ns();
+     for (int i = 0; i < numc; i++)
+     {
+          cargs[i].run = &r;
+          latency_init(&cargs[i].lat);
+          pthread_create(&consumers[i], NULL, aimd_consumer, &cargs[i]);
+     }
+     for (int i = 0; i < nump; i++)
+          pthread_create(&producers[i], NULL, aimd_producer, &r);
+     for (int i = 0; i < nump; i++)
+          pthread_join(producers[i], NULL);
+     int final_batch = queue_batch_size(r.q);
+     queue_shutdown(r.q);
+     struct latency all;
+     latency_init(&all);
+     for (int i = 0; i < numc; i++)
+     {
+          pthread_join(consumers[i], NULL);
+          latency_merge(&all, &cargs[i].lat);
+          latency_free(&cargs[i].lat);
+     }
+     uint64_t elapsed = bench_now_ns() - start;
+
+     fprintf(stdout, "%-6s %-10s %12.0f %10.1f %10.1f %10.1f %6d\n", load, name,
+             all.n / (elapsed / 1e9),
+             latency_mean(&all) / 1e3,
+             latency_percentile(&all, 50) / 1e3,
+             latency_percentile(&all, 99) / 1e3,
+             fixed ? fixed : final_batch);
+     latency_free(&all);
+     queue_destroy(r.q);
+}
+
+int bench_aimd(const struct bench_opts *o)
+{
+     fprintf(stderr, "Moving %d items with %d producers and %d consumers, queue size %d, target %d us\n",
+             o->numitems, o->nump, o->numc, o->queue_size, TARGET_NS / 1000);
+     fprintf(stdout, "%-6s %-10s %12s %10s %10s %10s %6s\n",
+             "load", "batch", "items/s", "mean(us)", "p50(us)", "p99(us)", "size");
+     const struct
+     {
+          const char *name;
+          uint64_t gap;
+     } loads[] = {{"low", LOW_LOAD_GAP_NS}, {"high", 0}};
+     for (int i = 0; i < 2; i++)
+     {
+          run_aimd(o, loads[i].name, loads[i].gap, 1, "fixed-1");
+          run_aimd(o, loads[i].name, loads[i].gap, MAX_BATCH, "fixed-64");
+          run_aimd(o, loads[i].name, loads[i].gap, 0, "aimd");
+     }
+     return 0;
+}
@@ -0,0 +1,129 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include "bench.h"
+#include "../src/lab.h"
+#include "../src/arena.h"
+
+/*
+ * Payload allocation benchmark. Producers allocate a 64 byte payload per
+ * item and enqueue -B items (32 by default) per enqueue_batch, and consumers
+ * dispose of them, either with malloc/free or with a region arena tied to
+ * the queue, which seals the producer's region after every batch, and
+ * arena_release.
+ */
+
+#define PAYLOAD_SIZE 64
+#define ARENA_REGION (64 * 1024)
+
+struct arena_run
+{
+     queue_t q;
+     arena_t a;
+     int per_thread;
+     int batch;
+     int failed; /*set when a payload could not be allocated*/
+};
+
+static void *payload_producer(void *args)
+{
+     struct arena_run *r = (struct arena_run *)args;
+     void **batch = (void **)malloc(r->batch * sizeof(void *));
+     if (!batch)
+     {
+          perror("Failed to allocate batch");
+          __atomic_store_n(&r->failed, 1, __ATOMIC_RELAXED);
+          return NULL;
+     }
+     for (int i = 0; i < r->per_thread; i += r->batch)
+     {
+          int n = r->per_thread - i < r->batch ? r->per_thread - i : r->batch;
+          for (int j = 0; j < n; j++)
+          {
+               char *p = r->a ? (char *)arena_alloc(r->a, PAYLOAD_SIZE) : (char *)malloc(PAYLOAD_SIZE);
+               if (!p)
+               {
+                    fprintf(stderr, "Error: Failed to allocate a payload.\n");
+                    __atomic_store_n(&r->failed, 1, __ATOMIC_RELAXED);
+                    n = j;
+                    break;
+               }
+               p[0] = (char)(i + j);
+               batch[j] = p;
+          }
+          enqueue_batch(r->q, batch, n);
+          if (__atomic_load_n(&r->failed, __ATOMIC_RELAXED))
+               break;
+     }
+     free(batch);
+     return NULL;
+}
+
+static void *payload_consumer(void *args)
+{
+     struct arena_run *r = (struct arena_run *)args;
+     char *p;
+     while ((p = (char *)dequeue(r->q)) != NULL)
+     {
+          if (r->a)
+               arena_release(r->a, p);
+          else
+               free(p);
+     }
+     return NULL;
+}
+
+int bench_arena(const struct bench_opts *o)
+{
+     int nump = o->nump;
+     int numc = o->numc;
+     int batch = o->batch > 0 ? o->batch : 32;
+     fprintf(stderr, "Moving %d %d byte payloads with %d producers and %d consumers, queue size %d\n",
+             o->numitems, PAYLOAD_SIZE, nump, numc, o->queue_size);
+     fprintf(stdout, "%-8s %14s %10s\n", "payloads", "items/s", "ns/item");
+
+     for (int use_arena = 0; use_arena <= 1; use_arena++)
+     {
+          struct arena_run r = {queue_init(o->queue_size), NULL, o->numitems / nump, batch, 0};
+          if (!r.q)
+               return 1;
+          if (use_arena)
+          {
+               /*enough regions that producers only wait when consumers fall far behind*/
+               r.a = arena_init(ARENA_REGION, 4 * (nump + 1));
+               if (!r.a)
+               {
+                    queue_destroy(r.q);
+                    return 1;
+               }
+               queue_set_arena(r.q, r.a);
+          }
+          pthread_t producers[nump];
+          pthread_t consumers[numc];
+
+          uint64_t start = bench_now_ns();
+          for (int i = 0; i < numc; i++)
+               pthread_create(&consumers[i], NULL, payload_consumer, &r);
+          for (int i = 0; i < nump; i++)
+               pthread_create(&producers[i], NULL, payload_producer, &r);
+          for (int i = 0; i < nump; i++)
+               pthread_join(producers[i], NULL);
+          queue_shutdown(r.q);
+          for (int i = 0; i < numc; i++)
+               pthread_join(consumers[i], NULL);
+          uint64_t ns = bench_now_ns() - start;
+          if (r.failed)
+          {
+               arena_destroy(r.a);
+               queue_destroy(r.q);
+               return 1;
+          }
+
+          long total = (long)r.per_thread * nump;
+          fprintf(stdout, "%-8s %14.0f %10.1f\n", use_arena ? "arena" : "malloc",
+                  total / (ns / 1e9), (double)ns / total);
+          arena_destroy(r.a);
+          queue_destroy(r.q);
+     }
+     return 0;
+}
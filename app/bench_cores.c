@@ -0,0 +1,216 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include <sched.h>
+#include "bench.h"
+#include "../src/lab.h"
+
+/*
+ * Core-to-core latency benchmark. For every ordered pair of CPUs, two
+ * threads pinned to them bounce a single cache line back and forth, which
+ * is the floor for any cross-core handoff on this machine. The same pinned
+ * pair then bounces a token through two queue_t instances (request and
+ * reply), so the queue's cost above the hardware floor is explicit. Both
+ * matrices report one-way latency, half a round trip, in nanoseconds.
+ */
+
+#define MAX_CORES 64     /*largest matrix printed*/
+#define SPINS_BEFORE_YIELD 1024 /*lets two threads share a CPU without stalling*/
+
+struct pingpong
+{
+     int ping_cpu;
+     int pong_cpu;
+     int rounds;
+     queue_t req;
+     queue_t rep;
+     int flag __attribute__((aligned(64))); /*the bounced cache line*/
+};
+
+static inline void cpu_relax(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+     __builtin_ia32_pause();
+#endif
+}
+
+static void wait_flag(int *flag, int value)
+{
+     unsigned spins = 0;
+     while (__atomic_load_n(flag, __ATOMIC_ACQUIRE) != value)
+     {
+          cpu_relax();
+          if (++spins % SPINS_BEFORE_YIELD == 0)
+               sched_yield();
+     }
+}
+
+static void *line_pong(void *args)
+{
+     struct pingpong *p = (struct pingpong *)args;
+     bench_pin_cpu(p->pong_cpu);
+     for (int r = 1; r <= p->rounds; r++)
+     {
+          wait_flag(&p->flag, 2 * r - 1);
+          __atomic_store_n(&p->flag, 2 * r, __ATOMIC_RELEASE);
+     }
+     return NULL;
+}
+
+static void *queue_pong(void *args)
+{
+     struct pingpong *p = (struct pingpong *)args;
+     void *token;
+     bench_pin_cpu(p->pong_cpu);
+     while ((token = dequeue(p->req)) != NULL)
+          enqueue(p->rep, token);
+     return NULL;
+}
+
+/**
+ * Bounces the cache line p->rounds times and returns the one-way latency.
+ * The first tenth of the rounds warms up and is not timed.
+ */
+static double line_ping(struct pingpong *p)
+{
+     pthread_t t;
+     int warm = p->rounds / 10;
+     uint64_t start = 0;
+     p->flag = 0;
+     pthread_create(&t, NULL, line_pong, p);
+     for (int r = 1; r <= p->rounds; r++)
+     {
+          if (r == warm + 1)
+               start = bench_now_ns();
+          __atomic_store_n(&p->flag, 2 * r - 1, __ATOMIC_RELEASE);
+          wait_flag(&p->flag, 2 * r);
+     }
+     uint64_t end = bench_now_ns();
+     pthread_join(t, NULL);
+     return (double)(end - start) / (2.0 * (p->rounds - warm));
+}
+
+/**
+ * Bounces a token through the request and reply queues p->rounds times and
+ * returns the one-way latency.
+ */
+static double queue_ping(struct pingpong *p)
+{
+     pthread_t t;
+     int warm = p->rounds / 10;
+     uint64_t start = 0;
+     p->req = queue_init(1);
+     p->rep = queue_init(1);
+     pthread_create(&t, NULL, queue_pong, p);
+     for (int r = 1; r <= p->rounds; r++)
+     {
+          if (r == warm + 1)
+               start = bench_now_ns();
+          enqueue(p->req, p);
+          dequeue(p->rep);
+     }
+     uint64_t end = bench_now_ns();
+     queue_shutdown(p->req);
+     pthread_join(t, NULL);
+     queue_destroy(p->req);
+     queue_destroy(p->rep);
+     return (double)(end - start) / (2.0 * (p->rounds - warm));
+}
+
+struct pair_arg
+{
+     struct pingpong *p;
+     double line_ns;
+     double queue_ns;
+};
+
+static void *measure_pair(void *args)
+{
+     struct pair_arg *a = (struct pair_arg *)args;
+     bench_pin_cpu(a->p->ping_cpu);
+     a->line_ns = line_ping(a->p);
+     a->queue_ns = queue_ping(a->p);
+     return NULL;
+}
+
+static void print_matrix(const char *title, const int *cpus, int n, const double *m)
+{
+     fprintf(stdout, "%s (one-way ns, row pings column)\n%6s", title, "");
+     for (int j = 0; j < n; j++)
+          fprintf(stdout, " %7d", cpus[j]);
+     fprintf(stdout, "\n");
+     for (int i = 0; i < n; i++)
+     {
+          fprintf(stdout, "%6d", cpus[i]);
+          for (int j = 0; j < n; j++)
+               if (n > 1 && i == j)
+                    fprintf(stdout, " %7s", "-");
+               else
+                    fprintf(stdout, " %7.0f", m[i * n + j]);
+          fprintf(stdout, "\n");
+     }
+}
+
+static int cmp_double(const void *a, const void *b)
+{
+     double x = *(const double *)a;
+     double y = *(const double *)b;
+     return (x > y) - (x < y);
+}
+
+int bench_cores(const struct bench_opts *o)
+{
+     int cpus[MAX_CORES];
+     int n = bench_cpus(cpus, MAX_CORES);
+     int rounds = o->numitems >= 1000 ? o->numitems : 1000;
+     if (n == 0)
+          return 1;
+     if (n == 1)
+          fprintf(stderr, "Only CPU %d is available, measuring a same-core handoff instead of a matrix\n", cpus[0]);
+     fprintf(stderr, "Measuring %d CPUs with %d round trips per pair\n", n, rounds);
+
+     double *line = (double *)calloc((size_t)n * n, sizeof(double));
+     double *queue = (double *)calloc((size_t)n * n, sizeof(double));
+     double *overhead = (double *)calloc((size_t)n * n, sizeof(double));
+     struct pingpong *p = (struct pingpong *)aligned_alloc(64, sizeof(struct pingpong));
+     if (!line || !queue || !overhead || !p)
+     {
+          perror("Failed to allocate latency matrix");
+          free(line);
+          free(queue);
+          free(overhead);
+          free(p);
+          return 1;
+     }
+
+     int npairs = 0;
+     for (int i = 0; i < n; i++)
+          for (int j = 0; j < n; j++)
+          {
+               if (n > 1 && i == j)
+                    continue;
+               p->ping_cpu = cpus[i];
+               p->pong_cpu = cpus[j];
+               p->rounds = rounds;
+               /*a fresh thread per pair so the caller's affinity is untouched*/
+               struct pair_arg a = {p, 0, 0};
+               pthread_t t;
+               pthread_create(&t, NULL, measure_pair, &a);
+               pthread_join(t, NULL);
+               line[i * n + j] = a.line_ns;
+               queue[i * n + j] = a.queue_ns;
+               overhead[npairs++] = a.queue_ns - a.line_ns;
+          }
+
+     print_matrix("cache line", cpus, n, line);
+     print_matrix("queue_t", cpus, n, queue);
+     qsort(overhead, npairs, sizeof(double), cmp_double);
+     fprintf(stdout, "queue_t overhead above the cache line: min %.0f median %.0f max %.0f ns\n",
+             overhead[0], overhead[npairs / 2], overhead[npairs - 1]);
+
+     free(line);
+     free(queue);
+     free(overhead);
+     free(p);
+     return 0;
+}
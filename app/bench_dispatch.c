@@ -0,0 +1,168 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include "bench.h"
+#include "../src/lab.h"
+#include "../src/dispatch.h"
+
+/*
+ * Sharded dispatch benchmark. Each consumer owns one queue and spends an
+ * exponentially distributed time on every item. Producers pace arrivals so
+ * the consumers run at about 90% utilization and dispatch each item with the
+ * policy under test. Reports throughput, sojourn latency and how unevenly the
+ * work piles up across the queues.
+ */
+
+#define SERVICE_NS 2000 /*mean service time per item*/
+#define LOAD 0.9        /*target utilization of the consumers*/
+#define SAMPLE_EVERY 64 /*items between depth samples*/
+
+struct dispatch_run
+{
+     dispatcher_t d;
+     queue_t *queues;
+     int nq;
+     int per_thread;
+     uint64_t gap_ns; /*mean inter-arrival time per producer*/
+};
+
+struct producer_arg
+{
+     struct dispatch_run *run;
+     unsigned int seed;
+     double spread; /*sum of (max depth - mean depth) over samples*/
+     long samples;
+};
+
+struct consumer_arg
+{
+     queue_t q;
+     unsigned int seed;
+     struct latency lat;
+};
+
+static void *dispatch_producer(void *args)
+{
+     struct producer_arg *a = (struct producer_arg *)args;
+     struct dispatch_run *r = a->run;
+
+     for (int i = 0; i < r->per_thread; i++)
+     {
+          bench_spin_ns(bench_exp_ns(&a->seed, r->gap_ns));
+          uint64_t *stamp = (uint64_t *)malloc(sizeof(uint64_t));
+          *stamp = bench_now_ns();
+          dispatch(r->d, stamp);
+
+          if (i % SAMPLE_EVERY == 0)
+          {
+               int max = 0;
+               long total = 0;
+               for (int j = 0; j < r->nq; j++)
+               {
+                    int s = queue_size(r->queues[j]);
+                    total += s;
+                    if (s > max)
+                         max = s;
+               }
+               a->spread += max - (double)total / r->nq;
+               a->samples++;
+          }
+     }
+     return NULL;
+}
+
+static void *dispatch_consumer(void *args)
+{
+     struct consumer_arg *a = (struct consumer_arg *)args;
+     uint64_t *stamp;
+     while ((stamp = (uint64_t *)dequeue(a->q)) != NULL)
+     {
+          bench_spin_ns(bench_exp_ns(&a->seed, SERVICE_NS));
+          latency_add(&a->lat, bench_now_ns() - *stamp);
+          free(stamp);
+     }
+     return NULL;
+}
+
+static void run_policy(const struct bench_opts *o, dispatch_policy_t policy, const char *name)
+{
+     int nq = o->numc;
+     int nump = o->nump;
+     queue_t queues[nq];
+     pthread_t producers[nump];
+     pthread_t consumers[nq];
+     struct producer_arg pargs[nump];
+     struct consumer_arg cargs[nq];
+
+     for (int i = 0; i < nq; i++)
+     {
+          queues[i] = queue_init(o->queue_size);
+          queue_set_consumer_batch(queues[i], o->batch);
+     }
+
+     struct dispatch_run run = {
+         .d = dispatcher_init(queues, nq, policy),
+         .queues = queues,
+         .nq = nq,
+         .per_thread = o->numitems / nump,
+         .gap_ns = (uint64_t)(SERVICE_NS * nump / (nq * LOAD)),
+     };
+
+     uint64_t start = bench_now_ns();
+     for (int i = 0; i < nq; i++)
+     {
+          cargs[i].q = queues[i];
+          cargs[i].seed = i + 1;
+          latency_init(&cargs[i].lat);
+          pthread_create(&consumers[i], NULL, dispatch_consumer, &cargs[i]);
+     }
+     for (int i = 0; i < nump; i++)
+     {
+          pargs[i] = (struct producer_arg){.run = &run, .seed = 1000 + i};
+          pthread_create(&producers[i], NULL, dispatch_producer, &pargs[i]);
+     }
+     for (int i = 0; i < nump; i++)
+          pthread_join(producers[i], NULL);
+     for (int i = 0; i < nq; i++)
+          queue_shutdown(queues[i]);
+     for (int i = 0; i < nq; i++)
+          pthread_join(consumers[i], NULL);
+     uint64_t elapsed = bench_now_ns() - start;
+
+     struct latency all;
+     latency_init(&all);
+     for (int i = 0; i < nq; i++)
+     {
+          latency_merge(&all, &cargs[i].lat);
+          latency_free(&cargs[i].lat);
+          queue_destroy(queues[i]);
+     }
+     double spread = 0.0;
+     long samples = 0;
+     for (int i = 0; i < nump; i++)
+     {
+          spread += pargs[i].spread;
+          samples += pargs[i].samples;
+     }
+
+     fprintf(stdout, "%-12s %12.0f %10.1f %10.1f %10.1f %10.2f\n", name,
+             all.n / (elapsed / 1e9),
+             latency_mean(&all) / 1e3,
+             latency_percentile(&all, 50) / 1e3,
+             latency_percentile(&all, 99) / 1e3,
+             samples ? spread / samples : 0.0);
+     latency_free(&all);
+     dispatcher_destroy(run.d);
+}
+
+int bench_dispatch(const struct bench_opts *o)
+{
+     fprintf(stderr, "Dispatching %d items from %d producers over %d queues of size %d\n",
+             o->numitems, o->nump, o->numc, o->queue_size);
+     fprintf(stdout, "%-12s %12s %10s %10s %10s %10s\n",
+             "policy", "items/s", "mean(us)", "p50(us)", "p99(us)", "imbalance");
+     run_policy(o, DISPATCH_ROUND_ROBIN, "round-robin");
+     run_policy(o, DISPATCH_TWO_CHOICES, "two-choices");
+     run_policy(o, DISPATCH_SHORTEST, "shortest");
+     return 0;
+}
@@ -0,0 +1,292 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/eventfd.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include "bench.h"
+#include "../src/lab.h"
+#include "../src/multiqueue.h"
+
+/*
+ * IPC baseline benchmark. One producer thread sends -i items to one consumer
+ * thread through each transport in turn: a pipe, an eventfd-signalled ring
+ * buffer, a unix socketpair, queue_t (with -B consumer batching when given)
+ * and the multiqueue. Every item is its send timestamp, so the consumer
+ * records end-to-end latency. CPU per item is user plus system time of the
+ * whole process divided by the items moved. Kernel transports carry one
+ * 8 byte item per system call, as a naive port would.
+ */
+
+struct channel
+{
+     int fds[2];      /*pipe or socketpair, [0] reads and [1] writes*/
+     int items_fd;    /*eventfd counting items in the ring*/
+     int space_fd;    /*eventfd counting free slots in the ring*/
+     uint64_t *ring;
+     int cap;
+     uint64_t head;   /*consumer position, consumer only*/
+     uint64_t tail;   /*producer position, producer only*/
+     uint64_t avail;  /*items the consumer has been told about*/
+     uint64_t credit; /*free slots the producer has been told about*/
+     queue_t q;
+     multiqueue_t mq;
+};
+
+/**
+ * A transport moves nonzero 64 bit values. recv() returns 0 once the sender
+ * has called finish() and everything sent before it has been received.
+ */
+struct transport
+{
+     const char *name;
+     int (*open)(struct channel *ch, const struct bench_opts *o);
+     void (*send)(struct channel *ch, uint64_t v);
+     uint64_t (*recv)(struct channel *ch);
+     void (*finish)(struct channel *ch);
+     void (*close)(struct channel *ch);
+};
+
+static int pipe_open(struct channel *ch, const struct bench_opts *o)
+{
+     (void)o;
+     return pipe(ch->fds);
+}
+
+static int socket_open(struct channel *ch, const struct bench_opts *o)
+{
+     (void)o;
+     return socketpair(AF_UNIX, SOCK_STREAM, 0, ch->fds);
+}
+
+static void fd_send(struct channel *ch, uint64_t v)
+{
+     if (write(ch->fds[1], &v, sizeof(v)) != sizeof(v))
+          perror("write");
+}
+
+static uint64_t fd_recv(struct channel *ch)
+{
+     uint64_t v;
+     size_t got = 0;
+     /*a stream may split an item across reads*/
+     while (got < sizeof(v))
+     {
+          ssize_t r = read(ch->fds[0], (char *)&v + got, sizeof(v) - got);
+          if (r <= 0)
+               return 0;
+          got += r;
+     }
+     return v;
+}
+
+static void fd_finish(struct channel *ch)
+{
+     close(ch->fds[1]);
+     ch->fds[1] = -1;
+}
+
+static void fd_close(struct channel *ch)
+{
+     close(ch->fds[0]);
+     if (ch->fds[1] >= 0)
+          close(ch->fds[1]);
+}
+
+static int eventfd_open(struct channel *ch, const struct bench_opts *o)
+{
+     ch->cap = o->queue_size > 0 ? o->queue_size : 1;
+     ch->ring = (uint64_t *)malloc(ch->cap * sizeof(uint64_t));
+     ch->items_fd = eventfd(0, 0);
+     ch->space_fd = eventfd(ch->cap, 0);
+     if (!ch->ring || ch->items_fd < 0 || ch->space_fd < 0)
+     {
+          /*the driver only closes channels that opened*/
+          if (ch->items_fd >= 0)
+               close(ch->items_fd);
+          if (ch->space_fd >= 0)
+               close(ch->space_fd);
+          free(ch->ring);
+          ch->ring = NULL;
+          return -1;
+     }
+     return 0;
+}
+
+static void eventfd_send(struct channel *ch, uint64_t v)
+{
+     uint64_t one = 1;
+     if (ch->credit == 0 && read(ch->space_fd, &ch->credit, sizeof(ch->credit)) != sizeof(ch->credit))
+          perror("read eventfd");
+     ch->credit--;
+     __atomic_store_n(&ch->ring[ch->tail++ % ch->cap], v, __ATOMIC_RELEASE);
+     if (write(ch->items_fd, &one, sizeof(one)) != sizeof(one))
+          perror("write eventfd");
+}
+
+static uint64_t eventfd_recv(struct channel *ch)
+{
+     uint64_t one = 1;
+     if (ch->avail == 0 && read(ch->items_fd, &ch->avail, sizeof(ch->avail)) != sizeof(ch->avail))
+          return 0;
+     ch->avail--;
+     uint64_t v = __atomic_load_n(&ch->ring[ch->head++ % ch->cap], __ATOMIC_ACQUIRE);
+     if (write(ch->space_fd, &one, sizeof(one)) != sizeof(one))
+          perror("write eventfd");
+     return v;
+}
+
+static void eventfd_finish(struct channel *ch)
+{
+     eventfd_send(ch, 0); /*zero is never a timestamp*/
+}
+
+static void eventfd_close(struct channel *ch)
+{
+     close(ch->items_fd);
+     close(ch->space_fd);
+     free(ch->ring);
+}
+
+static int queue_open(struct channel *ch, const struct bench_opts *o)
+{
+     ch->q = queue_init(o->queue_size);
+     if (!ch->q)
+          return -1;
+     queue_set_consumer_batch(ch->q, o->batch);
+     return 0;
+}
+
+static void queue_send(struct channel *ch, uint64_t v)
+{
+     enqueue(ch->q, (void *)(uintptr_t)v);
+}
+
+static uint64_t queue_recv(struct channel *ch)
+{
+     return (uint64_t)(uintptr_t)dequeue(ch->q);
+}
+
+static void queue_finish(struct channel *ch)
+{
+     queue_shutdown(ch->q);
+}
+
+static void queue_close(struct channel *ch)
+{
+     queue_destroy(ch->q);
+}
+
+static int mq_open(struct channel *ch, const struct bench_opts *o)
+{
+     ch->mq = multiqueue_init(o->queue_size, 2, 2);
+     return ch->mq ? 0 : -1;
+}
+
+static void mq_send(struct channel *ch, uint64_t v)
+{
+     multiqueue_enqueue(ch->mq, (void *)(uintptr_t)v);
+}
+
+static uint64_t mq_recv(struct channel *ch)
+{
+     return (uint64_t)(uintptr_t)multiqueue_dequeue(ch->mq);
+}
+
+static void mq_finish(struct channel *ch)
+{
+     multiqueue_shutdown(ch->mq);
+}
+
+static void mq_close(struct channel *ch)
+{
+     multiqueue_destroy(ch->mq);
+}
+
+static const struct transport transports[] = {
+    {"pipe", pipe_open, fd_send, fd_recv, fd_finish, fd_close},
+    {"eventfd", eventfd_open, eventfd_send, eventfd_recv, eventfd_finish, eventfd_close},
+    {"socketpair", socket_open, fd_send, fd_recv, fd_finish, fd_close},
+    {"queue_t", queue_open, queue_send, queue_recv, queue_finish, queue_close},
+    {"multiqueue", mq_open, mq_send, mq_recv, mq_finish, mq_close},
+};
+
+struct ipc_run
+{
+     const struct transport *t;
+     struct channel ch;
+     int numitems;
+     struct latency lat;
+};
+
+static void *ipc_producer(void *args)
+{
+     struct ipc_run *r = (struct ipc_run *)args;
+     for (int i = 0; i < r->numitems; i++)
+          r->t->send(&r->ch, bench_now_ns());
+     r->t->finish(&r->ch);
+     return NULL;
+}
+
+static void *ipc_consumer(void *args)
+{
+     struct ipc_run *r = (struct ipc_run *)args;
+     uint64_t v;
+     while ((v = r->t->recv(&r->ch)) != 0)
+          latency_add(&r->lat, bench_now_ns() - v);
+     return NULL;
+}
+
+static uint64_t cpu_ns(void)
+{
+     struct rusage ru;
+     getrusage(RUSAGE_SELF, &ru);
+     return (uint64_t)(ru.ru_utime.tv_sec + ru.ru_stime.tv_sec) * 1000000000ull +
+            (uint64_t)(ru.ru_utime.tv_usec + ru.ru_stime.tv_usec) * 1000ull;
+}
+
+int bench_ipc(const struct bench_opts *o)
+{
+     fprintf(stderr, "Moving %d items from one producer to one consumer, queue size %d\n",
+             o->numitems, o->queue_size);
+     fprintf(stdout, "%-11s %12s %9s %9s %9s %11s\n",
+             "transport", "items/s", "p50 ns", "p99 ns", "p99.9 ns", "cpu ns/item");
+
+     for (size_t i = 0; i < sizeof(transports) / sizeof(transports[0]); i++)
+     {
+          struct ipc_run r;
+          memset(&r, 0, sizeof(r));
+          r.t = &transports[i];
+          r.numitems = o->numitems;
+          latency_init(&r.lat);
+          if (r.t->open(&r.ch, o) != 0)
+          {
+               perror(r.t->name);
+               continue;
+          }
+
+          pthread_t producer, consumer;
+          uint64_t cpu = cpu_ns();
+          uint64_t start = bench_now_ns();
+          pthread_create(&consumer, NULL, ipc_consumer, &r);
+          pthread_create(&producer, NULL, ipc_producer, &r);
+          pthread_join(producer, NULL);
+          pthread_join(consumer, NULL);
+          double secs = (bench_now_ns() - start) / 1e9;
+          cpu = cpu_ns() - cpu;
+          r.t->close(&r.ch);
+
+          fprintf(stdout, "%-11s %12.0f %9lu %9lu %9lu %11.0f\n", r.t->name,
+                  r.lat.n / secs,
+                  (unsigned long)latency_percentile(&r.lat, 50),
+                  (unsigned long)latency_percentile(&r.lat, 99),
+                  (unsigned long)latency_percentile(&r.lat, 99.9),
+                  r.lat.n ? (double)cpu / r.lat.n : 0.0);
+          if (r.lat.n != (size_t)o->numitems)
+               fprintf(stderr, "ERROR! %s moved %zu of %d items\n", r.t->name, r.lat.n, o->numitems);
+          latency_free(&r.lat);
+     }
+     return 0;
+}
@@ -0,0 +1,161 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "bench.h"
+#include "../src/lab.h"
+#include "../src/lanes.h"
+
+/*
+ * Affinity benchmark. -c consumers are pinned round-robin over the available
+ * CPUs and each owns a lane plus a block of per-lane state, standing in for
+ * a per-CPU cache or a connection's buffers. -p producers tag each item with
+ * a lane and processing an item updates that lane's state. Items go either
+ * through one shared queue_t, where any consumer may get any lane's item,
+ * or through the multi-lane queue with the tag as hint, where the owner
+ * serves it unless it has waited LANE_STEAL_NS.
+ */
+
+#define LANE_STATE (64 * 1024) /*bytes of state per lane*/
+#define LANE_STEAL_NS 50000
+#define MAX_LANES 64
+
+struct lane_item
+{
+     uint64_t stamp;
+     int lane;
+     int seq;
+};
+
+struct lanes_run
+{
+     queue_t q;
+     laneq_t lq;
+     int nlanes;
+     int per_producer;
+     int cpus[MAX_LANES];
+     int ncpus;
+     char *state[MAX_LANES];
+     struct latency lat[MAX_LANES];
+};
+
+struct lanes_arg
+{
+     struct lanes_run *r;
+     int id;
+};
+
+static void *lanes_producer(void *args)
+{
+     struct lanes_arg *a = (struct lanes_arg *)args;
+     struct lanes_run *r = a->r;
+     bench_pin_cpu(r->cpus[a->id % r->ncpus]);
+     for (int i = 0; i < r->per_producer; i++)
+     {
+          struct lane_item *it = (struct lane_item *)malloc(sizeof(*it));
+          it->lane = (a->id + i) % r->nlanes;
+          it->seq = i;
+          it->stamp = bench_now_ns();
+          if (r->lq)
+               laneq_enqueue(r->lq, it, it->lane);
+          else
+               enqueue(r->q, it);
+     }
+     return NULL;
+}
+
+static void *lanes_consumer(void *args)
+{
+     struct lanes_arg *a = (struct lanes_arg *)args;
+     struct lanes_run *r = a->r;
+     struct lane_item *it;
+     bench_pin_cpu(r->cpus[a->id % r->ncpus]);
+     while ((it = (struct lane_item *)(r->lq ? laneq_dequeue(r->lq, a->id) : dequeue(r->q))) != NULL)
+     {
+          /*touch a stride of the lane's state, cheap if it is in our cache*/
+          char *st = r->state[it->lane];
+          for (int off = (it->seq * 64) % 4096; off < LANE_STATE; off += 4096)
+               st[off]++;
+          latency_add(&r->lat[a->id], bench_now_ns() - it->stamp);
+          free(it);
+     }
+     return NULL;
+}
+
+int bench_lanes(const struct bench_opts *o)
+{
+     struct lanes_run r;
+     memset(&r, 0, sizeof(r));
+     int nump = o->nump;
+     r.nlanes = o->numc > MAX_LANES ? MAX_LANES : o->numc;
+     r.per_producer = o->numitems / nump;
+     r.ncpus = bench_cpus(r.cpus, MAX_LANES);
+     if (r.ncpus == 0)
+          return 1;
+     for (int i = 0; i < r.nlanes; i++)
+          r.state[i] = (char *)calloc(1, LANE_STATE);
+     fprintf(stderr, "%d producers, %d consumers on %d CPUs, %d items, steal after %dns\n",
+             nump, r.nlanes, r.ncpus, o->numitems, LANE_STEAL_NS);
+     fprintf(stdout, "%-8s %12s %9s %9s %8s\n", "queue", "items/s", "p50 ns", "p99 ns", "local");
+
+     for (int hinted = 0; hinted <= 1; hinted++)
+     {
+          if (hinted)
+               r.lq = laneq_init(r.nlanes, o->queue_size, LANE_STEAL_NS);
+          else
+               r.q = queue_init(o->queue_size);
+          pthread_t producers[nump];
+          pthread_t consumers[r.nlanes];
+          struct lanes_arg pargs[nump];
+          struct lanes_arg cargs[r.nlanes];
+
+          uint64_t start = bench_now_ns();
+          for (int i = 0; i < r.nlanes; i++)
+          {
+               latency_init(&r.lat[i]);
+               cargs[i] = (struct lanes_arg){&r, i};
+               pthread_create(&consumers[i], NULL, lanes_consumer, &cargs[i]);
+          }
+          for (int i = 0; i < nump; i++)
+          {
+               pargs[i] = (struct lanes_arg){&r, i};
+               pthread_create(&producers[i], NULL, lanes_producer, &pargs[i]);
+          }
+          for (int i = 0; i < nump; i++)
+               pthread_join(producers[i], NULL);
+          if (r.lq)
+               laneq_shutdown(r.lq);
+          else
+               queue_shutdown(r.q);
+          for (int i = 0; i < r.nlanes; i++)
+               pthread_join(consumers[i], NULL);
+          double secs = (bench_now_ns() - start) / 1e9;
+
+          struct latency all;
+          latency_init(&all);
+          for (int i = 0; i < r.nlanes; i++)
+          {
+               latency_merge(&all, &r.lat[i]);
+               latency_free(&r.lat[i]);
+          }
+          char local[16] = "-";
+          if (r.lq)
+          {
+               uint64_t l, s;
+               laneq_stats(r.lq, &l, &s);
+               snprintf(local, sizeof(local), "%.1f%%", l + s ? 100.0 * l / (l + s) : 0.0);
+          }
+          fprintf(stdout, "%-8s %12.0f %9lu %9lu %8s\n", hinted ? "lanes" : "queue_t",
+                  all.n / secs,
+                  (unsigned long)latency_percentile(&all, 50),
+                  (unsigned long)latency_percentile(&all, 99), local);
+          latency_free(&all);
+          laneq_destroy(r.lq);
+          queue_destroy(r.q);
+          r.lq = NULL;
+          r.q = NULL;
+     }
+     for (int i = 0; i < r.nlanes; i++)
+          free(r.state[i]);
+     return 0;
+}
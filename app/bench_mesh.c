@@ -0,0 +1,135 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include <sched.h>
+#include "bench.h"
+#include "../src/lab.h"
+#include "../src/percore.h"
+
+/*
+ * All-to-all benchmark. max(-p, 2) workers each send -i / workers messages
+ * spread evenly over every other worker. The thread-per-core runtime moves
+ * them over its SPSC mesh (rings of -s slots); the baseline gives every
+ * worker an inbound queue_t that all other workers enqueue into. Baseline
+ * queues hold everything a worker will receive, so senders never block.
+ * Workers are pinned round-robin over the available CPUs in both runs.
+ */
+
+#define MAX_WORKERS 64
+
+struct mesh_run
+{
+     int nworkers;
+     int per_worker;
+     int cpus[MAX_WORKERS];
+     int ncpus;
+     queue_t inbox[MAX_WORKERS];
+     long received[MAX_WORKERS];
+};
+
+static inline int mesh_dest(int self, int i, int n)
+{
+     return (self + 1 + i % (n - 1)) % n;
+}
+
+static void mesh_handler(percore_t p, int self, int from, void *msg, void *ctx)
+{
+     (void)p;
+     (void)from;
+     (void)msg;
+     ((struct mesh_run *)ctx)->received[self]++;
+}
+
+static void mesh_main(percore_t p, int self, void *ctx)
+{
+     struct mesh_run *r = (struct mesh_run *)ctx;
+     for (int i = 0; i < r->per_worker; i++)
+     {
+          percore_send(p, self, mesh_dest(self, i, r->nworkers), r);
+          if (i % 16 == 15)
+               percore_poll(p, self, 64);
+     }
+}
+
+struct shared_arg
+{
+     struct mesh_run *r;
+     int self;
+};
+
+static void *shared_worker(void *args)
+{
+     struct shared_arg *a = (struct shared_arg *)args;
+     struct mesh_run *r = a->r;
+     void *items[64];
+     bench_pin_cpu(r->cpus[a->self % r->ncpus]);
+     for (int i = 0; i < r->per_worker; i++)
+     {
+          enqueue(r->inbox[mesh_dest(a->self, i, r->nworkers)], r);
+          if (i % 16 == 15 && queue_size(r->inbox[a->self]) > 0)
+               r->received[a->self] += dequeue_batch(r->inbox[a->self], items, 64);
+     }
+     /*every worker receives exactly per_worker messages*/
+     while (r->received[a->self] < r->per_worker)
+          r->received[a->self] += dequeue_batch(r->inbox[a->self], items, 64);
+     return NULL;
+}
+
+static void report(const char *name, struct mesh_run *r, uint64_t ns)
+{
+     long total = 0;
+     for (int i = 0; i < r->nworkers; i++)
+          total += r->received[i];
+     fprintf(stdout, "%-10s %14.0f %10.1f\n", name, total / (ns / 1e9), (double)ns / total);
+     if (total != (long)r->per_worker * r->nworkers)
+          fprintf(stderr, "ERROR! %s delivered %ld of %ld messages\n", name, total,
+                  (long)r->per_worker * r->nworkers);
+}
+
+int bench_mesh(const struct bench_opts *o)
+{
+     struct mesh_run r;
+     r.nworkers = o->nump < 2 ? 2 : (o->nump > MAX_WORKERS ? MAX_WORKERS : o->nump);
+     r.per_worker = o->numitems / r.nworkers;
+     r.ncpus = bench_cpus(r.cpus, MAX_WORKERS);
+     if (r.ncpus == 0)
+          return 1;
+     int pins[MAX_WORKERS];
+     for (int i = 0; i < r.nworkers; i++)
+          pins[i] = r.cpus[i % r.ncpus];
+     fprintf(stderr, "All-to-all between %d workers on %d CPUs, %d messages each, ring size %d\n",
+             r.nworkers, r.ncpus, r.per_worker, o->queue_size);
+     fprintf(stdout, "%-10s %14s %10s\n", "engine", "messages/s", "ns/msg");
+
+     /*thread-per-core over the SPSC mesh*/
+     for (int i = 0; i < r.nworkers; i++)
+          r.received[i] = 0;
+     percore_t p = percore_init(r.nworkers, o->queue_size, pins, mesh_handler, &r);
+     if (!p)
+          return 1;
+     uint64_t start = bench_now_ns();
+     percore_run(p, mesh_main, &r);
+     report("percore", &r, bench_now_ns() - start);
+     percore_destroy(p);
+
+     /*one shared queue_t inbox per worker*/
+     pthread_t threads[MAX_WORKERS];
+     struct shared_arg args[MAX_WORKERS];
+     for (int i = 0; i < r.nworkers; i++)
+     {
+          r.received[i] = 0;
+          r.inbox[i] = queue_init(r.per_worker > 0 ? r.per_worker : 1);
+     }
+     start = bench_now_ns();
+     for (int i = 0; i < r.nworkers; i++)
+     {
+          args[i] = (struct shared_arg){&r, i};
+          pthread_create(&threads[i], NULL, shared_worker, &args[i]);
+     }
+     for (int i = 0; i < r.nworkers; i++)
+          pthread_join(threads[i], NULL);
+     report("queue_t", &r, bench_now_ns() - start);
+     for (int i = 0; i < r.nworkers; i++)
+          queue_destroy(r.inbox[i]);
+     return 0;
+}
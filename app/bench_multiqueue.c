@@ -0,0 +1,94 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include "bench.h"
+#include "../src/lab.h"
+#include "../src/multiqueue.h"
+
+/*
+ * Thread scaling benchmark. Runs t producers and t consumers for t = 1, 2,
+ * 4, ... up to max(-p, -c) against the strict FIFO queue_t and against the
+ * relaxed multiqueue, and reports throughput for both.
+ */
+
+struct scale_run
+{
+     queue_t q;
+     multiqueue_t mq;
+     int per_thread;
+};
+
+static void *scale_producer(void *args)
+{
+     struct scale_run *r = (struct scale_run *)args;
+     for (int i = 0; i < r->per_thread; i++)
+     {
+          /*items are never dereferenced, any non-NULL pointer will do*/
+          void *itm = (void *)(intptr_t)(i + 1);
+          if (r->mq)
+               multiqueue_enqueue(r->mq, itm);
+          else
+               enqueue(r->q, itm);
+     }
+     return NULL;
+}
+
+static void *scale_consumer(void *args)
+{
+     struct scale_run *r = (struct scale_run *)args;
+     if (r->mq)
+          while (multiqueue_dequeue(r->mq))
+               ;
+     else
+          while (dequeue(r->q))
+               ;
+     return NULL;
+}
+
+static double run_scale(const struct bench_opts *o, int t, bool relaxed)
+{
+     pthread_t producers[t];
+     pthread_t consumers[t];
+     struct scale_run r = {NULL, NULL, o->numitems / t};
+
+     if (relaxed)
+          r.mq = multiqueue_init(o->queue_size, 2 * t, 2);
+     else
+          r.q = queue_init(o->queue_size);
+
+     uint64_t start = bench_now_ns();
+     for (int i = 0; i < t; i++)
+          pthread_create(&consumers[i], NULL, scale_consumer, &r);
+     for (int i = 0; i < t; i++)
+          pthread_create(&producers[i], NULL, scale_producer, &r);
+     for (int i = 0; i < t; i++)
+          pthread_join(producers[i], NULL);
+     if (relaxed)
+          multiqueue_shutdown(r.mq);
+     else
+          queue_shutdown(r.q);
+     for (int i = 0; i < t; i++)
+          pthread_join(consumers[i], NULL);
+     uint64_t elapsed = bench_now_ns() - start;
+
+     if (relaxed)
+          multiqueue_destroy(r.mq);
+     else
+          queue_destroy(r.q);
+     return (double)r.per_thread * t / (elapsed / 1e9);
+}
+
+int bench_multiqueue(const struct bench_opts *o)
+{
+     int max = o->nump > o->numc ? o->nump : o->numc;
+     fprintf(stderr, "Moving %d items through a queue of size %d with up to %d producer/consumer pairs\n",
+             o->numitems, o->queue_size, max);
+     fprintf(stdout, "%8s %14s %14s %8s\n", "threads", "queue_t/s", "multiqueue/s", "speedup");
+     for (int t = 1; t <= max; t *= 2)
+     {
+          double strict = run_scale(o, t, false);
+          double relaxed = run_scale(o, t, true);
+          fprintf(stdout, "%8d %14.0f %14.0f %8.2f\n", t, strict, relaxed, relaxed / strict);
+     }
+     return 0;
+}
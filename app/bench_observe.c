@@ -0,0 +1,108 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include "bench.h"
+#include "../src/lab.h"
+
+/*
+ * Observer contention benchmark. Producers and consumers move items through
+ * one queue while 0, 1, 2, ... monitor threads poll is_empty, is_shutdown,
+ * queue_size and the waiter counts as fast as they can. Since none of the
+ * queries take the queue lock, throughput should not drop as monitors are
+ * added (on a machine with spare cores).
+ */
+
+struct observe_run
+{
+     queue_t q;
+     int per_thread;
+     bool stop;
+};
+
+struct monitor_arg
+{
+     struct observe_run *run;
+     long queries;
+};
+
+static void *observe_producer(void *args)
+{
+     struct observe_run *r = (struct observe_run *)args;
+     for (int i = 0; i < r->per_thread; i++)
+          enqueue(r->q, (void *)(intptr_t)(i + 1));
+     return NULL;
+}
+
+static void *observe_consumer(void *args)
+{
+     struct observe_run *r = (struct observe_run *)args;
+     while (dequeue(r->q) || !is_shutdown(r->q))
+          ;
+     return NULL;
+}
+
+static void *observe_monitor(void *args)
+{
+     struct monitor_arg *a = (struct monitor_arg *)args;
+     long sink = 0;
+     while (!__atomic_load_n(&a->run->stop, __ATOMIC_RELAXED))
+     {
+          sink += is_empty(a->run->q);
+          sink += is_shutdown(a->run->q);
+          sink += queue_size(a->run->q);
+          sink += queue_waiting_producers(a->run->q);
+          sink += queue_waiting_consumers(a->run->q);
+          a->queries += 5;
+     }
+     return (void *)(intptr_t)sink;
+}
+
+int bench_observe(const struct bench_opts *o)
+{
+     int nump = o->nump;
+     int numc = o->numc;
+     fprintf(stderr, "Moving %d items with %d producers and %d consumers, queue size %d\n",
+             o->numitems, nump, numc, o->queue_size);
+     fprintf(stdout, "%9s %14s %16s\n", "monitors", "items/s", "queries/s");
+
+     for (int m = 0; m <= 4; m = m ? m * 2 : 1)
+     {
+          struct observe_run r = {queue_init(o->queue_size), o->numitems / nump, false};
+          queue_set_consumer_batch(r.q, o->batch);
+          pthread_t producers[nump];
+          pthread_t consumers[numc];
+          pthread_t monitors[m > 0 ? m : 1];
+          struct monitor_arg margs[m > 0 ? m : 1];
+
+          for (int i = 0; i < m; i++)
+          {
+               margs[i] = (struct monitor_arg){&r, 0};
+               pthread_create(&monitors[i], NULL, observe_monitor, &margs[i]);
+          }
+          uint64_t start = bench_now_ns();
+          for (int i = 0; i < numc; i++)
+               pthread_create(&consumers[i], NULL, observe_consumer, &r);
+          for (int i = 0; i < nump; i++)
+               pthread_create(&producers[i], NULL, observe_producer, &r);
+          for (int i = 0; i < nump; i++)
+               pthread_join(producers[i], NULL);
+          queue_shutdown(r.q);
+          for (int i = 0; i < numc; i++)
+               pthread_join(consumers[i], NULL);
+          uint64_t elapsed = bench_now_ns() - start;
+
+          __atomic_store_n(&r.stop, true, __ATOMIC_RELAXED);
+          long queries = 0;
+          for (int i = 0; i < m; i++)
+          {
+               pthread_join(monitors[i], NULL);
+               queries += margs[i].queries;
+          }
+          queue_destroy(r.q);
+
+          fprintf(stdout, "%9d %14.0f %16.0f\n", m,
+                  (double)r.per_thread * nump / (elapsed / 1e9),
+                  queries / (elapsed / 1e9));
+     }
+     return 0;
+}
@@ -0,0 +1,86 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include <time.h>
+#include "bench.h"
+#include "../src/workpool.h"
+
+/*
+ * Overload policy benchmark. -p submitters push -i tasks in bursts into a
+ * worker pool of -c threads with -s queue slots. One task in four does
+ * OVERLOAD_WORK_NS of work, the rest are tiny. The pool either blocks
+ * submitters while its queue is full or lets them run tasks themselves;
+ * the run ends when every task has finished.
+ */
+
+#define OVERLOAD_BURST 256
+#define OVERLOAD_GAP_NS 200000 /*pause between bursts*/
+#define OVERLOAD_WORK_NS 5000
+
+struct overload_run
+{
+     workpool_t pool;
+     int per_submitter;
+     uint64_t done;
+};
+
+static void tiny_task(void *arg)
+{
+     struct overload_run *r = (struct overload_run *)arg;
+     __atomic_fetch_add(&r->done, 1, __ATOMIC_RELAXED);
+}
+
+static void work_task(void *arg)
+{
+     bench_spin_ns(OVERLOAD_WORK_NS);
+     tiny_task(arg);
+}
+
+static void *submitter(void *args)
+{
+     struct overload_run *r = (struct overload_run *)args;
+     struct timespec gap = {0, OVERLOAD_GAP_NS};
+     for (int i = 0; i < r->per_submitter; i++)
+     {
+          if (i > 0 && i % OVERLOAD_BURST == 0)
+               nanosleep(&gap, NULL);
+          bool tiny = i % 4 != 0;
+          workpool_submit(r->pool, tiny ? tiny_task : work_task, r, tiny);
+     }
+     return NULL;
+}
+
+int bench_overload(const struct bench_opts *o)
+{
+     static const char *names[] = {"block", "caller-runs"};
+     fprintf(stderr, "Submitting %d tasks from %d threads in bursts of %d to %d workers, queue size %d\n",
+             o->numitems, o->nump, OVERLOAD_BURST, o->numc, o->queue_size);
+     fprintf(stdout, "%-12s %12s %10s %10s %10s\n", "policy", "tasks/s", "queued", "ran full", "ran busy");
+
+     for (int policy = WORKPOOL_BLOCK; policy <= WORKPOOL_CALLER_RUNS; policy++)
+     {
+          struct overload_run r = {NULL, o->numitems / o->nump, 0};
+          r.pool = workpool_init(o->numc, o->queue_size, (enum workpool_policy)policy);
+          if (!r.pool)
+               return 1;
+          pthread_t threads[o->nump];
+
+          uint64_t start = bench_now_ns();
+          for (int i = 0; i < o->nump; i++)
+               pthread_create(&threads[i], NULL, submitter, &r);
+          for (int i = 0; i < o->nump; i++)
+               pthread_join(threads[i], NULL);
+          struct workpool_stats st;
+          workpool_stats(r.pool, &st);
+          workpool_destroy(r.pool); /*runs what is still queued*/
+          double secs = (bench_now_ns() - start) / 1e9;
+
+          long total = (long)r.per_submitter * o->nump;
+          fprintf(stdout, "%-12s %12.0f %10lu %10lu %10lu\n", names[policy], total / secs,
+                  (unsigned long)st.queued, (unsigned long)st.ran_full, (unsigned long)st.ran_busy);
+          if ((long)r.done != total)
+               fprintf(stderr, "ERROR! %s ran %lu of %ld tasks\n", names[policy],
+                       (unsigned long)r.done, total);
+     }
+     return 0;
+}
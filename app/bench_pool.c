@@ -0,0 +1,66 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include "bench.h"
+#include "../src/lab.h"
+#include "../src/qpool.h"
+
+/*
+ * Queue churn benchmark. Each of -p threads handles -i requests in total,
+ * and every request gets its own short-lived queue that carries one item
+ * and is then shut down. The queue comes either from queue_init and goes to
+ * queue_destroy, or comes from and goes back to a shared queue pool.
+ */
+
+struct churn_run
+{
+     queue_pool_t pool;
+     int requests;
+     int capacity;
+};
+
+static void *churn(void *args)
+{
+     struct churn_run *r = (struct churn_run *)args;
+     for (int i = 0; i < r->requests; i++)
+     {
+          queue_t q = r->pool ? queue_pool_get(r->pool) : queue_init(r->capacity);
+          enqueue(q, (void *)r);
+          dequeue(q);
+          queue_shutdown(q);
+          if (r->pool)
+               queue_pool_put(r->pool, q);
+          else
+               queue_destroy(q);
+     }
+     return NULL;
+}
+
+int bench_pool(const struct bench_opts *o)
+{
+     int nthreads = o->nump;
+     fprintf(stderr, "Churning %d per-request queues of size %d on %d threads\n",
+             o->numitems, o->queue_size, nthreads);
+     fprintf(stdout, "%-8s %14s %12s\n", "source", "requests/s", "ns/request");
+
+     for (int pooled = 0; pooled <= 1; pooled++)
+     {
+          struct churn_run r = {NULL, o->numitems / nthreads, o->queue_size};
+          if (pooled)
+               r.pool = queue_pool_init(o->queue_size, 4 * nthreads);
+          pthread_t threads[nthreads];
+
+          uint64_t start = bench_now_ns();
+          for (int i = 0; i < nthreads; i++)
+               pthread_create(&threads[i], NULL, churn, &r);
+          for (int i = 0; i < nthreads; i++)
+               pthread_join(threads[i], NULL);
+          uint64_t ns = bench_now_ns() - start;
+
+          long total = (long)r.requests * nthreads;
+          fprintf(stdout, "%-8s %14.0f %12.1f\n", pooled ? "pool" : "init",
+                  total / (ns / 1e9), (double)ns / total);
+          queue_pool_destroy(r.pool);
+     }
+     return 0;
+}
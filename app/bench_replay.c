@@ -0,0 +1,206 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include <time.h>
+#include "bench.h"
+#include "../src/lab.h"
+#include "../src/multiqueue.h"
+#include "../src/trace.h"
+
+/*
+ * Replays a trace captured with -C against each engine. Every queue id in
+ * the trace gets a producer that enqueues at the recorded arrival times and
+ * a consumer that dequeues no earlier than the recorded departure times, so
+ * the engine sees the production arrival and service pattern. Reports the
+ * sojourn latency and how far the consumers fell behind the recording.
+ */
+
+#define MAX_TRACED_QUEUES 64
+
+struct replay_lane
+{
+     const struct trace_rec *recs; /*the whole trace*/
+     long n;
+     uint16_t id;     /*queue id to replay*/
+     uint64_t t0;     /*first timestamp in the trace*/
+     uint64_t start;  /*when the replay started*/
+     queue_t q;
+     multiqueue_t mq;
+     struct latency lat;
+     uint64_t max_lag; /*worst delay of a dequeue past its recorded time*/
+     long moved;
+};
+
+static void wait_until(uint64_t t)
+{
+     uint64_t now = bench_now_ns();
+     if (t <= now)
+          return;
+     if (t - now > 100000)
+     {
+          /*sleep most of a long gap, spin the rest*/
+          uint64_t ns = t - now - 50000;
+          struct timespec s = {(time_t)(ns / 1000000000ull), (long)(ns % 1000000000ull)};
+          nanosleep(&s, NULL);
+     }
+     while (bench_now_ns() < t)
+          ;
+}
+
+static void *replay_producer(void *args)
+{
+     struct replay_lane *l = (struct replay_lane *)args;
+     for (long i = 0; i < l->n; i++)
+     {
+          const struct trace_rec *r = &l->recs[i];
+          if (r->queue != l->id || r->op != TRACE_ENQ)
+               continue;
+          wait_until(l->start + (r->ts_ns - l->t0));
+          for (int k = 0; k < r->count; k++)
+          {
+               uint64_t *stamp = (uint64_t *)malloc(sizeof(uint64_t));
+               *stamp = bench_now_ns();
+               if (l->mq)
+                    multiqueue_enqueue(l->mq, stamp);
+               else
+                    enqueue(l->q, stamp);
+          }
+     }
+     return NULL;
+}
+
+static void *replay_consumer(void *args)
+{
+     struct replay_lane *l = (struct replay_lane *)args;
+     for (long i = 0; i < l->n; i++)
+     {
+          const struct trace_rec *r = &l->recs[i];
+          if (r->queue != l->id || r->op != TRACE_DEQ)
+               continue;
+          uint64_t due = l->start + (r->ts_ns - l->t0);
+          wait_until(due);
+          for (int k = 0; k < r->count; k++)
+          {
+               uint64_t *stamp = l->mq ? (uint64_t *)multiqueue_dequeue(l->mq)
+                                       : (uint64_t *)dequeue(l->q);
+               if (!stamp)
+                    return NULL;
+               uint64_t now = bench_now_ns();
+               latency_add(&l->lat, now - *stamp);
+               if (now - due > l->max_lag)
+                    l->max_lag = now - due;
+               l->moved++;
+               free(stamp);
+          }
+     }
+     /*leftovers when the trace has more arrivals than departures*/
+     uint64_t *stamp;
+     while ((stamp = l->mq ? (uint64_t *)multiqueue_dequeue(l->mq)
+                           : (uint64_t *)dequeue(l->q)) != NULL)
+     {
+          latency_add(&l->lat, bench_now_ns() - *stamp);
+          l->moved++;
+          free(stamp);
+     }
+     return NULL;
+}
+
+static void run_replay(const struct bench_opts *o, const struct trace_rec *recs, long n,
+                       const uint16_t *ids, int nids, bool relaxed, const char *name)
+{
+     struct replay_lane lanes[nids];
+     pthread_t producers[nids];
+     pthread_t consumers[nids];
+     uint64_t start = bench_now_ns() + 1000000; /*let every thread get going*/
+
+     for (int i = 0; i < nids; i++)
+     {
+          lanes[i] = (struct replay_lane){.recs = recs, .n = n, .id = ids[i],
+                                          .t0 = recs[0].ts_ns, .start = start};
+          if (relaxed)
+               lanes[i].mq = multiqueue_init(o->queue_size, 2, 2);
+          else
+          {
+               lanes[i].q = queue_init(o->queue_size);
+               queue_set_consumer_batch(lanes[i].q, o->batch);
+          }
+          latency_init(&lanes[i].lat);
+          pthread_create(&consumers[i], NULL, replay_consumer, &lanes[i]);
+          pthread_create(&producers[i], NULL, replay_producer, &lanes[i]);
+     }
+
+     struct latency all;
+     latency_init(&all);
+     uint64_t max_lag = 0;
+     long moved = 0;
+     for (int i = 0; i < nids; i++)
+     {
+          pthread_join(producers[i], NULL);
+          if (relaxed)
+               multiqueue_shutdown(lanes[i].mq);
+          else
+               queue_shutdown(lanes[i].q);
+          pthread_join(consumers[i], NULL);
+          latency_merge(&all, &lanes[i].lat);
+          latency_free(&lanes[i].lat);
+          if (lanes[i].max_lag > max_lag)
+               max_lag = lanes[i].max_lag;
+          moved += lanes[i].moved;
+          if (relaxed)
+               multiqueue_destroy(lanes[i].mq);
+          else
+               queue_destroy(lanes[i].q);
+     }
+     uint64_t elapsed = bench_now_ns() - start;
+
+     fprintf(stdout, "%-12s %10ld %10.1f %10.1f %10.1f %12.1f %10.3f\n", name, moved,
+             latency_mean(&all) / 1e3,
+             latency_percentile(&all, 50) / 1e3,
+             latency_percentile(&all, 99) / 1e3,
+             max_lag / 1e3,
+             elapsed / 1e9);
+     latency_free(&all);
+}
+
+int bench_replay(const struct bench_opts *o)
+{
+     if (!o->file)
+     {
+          fprintf(stderr, "replay needs a trace file, capture one with -C and pass it with -f\n");
+          return 1;
+     }
+     FILE *f = fopen(o->file, "rb");
+     if (!f)
+     {
+          perror("Failed to open trace file");
+          return 1;
+     }
+     struct trace_rec *recs = NULL;
+     long n = trace_read(f, &recs);
+     fclose(f);
+     if (n <= 0)
+     {
+          free(recs);
+          return 1;
+     }
+
+     uint16_t ids[MAX_TRACED_QUEUES];
+     int nids = 0;
+     for (long i = 0; i < n; i++)
+     {
+          bool seen = false;
+          for (int j = 0; j < nids; j++)
+               seen = seen || ids[j] == recs[i].queue;
+          if (!seen && nids < MAX_TRACED_QUEUES)
+               ids[nids++] = recs[i].queue;
+     }
+
+     fprintf(stderr, "Replaying %ld records over %d queues spanning %.3f s with queue size %d\n",
+             n, nids, (recs[n - 1].ts_ns - recs[0].ts_ns) / 1e9, o->queue_size);
+     fprintf(stdout, "%-12s %10s %10s %10s %10s %12s %10s\n",
+             "engine", "items", "mean(us)", "p50(us)", "p99(us)", "maxlag(us)", "time(s)");
+     run_replay(o, recs, n, ids, nids, false, "queue_t");
+     run_replay(o, recs, n, ids, nids, true, "multiqueue");
+     free(recs);
+     return 0;
+}
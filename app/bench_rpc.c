@@ -0,0 +1,165 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include "bench.h"
+#include "../src/lab.h"
+#include "../src/rpc.h"
+
+/*
+ * Request/response benchmark. -p caller threads make -i calls in total to
+ * -c worker threads whose handler returns the request unchanged. Modes:
+ *   queues     request queue_t plus one reply queue_t per caller
+ *   rpc        rpc_call(), one call in flight per caller
+ *   pipelined  rpc_send() keeps RPC_DEPTH calls in flight per caller
+ *   batch      rpc_call_batch() with RPC_DEPTH calls per batch
+ * RPC workers take up to -B requests per dequeue, RPC_DEPTH by default.
+ */
+
+#define RPC_DEPTH 16
+
+enum rpc_mode
+{
+     MODE_QUEUES,
+     MODE_RPC,
+     MODE_PIPELINED,
+     MODE_BATCH
+};
+
+static const char *mode_names[] = {"queues", "rpc", "pipelined", "batch"};
+
+struct rpc_run
+{
+     enum rpc_mode mode;
+     int per_caller;
+     rpc_t rpc;
+     queue_t requests;
+     bool failed;
+};
+
+/*a request for the queue pair mode, the reply is the request itself*/
+struct queue_request
+{
+     queue_t reply;
+     intptr_t value;
+};
+
+static void *echo(void *request, void *ctx)
+{
+     (void)ctx;
+     return request;
+}
+
+static void *queue_worker(void *args)
+{
+     struct rpc_run *r = (struct rpc_run *)args;
+     struct queue_request *req;
+     while ((req = (struct queue_request *)dequeue(r->requests)) != NULL)
+          enqueue(req->reply, req);
+     return NULL;
+}
+
+static void *caller(void *args)
+{
+     struct rpc_run *r = (struct rpc_run *)args;
+     int n = r->per_caller;
+     if (r->mode == MODE_QUEUES)
+     {
+          struct queue_request req = {queue_init(1), 0};
+          for (int i = 0; i < n; i++)
+          {
+               req.value = i;
+               enqueue(r->requests, &req);
+               if (dequeue(req.reply) != &req)
+                    r->failed = true;
+          }
+          queue_destroy(req.reply);
+     }
+     else if (r->mode == MODE_RPC)
+     {
+          for (intptr_t i = 1; i <= n; i++)
+               if ((intptr_t)rpc_call(r->rpc, (void *)i) != i)
+                    r->failed = true;
+     }
+     else if (r->mode == MODE_PIPELINED)
+     {
+          rpc_call_t calls[RPC_DEPTH];
+          for (int i = 0; i < n; i++)
+          {
+               /*wait for the call sent RPC_DEPTH calls ago before reusing its place*/
+               if (i >= RPC_DEPTH && (intptr_t)rpc_wait(r->rpc, calls[i % RPC_DEPTH]) != i - RPC_DEPTH + 1)
+                    r->failed = true;
+               calls[i % RPC_DEPTH] = rpc_send(r->rpc, (void *)(intptr_t)(i + 1));
+          }
+          for (int i = n > RPC_DEPTH ? n - RPC_DEPTH : 0; i < n; i++)
+               if ((intptr_t)rpc_wait(r->rpc, calls[i % RPC_DEPTH]) != i + 1)
+                    r->failed = true;
+     }
+     else
+     {
+          void *req[RPC_DEPTH], *rep[RPC_DEPTH];
+          for (int i = 0; i < n; i += RPC_DEPTH)
+          {
+               int k = n - i < RPC_DEPTH ? n - i : RPC_DEPTH;
+               for (int j = 0; j < k; j++)
+                    req[j] = (void *)(intptr_t)(i + j + 1);
+               if (rpc_call_batch(r->rpc, req, rep, k) != k)
+                    r->failed = true;
+               for (int j = 0; j < k; j++)
+                    if (rep[j] != req[j])
+                         r->failed = true;
+          }
+     }
+     return NULL;
+}
+
+int bench_rpc(const struct bench_opts *o)
+{
+     int ncallers = o->nump;
+     int nworkers = o->numc;
+     int batch = o->batch > 0 ? o->batch : RPC_DEPTH;
+     fprintf(stderr, "%d callers making %d calls to %d workers, request queue size %d\n",
+             ncallers, o->numitems, nworkers, o->queue_size);
+     fprintf(stdout, "%-10s %12s %10s\n", "mode", "calls/s", "ns/call");
+
+     for (int m = MODE_QUEUES; m <= MODE_BATCH; m++)
+     {
+          struct rpc_run r = {(enum rpc_mode)m, o->numitems / ncallers, NULL, NULL, false};
+          pthread_t callers[ncallers];
+          pthread_t workers[nworkers];
+          if (m == MODE_QUEUES)
+          {
+               r.requests = queue_init(o->queue_size);
+               for (int i = 0; i < nworkers; i++)
+                    pthread_create(&workers[i], NULL, queue_worker, &r);
+          }
+          else
+          {
+               r.rpc = rpc_init(o->queue_size, ncallers * RPC_DEPTH, echo, NULL, nworkers, batch);
+               if (!r.rpc)
+                    return 1;
+          }
+
+          uint64_t start = bench_now_ns();
+          for (int i = 0; i < ncallers; i++)
+               pthread_create(&callers[i], NULL, caller, &r);
+          for (int i = 0; i < ncallers; i++)
+               pthread_join(callers[i], NULL);
+          uint64_t ns = bench_now_ns() - start;
+
+          if (m == MODE_QUEUES)
+          {
+               queue_shutdown(r.requests);
+               for (int i = 0; i < nworkers; i++)
+                    pthread_join(workers[i], NULL);
+               queue_destroy(r.requests);
+          }
+          else
+               rpc_destroy(r.rpc);
+
+          long total = (long)r.per_caller * ncallers;
+          fprintf(stdout, "%-10s %12.0f %10.1f\n", mode_names[m], total / (ns / 1e9), (double)ns / total);
+          if (r.failed)
+               fprintf(stderr, "ERROR! %s returned a wrong reply\n", mode_names[m]);
+     }
+     return 0;
+}
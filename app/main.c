@@ -4,8 +4,12 @@
 #include <unistd.h>
 #include <stdbool.h>
 #include <time.h>
-#include <sys/time.h> /* for gettimeofday system call */
+#include <string.h>
 #include "../src/lab.h"
+#include "../src/trace.h"
+#include "../src/clock.h"
+#include "../src/sketch.h"
+#include "bench.h"
 
 #define UNUSED(x) (void)x
 #define MAX_C 8           /* Maximum number of consumer threads */
@@ -14,11 +18,31 @@
 
 static bool delay = false;
 
+/*Benchmarks that can be run instead of the default simulation*/
+static const struct
+{
+     const char *name;
+     int (*run)(const struct bench_opts *o);
+     const char *desc;
+} benchmarks[] = {
+    {"aimd", bench_aimd, "fixed batch sizes vs the adaptive batch controller at low and high load"},
+    {"arena", bench_arena, "malloc/free per payload vs region arenas recycled per sealed batch"},
+    {"cores", bench_cores, "core-to-core cache line latency matrix next to queue_t round trips"},
+    {"dispatch", bench_dispatch, "round-robin vs two-choices vs shortest queue dispatch"},
+    {"ipc", bench_ipc, "pipe vs eventfd vs socketpair vs queue_t vs multiqueue, one producer and one consumer"},
+    {"lanes", bench_lanes, "shared queue_t vs the affinity-hinted multi-lane queue"},
+    {"mesh", bench_mesh, "all-to-all over the thread-per-core SPSC mesh vs queue_t inboxes"},
+    {"multiqueue", bench_multiqueue, "thread scaling of queue_t vs the relaxed multiqueue"},
+    {"observe", bench_observe, "throughput while monitor threads poll the lock-free queries"},
+    {"overload", bench_overload, "bursty task submission to a worker pool, blocking vs caller-runs"},
+    {"pool", bench_pool, "per-request queue_init/queue_destroy vs a queue pool"},
+    {"rpc", bench_rpc, "queue pair ping-pong vs RPC reply slots, single, pipelined and batched calls"},
+    {"replay", bench_replay, "replay a trace captured with -C (pass it with -f) against each engine"},
+};
+
 double getMilliSeconds()
 {
-     struct timeval now;
-     gettimeofday(&now, (struct timezone *)0);
-     return (double)now.tv_sec * 1000.0 + now.tv_usec / 1000.0;
+     return clock_now_ns() / 1000000.0;
 }
 
 /*Track the total items produced and consumed*/
@@ -32,6 +56,12 @@ static struct
 /*Shared queue that producers and consumers will access*/
 static queue_t pc_queue;
 
+/*Analytics window for -S in milliseconds, 0 disables*/
+static int stats_ms = 0;
+/*Heaviest producers listed with each stats line*/
+#define HOT_PRODUCERS 3
+static volatile bool stats_done = false;
+
 /**
  * Produces items at a random interval. Exits once it has produced
  * the correct number of items.
@@ -117,10 +147,57 @@ static void *consumer(void *args)
      pthread_exit(NULL);
 }
 
+/**
+ * Prints one analytics window for the shared queue.
+ */
+static void print_stats(int numc)
+{
+     struct queue_stats st;
+     if (queue_stats_sample(pc_queue, numc, &st) != 0)
+          return;
+     fprintf(stderr, "stats: %7.1fms in %8.0f/s out %8.0f/s depth %6.2f sojourn %9.0fns "
+                     "busy %5.1f%% mu %8.0f/s rho %5.2f little %+6.1f%%\n",
+             st.window_ns / 1e6, st.arrival_rate, st.departure_rate, st.mean_depth,
+             st.mean_sojourn_ns, st.busy_fraction * 100.0, st.service_rate,
+             st.utilization, st.little_error * 100.0);
+
+     struct sketch_entry hot[HOT_PRODUCERS];
+     int n = queue_hot_producers(pc_queue, hot, HOT_PRODUCERS);
+     for (int i = 0; i < n; i++)
+          fprintf(stderr, "%s producer %lu %8.0f/s", i == 0 ? "hot:" : ",",
+                  (unsigned long)hot[i].key, hot[i].rate);
+     if (n > 0)
+          fprintf(stderr, "\n");
+}
+
+/**
+ * Samples the queue analytics every stats_ms until the consumers are done.
+ */
+static void *monitor(void *args)
+{
+     int numc = *((int *)args);
+     struct timespec s = {stats_ms / 1000, (stats_ms % 1000) * 1000000L};
+     while (!stats_done)
+     {
+          nanosleep(&s, NULL);
+          if (!stats_done)
+               print_stats(numc);
+     }
+     return NULL;
+}
+
 static void usage(char *n)
 {
-     fprintf(stderr, "Usage: %s [-c num consumer] [-p num producer] [-i num items] [-s queue size] <-d introduce delay>\n", n);
-     fprintf(stderr, "-d will introduce a random delay between consumer and producer");
+     fprintf(stderr, "Usage: %s [-c num consumer] [-p num producer] [-i num items] [-s queue size] [-B consumer batch] [-b benchmark] [-f input file] [-C capture file] [-S stats ms] [-t scenario] <-d introduce delay>\n", n);
+     fprintf(stderr, "-d will introduce a random delay between consumer and producer\n");
+     fprintf(stderr, "-B lets each consumer pull up to n items per shared access\n");
+     fprintf(stderr, "-C records the simulation's queue traffic to a file for -b replay\n");
+     fprintf(stderr, "-S prints arrival/service rates, utilization, a Little's law check and the busiest producers every n ms\n");
+     fprintf(stderr, "-t runs a topology from the scenario pack instead of the simulation, or all of them:\n");
+     scenario_list(stderr);
+     fprintf(stderr, "-b runs a benchmark instead of the simulation:\n");
+     for (size_t i = 0; i < sizeof(benchmarks) / sizeof(benchmarks[0]); i++)
+          fprintf(stderr, "   %-12s %s\n", benchmarks[i].name, benchmarks[i].desc);
      exit(EXIT_FAILURE);
 }
 
@@ -130,12 +207,19 @@ int main(int argc, char *argv[])
      int numc = 1;       /*total number of consumers*/
      int numitems = 10;  /*total number of items to produce per thread*/
      int queue_size = 5; /*The default size of the queue*/
+     int batch = 0;      /*Items a consumer pulls per shared access*/
+     const char *bench = NULL; /*Benchmark to run instead of the simulation*/
+     const char *scenario = NULL; /*Scenario to run instead of the simulation*/
+     const char *file = NULL;    /*Input file for the benchmark*/
+     const char *capture = NULL; /*File to record queue traffic into*/
+     trace_t trace = NULL;
+     pthread_t stats_thread;
      int c;
 
      pthread_t producers[MAX_P];
      pthread_t consumers[MAX_C];
 
-     while ((c = getopt(argc, argv, "c:p:i:s:dh")) != -1)
+     while ((c = getopt(argc, argv, "c:p:i:s:B:b:f:C:S:t:dh")) != -1)
           switch (c)
           {
           case 'c':
@@ -151,6 +235,24 @@ int main(int argc, char *argv[])
           case 's':
                queue_size = atoi(optarg);
                break;
+          case 'B':
+               batch = atoi(optarg);
+               break;
+          case 'b':
+               bench = optarg;
+               break;
+          case 'f':
+               file = optarg;
+               break;
+          case 'C':
+               capture = optarg;
+               break;
+          case 'S':
+               stats_ms = atoi(optarg);
+               break;
+          case 't':
+               scenario = optarg;
+               break;
           case 'd':
                delay = true;
                break;
@@ -160,11 +262,29 @@ int main(int argc, char *argv[])
           default: /* ? */
                usage(argv[0]);
           }
+     clock_init(); /*Calibrate before any thread reads the clock*/
      if (numc > MAX_C)
           numc = MAX_C;
      if (nump > MAX_P)
           nump = MAX_P;
 
+     if (scenario)
+     {
+          struct bench_opts o = {nump, numc, numitems, queue_size, batch, delay, file};
+          return scenario_run(scenario, &o);
+     }
+
+     if (bench)
+     {
+          struct bench_opts o = {nump, numc, numitems, queue_size, batch, delay, file};
+          fprintf(stderr, "Timing with the %s clock\n", clock_source());
+          for (size_t i = 0; i < sizeof(benchmarks) / sizeof(benchmarks[0]); i++)
+               if (strcmp(bench, benchmarks[i].name) == 0)
+                    return benchmarks[i].run(&o);
+          fprintf(stderr, "Unknown benchmark: %s\n", bench);
+          usage(argv[0]);
+     }
+
      int per_thread = numitems / nump;
      fprintf(stderr, "Simulating %d producers %d consumers with %d items per thread and a queue size of %d\n", nump, numc, per_thread, queue_size);
      // Start our timing
@@ -173,6 +293,19 @@ int main(int argc, char *argv[])
 
      // Initialize the queue for usage
      pc_queue = queue_init(queue_size);
+     queue_set_consumer_batch(pc_queue, batch);
+     if (capture)
+     {
+          /*one enqueue and at most one dequeue record per item*/
+          trace = trace_init((size_t)per_thread * nump * 2);
+          queue_set_trace(pc_queue, trace, 0);
+     }
+     if (stats_ms > 0)
+     {
+          queue_set_stats(pc_queue, true);
+          queue_set_sketch(pc_queue, HOT_PRODUCERS, (uint64_t)stats_ms * 1000000ull);
+          pthread_create(&stats_thread, NULL, monitor, (void *)&numc);
+     }
      /*Create the producer threads*/
      for (int i = 0; i < nump; i++)
      {
@@ -203,6 +336,13 @@ int main(int argc, char *argv[])
           pthread_join(consumers[i], NULL);
      }
 
+     if (stats_ms > 0)
+     {
+          stats_done = true;
+          pthread_join(stats_thread, NULL);
+          print_stats(numc); /*the last, partial window*/
+     }
+
      if (numproduced.num != numconsumed.num)
      {
           fprintf(stderr, "ERROR! produced != consumed\n");
@@ -212,6 +352,19 @@ int main(int argc, char *argv[])
      fprintf(stderr, "Total produced:%d\n", numproduced.num);
      fprintf(stderr, "Total consumed:%d\n", numconsumed.num);
 
+     if (trace)
+     {
+          FILE *f = fopen(capture, "wb");
+          if (f)
+          {
+               fprintf(stderr, "Captured %ld records to %s\n", trace_write(trace, f), capture);
+               fclose(f);
+          }
+          else
+               perror("Failed to open capture file");
+          trace_destroy(trace);
+     }
+
      // Free up all the stuff we allocated
      queue_destroy(pc_queue);
 
@@ -0,0 +1,275 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <time.h>
+#include "bench.h"
+#include "../src/lab.h"
+
+/*
+ * Scenario pack. Each scenario wires queue_t instances into a topology we
+ * run in production and moves -i items through it. Every item carries its
+ * creation time and every scenario reports the same metrics: throughput,
+ * end-to-end latency percentiles, and the mean depth and consumer busy
+ * fraction of its entry queue (from queue_stats_sample). -s sizes every
+ * queue and -B applies to every consumer.
+ */
+
+#define MANY 8                 /*"many" when -p or -c is left at 1*/
+#define PIPELINE_STAGES 3
+#define BURST_ITEMS 64         /*items per burst in bursty ingest*/
+#define BURST_GAP_NS 1000000   /*pause between bursts*/
+#define SLOW_CONSUMER_NS 20000 /*per-item work of the slow consumer*/
+
+struct sc_item
+{
+     uint64_t born;
+     queue_t reply; /*request/reply only*/
+};
+
+/**
+ * How a scenario is wired
+ */
+struct sc_run
+{
+     int nprod;          /*producers, or clients for request/reply*/
+     int ncons;          /*consumers per stage, or servers for request/reply*/
+     int nstages;        /*queues in a chain, 1 unless pipelined*/
+     bool reqreply;      /*consumers answer on the item's reply queue*/
+     bool bursty;        /*producers send in bursts*/
+     uint64_t slow_ns;   /*extra work per item for consumer 0*/
+     int per_producer;
+     int batch;
+     queue_t q[PIPELINE_STAGES];
+     pthread_mutex_t lock; /*guards lat*/
+     struct latency lat;
+};
+
+struct sc_arg
+{
+     struct sc_run *r;
+     int id;    /*thread index within its role*/
+     int stage; /*queue the thread consumes from*/
+};
+
+static void record(struct sc_run *r, struct latency *mine)
+{
+     pthread_mutex_lock(&r->lock);
+     latency_merge(&r->lat, mine);
+     pthread_mutex_unlock(&r->lock);
+     latency_free(mine);
+}
+
+static void *sc_producer(void *args)
+{
+     struct sc_arg *a = (struct sc_arg *)args;
+     struct sc_run *r = a->r;
+     struct latency mine;
+     struct sc_item req;
+     latency_init(&mine);
+     if (r->reqreply)
+     {
+          req.reply = queue_init(1);
+          queue_set_consumer_batch(req.reply, r->batch);
+     }
+
+     for (int i = 0; i < r->per_producer; i++)
+     {
+          if (r->bursty && i > 0 && i % BURST_ITEMS == 0)
+          {
+               struct timespec s = {0, BURST_GAP_NS};
+               nanosleep(&s, NULL);
+          }
+          if (r->reqreply)
+          {
+               /*one call in flight, the round trip is the latency*/
+               req.born = bench_now_ns();
+               enqueue(r->q[0], &req);
+               dequeue(req.reply);
+               latency_add(&mine, bench_now_ns() - req.born);
+               continue;
+          }
+          struct sc_item *it = (struct sc_item *)malloc(sizeof(*it));
+          it->born = bench_now_ns();
+          it->reply = NULL;
+          enqueue(r->q[0], it);
+     }
+
+     if (r->reqreply)
+          queue_destroy(req.reply);
+     record(r, &mine);
+     return NULL;
+}
+
+static void *sc_consumer(void *args)
+{
+     struct sc_arg *a = (struct sc_arg *)args;
+     struct sc_run *r = a->r;
+     bool last = a->stage == r->nstages - 1;
+     struct latency mine;
+     struct sc_item *it;
+     latency_init(&mine);
+
+     while ((it = (struct sc_item *)dequeue(r->q[a->stage])) != NULL)
+     {
+          if (a->id == 0 && r->slow_ns)
+               bench_spin_ns(r->slow_ns);
+          if (r->reqreply)
+               enqueue(it->reply, it);
+          else if (!last)
+               enqueue(r->q[a->stage + 1], it);
+          else
+          {
+               latency_add(&mine, bench_now_ns() - it->born);
+               free(it);
+          }
+     }
+     queue_consumer_flush(r->q[a->stage]);
+     record(r, &mine);
+     return NULL;
+}
+
+static void setup_fanin(struct sc_run *r, const struct bench_opts *o)
+{
+     r->nprod = o->nump > 1 ? o->nump : MANY;
+     r->ncons = 1;
+}
+
+static void setup_fanout(struct sc_run *r, const struct bench_opts *o)
+{
+     r->nprod = 1;
+     r->ncons = o->numc > 1 ? o->numc : MANY;
+}
+
+static void setup_pipeline(struct sc_run *r, const struct bench_opts *o)
+{
+     r->nprod = 1;
+     r->ncons = o->numc;
+     r->nstages = PIPELINE_STAGES;
+}
+
+static void setup_reqreply(struct sc_run *r, const struct bench_opts *o)
+{
+     r->nprod = o->nump > 1 ? o->nump : MANY;
+     r->ncons = o->numc;
+     r->reqreply = true;
+}
+
+static void setup_bursty(struct sc_run *r, const struct bench_opts *o)
+{
+     r->nprod = o->nump;
+     r->ncons = o->numc;
+     r->bursty = true;
+}
+
+static void setup_slow(struct sc_run *r, const struct bench_opts *o)
+{
+     r->nprod = o->nump;
+     r->ncons = o->numc > 1 ? o->numc : 4;
+     r->slow_ns = SLOW_CONSUMER_NS;
+}
+
+static const struct
+{
+     const char *name;
+     void (*setup)(struct sc_run *r, const struct bench_opts *o);
+     const char *desc;
+} scenarios[] = {
+    {"fanin", setup_fanin, "many producers (-p, default 8) into one consumer"},
+    {"fanout", setup_fanout, "one producer out to many consumers (-c, default 8)"},
+    {"pipeline", setup_pipeline, "one producer through a chain of 3 queues, -c threads per stage"},
+    {"reqreply", setup_reqreply, "clients (-p, default 8) call -c servers, reply on a per-client queue"},
+    {"bursty", setup_bursty, "producers send bursts of 64 items 1ms apart"},
+    {"slow", setup_slow, "one consumer spends 20us per item, the rest (-c, default 4) none"},
+};
+
+void scenario_list(FILE *f)
+{
+     for (size_t i = 0; i < sizeof(scenarios) / sizeof(scenarios[0]); i++)
+          fprintf(f, "   %-12s %s\n", scenarios[i].name, scenarios[i].desc);
+}
+
+static void run_one(size_t k, const struct bench_opts *o)
+{
+     struct sc_run r;
+     memset(&r, 0, sizeof(r));
+     r.nstages = 1;
+     r.batch = o->batch;
+     scenarios[k].setup(&r, o);
+     r.per_producer = o->numitems / r.nprod;
+     pthread_mutex_init(&r.lock, NULL);
+     latency_init(&r.lat);
+     for (int s = 0; s < r.nstages; s++)
+     {
+          r.q[s] = queue_init(o->queue_size);
+          queue_set_consumer_batch(r.q[s], o->batch);
+     }
+     queue_set_stats(r.q[0], true);
+
+     pthread_t producers[r.nprod];
+     pthread_t consumers[r.nstages][r.ncons];
+     struct sc_arg pargs[r.nprod];
+     struct sc_arg cargs[r.nstages][r.ncons];
+
+     uint64_t start = bench_now_ns();
+     for (int s = 0; s < r.nstages; s++)
+          for (int i = 0; i < r.ncons; i++)
+          {
+               cargs[s][i] = (struct sc_arg){&r, i, s};
+               pthread_create(&consumers[s][i], NULL, sc_consumer, &cargs[s][i]);
+          }
+     for (int i = 0; i < r.nprod; i++)
+     {
+          pargs[i] = (struct sc_arg){&r, i, 0};
+          pthread_create(&producers[i], NULL, sc_producer, &pargs[i]);
+     }
+     for (int i = 0; i < r.nprod; i++)
+          pthread_join(producers[i], NULL);
+     /*shut the chain down front to back so each stage drains into the next*/
+     for (int s = 0; s < r.nstages; s++)
+     {
+          queue_shutdown(r.q[s]);
+          for (int i = 0; i < r.ncons; i++)
+               pthread_join(consumers[s][i], NULL);
+     }
+     double secs = (bench_now_ns() - start) / 1e9;
+
+     struct queue_stats st;
+     queue_stats_sample(r.q[0], r.ncons, &st);
+     fprintf(stdout, "%-9s %4d %4d %12.0f %9lu %9lu %9lu %7.2f %6.1f%%\n",
+             scenarios[k].name, r.nprod, r.ncons, r.lat.n / secs,
+             (unsigned long)latency_percentile(&r.lat, 50),
+             (unsigned long)latency_percentile(&r.lat, 99),
+             (unsigned long)latency_percentile(&r.lat, 99.9),
+             st.mean_depth, st.busy_fraction * 100.0);
+     if (r.lat.n != (size_t)r.per_producer * r.nprod)
+          fprintf(stderr, "ERROR! %s delivered %zu of %d items\n", scenarios[k].name,
+                  r.lat.n, r.per_producer * r.nprod);
+
+     for (int s = 0; s < r.nstages; s++)
+          queue_destroy(r.q[s]);
+     latency_free(&r.lat);
+     pthread_mutex_destroy(&r.lock);
+}
+
+int scenario_run(const char *name, const struct bench_opts *o)
+{
+     bool all = strcmp(name, "all") == 0;
+     bool found = false;
+     fprintf(stderr, "Moving %d items per scenario, queue size %d, consumer batch %d\n",
+             o->numitems, o->queue_size, o->batch);
+     fprintf(stdout, "%-9s %4s %4s %12s %9s %9s %9s %7s %7s\n", "scenario", "prod", "cons",
+             "items/s", "p50 ns", "p99 ns", "p99.9 ns", "depth", "busy");
+     for (size_t k = 0; k < sizeof(scenarios) / sizeof(scenarios[0]); k++)
+          if (all || strcmp(name, scenarios[k].name) == 0)
+          {
+               run_one(k, o);
+               found = true;
+          }
+     if (!found)
+     {
+          fprintf(stderr, "Unknown scenario: %s\n", name);
+          return 1;
+     }
+     return 0;
+}
@@ -0,0 +1,214 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <pthread.h>
+#include "arena.h"
+
+#define ARENA_ALIGN 16
+#define ARENA_BIAS (1ull << 62) // Held in pending until the region is sealed
+
+/**
+ * @brief Header at the start of every region. Regions are aligned to their
+ * size, so a payload finds its region by masking its own address.
+ */
+struct region
+{
+    arena_t arena;
+    uint64_t pending;     // ARENA_BIAS until sealed, minus releases
+    size_t used;          // Bump offset, owner thread only
+    uint64_t allocated;   // Payloads handed out, owner thread only
+    struct region *next;  // Free list link
+} __attribute__((aligned(ARENA_ALIGN)));
+
+/**
+ * @brief The internal structure for an arena.
+ */
+struct arena
+{
+    size_t region_size;
+    int max_regions;
+    pthread_mutex_t mutex;   // Guards the fields below
+    pthread_cond_t recycled; // Signalled when a region joins the free list
+    struct region *free;     // Recycled regions
+    struct region **all;     // Every region allocated, for arena_destroy
+    int nregions;
+    pthread_key_t key;       // The calling thread's current region
+};
+
+static inline struct region *region_of(arena_t a, void *p)
+{
+    return (struct region *)((uintptr_t)p & ~(uintptr_t)(a->region_size - 1));
+}
+
+/**
+ * @brief Puts a region whose payloads are all released on the free list
+ */
+static void recycle(struct region *r)
+{
+    arena_t a = r->arena;
+    pthread_mutex_lock(&a->mutex);
+    r->next = a->free;
+    a->free = r;
+    pthread_cond_signal(&a->recycled);
+    pthread_mutex_unlock(&a->mutex);
+}
+
+/**
+ * @brief Swaps the bias in a region's counter for the number of payloads
+ * handed out, leaving the number still unreleased. Whoever brings the
+ * counter to zero, this call or the last arena_release(), recycles the
+ * region.
+ */
+static void seal(struct region *r)
+{
+    uint64_t drop = ARENA_BIAS - r->allocated;
+    if (__atomic_sub_fetch(&r->pending, drop, __ATOMIC_ACQ_REL) == 0)
+    {
+        recycle(r);
+    }
+}
+
+static void seal_on_exit(void *arg)
+{
+    seal((struct region *)arg);
+}
+
+arena_t arena_init(size_t region_size, int max_regions)
+{
+    if (region_size < 4096 || (region_size & (region_size - 1)) || max_regions <= 0)
+    {
+        fprintf(stderr, "Error: Invalid arena arguments.\n");
+        return NULL;
+    }
+
+    arena_t a = (arena_t)calloc(1, sizeof(struct arena));
+    if (!a)
+    {
+        perror("Failed to allocate arena");
+        return NULL;
+    }
+    a->all = (struct region **)malloc(max_regions * sizeof(struct region *));
+    if (!a->all || pthread_key_create(&a->key, seal_on_exit) != 0)
+    {
+        perror("Failed to allocate arena");
+        free(a->all);
+        free(a);
+        return NULL;
+    }
+    a->region_size = region_size;
+    a->max_regions = max_regions;
+    pthread_mutex_init(&a->mutex, NULL);
+    pthread_cond_init(&a->recycled, NULL);
+    return a;
+}
+
+void arena_destroy(arena_t a)
+{
+    if (!a) return;
+
+    // Deleting the key first means no thread exit seals a freed region
+    pthread_key_delete(a->key);
+    for (int i = 0; i < a->nregions; i++)
+    {
+        free(a->all[i]);
+    }
+    pthread_mutex_destroy(&a->mutex);
+    pthread_cond_destroy(&a->recycled);
+    free(a->all);
+    free(a);
+}
+
+/**
+ * @brief Takes a recycled region, allocates a new one, or waits for one
+ */
+static struct region *region_open(arena_t a)
+{
+    struct region *r = NULL;
+    pthread_mutex_lock(&a->mutex);
+    while (!a->free && a->nregions == a->max_regions)
+    {
+        pthread_cond_wait(&a->recycled, &a->mutex);
+    }
+    if (a->free)
+    {
+        r = a->free;
+        a->free = r->next;
+    }
+    else
+    {
+        r = (struct region *)aligned_alloc(a->region_size, a->region_size);
+        if (r)
+        {
+            a->all[a->nregions++] = r;
+        }
+    }
+    pthread_mutex_unlock(&a->mutex);
+    if (!r)
+    {
+        perror("Failed to allocate arena region");
+        return NULL;
+    }
+
+    r->arena = a;
+    r->used = sizeof(struct region);
+    r->allocated = 0;
+    r->next = NULL;
+    __atomic_store_n(&r->pending, ARENA_BIAS, __ATOMIC_RELAXED);
+    return r;
+}
+
+void *arena_alloc(arena_t a, size_t size)
+{
+    if (!a) return NULL;
+
+    size = (size + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1);
+    if (size == 0 || size > a->region_size - sizeof(struct region))
+    {
+        return NULL;
+    }
+
+    struct region *r = (struct region *)pthread_getspecific(a->key);
+    if (r && r->used + size > a->region_size)
+    {
+        seal(r);
+        r = NULL;
+        pthread_setspecific(a->key, NULL);
+    }
+    if (!r)
+    {
+        r = region_open(a);
+        if (!r)
+        {
+            return NULL;
+        }
+        pthread_setspecific(a->key, r);
+    }
+
+    void *p = (char *)r + r->used;
+    r->used += size;
+    r->allocated++; // Only added to pending when the region is sealed
+    return p;
+}
+
+void arena_seal(arena_t a)
+{
+    if (!a) return;
+
+    struct region *r = (struct region *)pthread_getspecific(a->key);
+    if (r)
+    {
+        pthread_setspecific(a->key, NULL);
+        seal(r);
+    }
+}
+
+void arena_release(arena_t a, void *p)
+{
+    if (!a || !p) return;
+
+    struct region *r = region_of(a, p);
+    if (__atomic_sub_fetch(&r->pending, 1, __ATOMIC_ACQ_REL) == 0)
+    {
+        recycle(r);
+    }
+}
@@ -0,0 +1,73 @@
+#ifndef ARENA_H
+#define ARENA_H
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+    /**
+     * @brief opaque type definition for a region arena for queue payloads
+     *
+     * Producers bump-allocate payloads from a region of their own instead of
+     * calling malloc per item. A region is sealed when it is full or when
+     * the producer calls arena_seal(), typically after each batch it
+     * enqueues. Consumers call arena_release() instead of free(). Each
+     * region keeps one counter of unreleased payloads, and a sealed region is
+     * recycled as a whole as soon as that counter reaches zero.
+     */
+    typedef struct arena *arena_t;
+
+    /**
+     * @brief Create an arena
+     *
+     * @param region_size bytes per region, a power of two of at least 4096
+     * @param max_regions most regions allocated at once; producers block in
+     * arena_alloc() while all of them are in use
+     * @return a new arena, or NULL on error
+     */
+    arena_t arena_init(size_t region_size, int max_regions);
+
+    /**
+     * @brief Frees every region. No thread may be using the arena and every
+     * payload becomes invalid.
+     *
+     * @param a the arena
+     */
+    void arena_destroy(arena_t a);
+
+    /**
+     * @brief Allocates size bytes, aligned to 16, from the calling thread's
+     * current region, opening a new region if it does not fit
+     *
+     * @param a the arena
+     * @param size bytes to allocate
+     * @return the payload, or NULL if size does not fit in a region
+     */
+    void *arena_alloc(arena_t a, size_t size);
+
+    /**
+     * @brief Seals the calling thread's current region, so it is recycled
+     * once all its payloads are released. The next arena_alloc() opens a
+     * new region.
+     *
+     * @param a the arena
+     */
+    void arena_seal(arena_t a);
+
+    /**
+     * @brief Releases a payload. May be called from any thread, once per
+     * payload. Costs one atomic decrement of the region's counter; the
+     * region is found by masking the payload's address.
+     *
+     * @param a the arena the payload came from
+     * @param p a payload from arena_alloc()
+     */
+    void arena_release(arena_t a, void *p);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
+
+#endif
@@ -0,0 +1,269 @@
+#include "clock.h"
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <time.h>
+#if defined(__x86_64__)
+#include <cpuid.h>
+#include <x86intrin.h>
+#define CLOCK_HAVE_TSC 1
+#endif
+
+#define CLOCK_CALIBRATE_NS 5000000ull   // Each of the two calibration windows
+#define CLOCK_RESYNC_NS 1000000000ull   // How often readers re-check drift
+#define CLOCK_MAX_ERROR_NS 1000000ull   // Drift beyond this abandons the TSC
+#define CLOCK_MAX_SLEW_PPM 500          // Largest rate change one resync applies
+#define CLOCK_SHIFT 32                  // Fixed point bits in mult
+
+/**
+ * @brief The internal structure for the clock. The conversion is
+ * base_ns + ((tsc - base_tsc) * mult >> CLOCK_SHIFT). seq is odd while a
+ * resync rewrites the conversion, readers retry around it. Readings below
+ * base_tsc use the conversion the last resync replaced, which meets the
+ * current one at base_tsc, so the output never steps back.
+ */
+static struct
+{
+    uint64_t seq;
+    uint64_t base_tsc;
+    uint64_t base_ns;
+    uint64_t mult;
+    uint64_t prev_tsc;   // Conversion in force before base_tsc
+    uint64_t prev_ns;
+    uint64_t prev_mult;
+    uint64_t resync_tsc; // First TSC reading that triggers a resync
+    uint64_t anchor_tsc; // Calibration reading the long run rate is measured from
+    uint64_t anchor_ns;
+    uint64_t offset_ns;  // Added to CLOCK_MONOTONIC after falling back
+    bool use_tsc;
+    bool resyncing;      // Claimed by the reader running the resync
+} clk;
+
+static pthread_once_t clk_once = PTHREAD_ONCE_INIT;
+
+static uint64_t mono_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+#ifdef CLOCK_HAVE_TSC
+/**
+ * @brief Reads the TSC and CLOCK_MONOTONIC as close together as we can,
+ * keeping the pair with the tightest TSC bracket out of a few tries so a
+ * preemption between the reads does not skew calibration.
+ */
+static void read_pair(uint64_t *tsc, uint64_t *ns)
+{
+    uint64_t best = UINT64_MAX;
+    for (int i = 0; i < 8; i++)
+    {
+        uint64_t t0 = __rdtsc();
+        uint64_t m = mono_ns();
+        uint64_t t1 = __rdtsc();
+        if (t1 - t0 < best)
+        {
+            best = t1 - t0;
+            *tsc = t0 + (t1 - t0) / 2;
+            *ns = m;
+        }
+    }
+}
+
+/**
+ * @brief CPUID leaf 0x80000007 EDX bit 8: the TSC ticks at a constant rate
+ * in every P-, C- and T-state
+ */
+static bool tsc_invariant(void)
+{
+    unsigned int a, b, c, d;
+    if (!__get_cpuid(0x80000007, &a, &b, &c, &d))
+    {
+        return false;
+    }
+    return (d & (1u << 8)) != 0;
+}
+
+static uint64_t rate_mult(uint64_t ticks, uint64_t ns)
+{
+    return (uint64_t)(((unsigned __int128)ns << CLOCK_SHIFT) / ticks);
+}
+
+static uint64_t tsc_to_ns(uint64_t tsc, uint64_t base_tsc, uint64_t base_ns, uint64_t mult)
+{
+    return base_ns + (uint64_t)(((unsigned __int128)(tsc - base_tsc) * mult) >> CLOCK_SHIFT);
+}
+
+/**
+ * @brief Reads the TSC after every earlier load and store has completed
+ * and before any later load starts, so the reading is ordered against the
+ * seq checks around it
+ */
+static inline uint64_t fenced_rdtsc(void)
+{
+    _mm_lfence();
+    uint64_t tsc = __rdtsc();
+    _mm_lfence();
+    return tsc;
+}
+
+/**
+ * @brief Measures the TSC rate over two back to back windows and only
+ * trusts it when they agree and the TSC moved forward.
+ */
+static bool calibrate(void)
+{
+    uint64_t t[3], m[3];
+    struct timespec nap = {0, (long)CLOCK_CALIBRATE_NS};
+    read_pair(&t[0], &m[0]);
+    for (int i = 1; i < 3; i++)
+    {
+        nanosleep(&nap, NULL);
+        read_pair(&t[i], &m[i]);
+        if (t[i] <= t[i - 1] || m[i] <= m[i - 1])
+        {
+            return false;
+        }
+    }
+    uint64_t r1 = rate_mult(t[1] - t[0], m[1] - m[0]);
+    uint64_t r2 = rate_mult(t[2] - t[1], m[2] - m[1]);
+    uint64_t diff = r1 > r2 ? r1 - r2 : r2 - r1;
+    if (diff > r1 / 1000)
+    {
+        return false;
+    }
+    clk.anchor_tsc = t[0];
+    clk.anchor_ns = m[0];
+    clk.base_tsc = t[2];
+    clk.base_ns = m[2];
+    clk.mult = rate_mult(t[2] - t[0], m[2] - m[0]);
+    clk.prev_tsc = clk.base_tsc;
+    clk.prev_ns = clk.base_ns;
+    clk.prev_mult = clk.mult;
+    clk.resync_tsc = t[2] + (uint64_t)(((unsigned __int128)CLOCK_RESYNC_NS << CLOCK_SHIFT) / clk.mult);
+    return true;
+}
+#endif
+
+static void clock_setup(void)
+{
+    const char *env = getenv("QUEUE_CLOCK");
+    bool forced = env && strcmp(env, "monotonic") == 0;
+#ifdef CLOCK_HAVE_TSC
+    bool use_tsc = !forced && tsc_invariant() && calibrate();
+    __atomic_store_n(&clk.use_tsc, use_tsc, __ATOMIC_RELEASE);
+#else
+    (void)forced;
+#endif
+}
+
+void clock_init(void)
+{
+    pthread_once(&clk_once, clock_setup);
+}
+
+#ifdef CLOCK_HAVE_TSC
+/**
+ * @brief Compares the TSC against CLOCK_MONOTONIC and rewrites the
+ * conversion from here on. The measurement runs before readers are held
+ * off, and costs a few clock_gettime() calls, never a sleep. The new rate
+ * is the long run rate since calibration plus enough to close the
+ * remaining error by the next resync; it takes over at a TSC reading taken
+ * once seq is odd, which every reader still using the old conversion has
+ * already passed, so time never steps back. Gives up on the TSC if the
+ * error is too large to be drift.
+ */
+static void resync(void)
+{
+    uint64_t tsc, ns;
+    read_pair(&tsc, &ns);
+    uint64_t est = tsc_to_ns(tsc, clk.base_tsc, clk.base_ns, clk.mult);
+    uint64_t err = est > ns ? est - ns : ns - est;
+
+    __atomic_store_n(&clk.seq, clk.seq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    uint64_t switch_tsc = fenced_rdtsc();
+    uint64_t switch_ns = tsc_to_ns(switch_tsc, clk.base_tsc, clk.base_ns, clk.mult);
+    if (tsc <= clk.base_tsc || err > CLOCK_MAX_ERROR_NS)
+    {
+        // Never hand out less than we already have
+        uint64_t mono = mono_ns();
+        __atomic_store_n(&clk.offset_ns, switch_ns > mono ? switch_ns - mono : 0, __ATOMIC_RELAXED);
+        __atomic_store_n(&clk.use_tsc, false, __ATOMIC_RELEASE);
+    }
+    else
+    {
+        uint64_t rate = rate_mult(tsc - clk.anchor_tsc, ns - clk.anchor_ns);
+        __int128 slew = ((__int128)ns - (__int128)est) * (__int128)rate / (__int128)CLOCK_RESYNC_NS;
+        __int128 cap = (__int128)rate * CLOCK_MAX_SLEW_PPM / 1000000;
+        slew = slew > cap ? cap : slew < -cap ? -cap : slew;
+        __atomic_store_n(&clk.prev_tsc, clk.base_tsc, __ATOMIC_RELAXED);
+        __atomic_store_n(&clk.prev_ns, clk.base_ns, __ATOMIC_RELAXED);
+        __atomic_store_n(&clk.prev_mult, clk.mult, __ATOMIC_RELAXED);
+        __atomic_store_n(&clk.base_tsc, switch_tsc, __ATOMIC_RELAXED);
+        __atomic_store_n(&clk.base_ns, switch_ns, __ATOMIC_RELAXED);
+        __atomic_store_n(&clk.mult, (uint64_t)((__int128)rate + slew), __ATOMIC_RELAXED);
+        __atomic_store_n(&clk.resync_tsc,
+                         switch_tsc + (uint64_t)(((unsigned __int128)CLOCK_RESYNC_NS << CLOCK_SHIFT) / rate),
+                         __ATOMIC_RELAXED);
+    }
+    __atomic_store_n(&clk.seq, clk.seq + 1, __ATOMIC_RELEASE);
+}
+#endif
+
+uint64_t clock_now_ns(void)
+{
+#ifdef CLOCK_HAVE_TSC
+    for (;;)
+    {
+        uint64_t seq = __atomic_load_n(&clk.seq, __ATOMIC_ACQUIRE);
+        if (!__atomic_load_n(&clk.use_tsc, __ATOMIC_ACQUIRE))
+        {
+            break;
+        }
+        if (seq & 1)
+        {
+            continue;
+        }
+        uint64_t base_tsc = __atomic_load_n(&clk.base_tsc, __ATOMIC_RELAXED);
+        uint64_t base_ns = __atomic_load_n(&clk.base_ns, __ATOMIC_RELAXED);
+        uint64_t mult = __atomic_load_n(&clk.mult, __ATOMIC_RELAXED);
+        uint64_t prev_tsc = __atomic_load_n(&clk.prev_tsc, __ATOMIC_RELAXED);
+        uint64_t prev_ns = __atomic_load_n(&clk.prev_ns, __ATOMIC_RELAXED);
+        uint64_t prev_mult = __atomic_load_n(&clk.prev_mult, __ATOMIC_RELAXED);
+        uint64_t resync_tsc = __atomic_load_n(&clk.resync_tsc, __ATOMIC_RELAXED);
+        // Read inside the seq check so a reading that passes it is older
+        // than any switch point not yet visible
+        uint64_t tsc = fenced_rdtsc();
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        if (__atomic_load_n(&clk.seq, __ATOMIC_RELAXED) != seq)
+        {
+            continue;
+        }
+        if (tsc >= resync_tsc && !__atomic_exchange_n(&clk.resyncing, true, __ATOMIC_ACQUIRE))
+        {
+            if (__atomic_load_n(&clk.seq, __ATOMIC_RELAXED) == seq)
+            {
+                resync();
+            }
+            __atomic_store_n(&clk.resyncing, false, __ATOMIC_RELEASE);
+            continue;
+        }
+        if (tsc >= base_tsc)
+        {
+            return tsc_to_ns(tsc, base_tsc, base_ns, mult);
+        }
+        // Taken before the last switch point, on another core or while this
+        // thread was descheduled
+        return tsc > prev_tsc ? tsc_to_ns(tsc, prev_tsc, prev_ns, prev_mult) : prev_ns;
+    }
+#endif
+    return mono_ns() + __atomic_load_n(&clk.offset_ns, __ATOMIC_RELAXED);
+}
+
+const char *clock_source(void)
+{
+    return __atomic_load_n(&clk.use_tsc, __ATOMIC_RELAXED) ? "tsc" : "monotonic";
+}
@@ -0,0 +1,46 @@
+#ifndef CLOCK_H
+#define CLOCK_H
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+    /**
+     * @brief Monotonic time in nanoseconds on the CLOCK_MONOTONIC timebase,
+     * so values can be mixed with clock_gettime() and used as absolute
+     * deadlines for condition variables created with that clock.
+     *
+     * On x86-64 with an invariant TSC this is a rdtsc and a multiply once
+     * clock_init() has calibrated the rate, and clock_gettime() before that.
+     * The rate is re-checked every CLOCK_RESYNC_NS by whichever call crosses
+     * that point, which costs it a few clock_gettime() calls; small drift is
+     * slewed away without any reading stepping below one already returned.
+     * If the TSC is not invariant, fails calibration, drifts by more than
+     * CLOCK_MAX_ERROR_NS, or the environment sets QUEUE_CLOCK=monotonic,
+     * every call falls back to clock_gettime(CLOCK_MONOTONIC).
+     *
+     * @return nanoseconds since an arbitrary fixed point
+     */
+    uint64_t clock_now_ns(void);
+
+    /**
+     * @brief Calibrates the TSC against CLOCK_MONOTONIC, sleeping about
+     * 10ms. Call once at startup, before starting threads that use queues;
+     * later calls return at once.
+     */
+    void clock_init(void);
+
+    /**
+     * @brief Names the source clock_now_ns() reads, for reports
+     *
+     * @return "tsc" or "monotonic"
+     */
+    const char *clock_source(void);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
+
+#endif
@@ -0,0 +1,185 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <pthread.h>
+#include "conflate.h"
+
+/**
+ * @brief One seqlock slot. seq is odd while the writer fills the slot and
+ * 2 * version once it holds that version.
+ */
+struct slot
+{
+    uint64_t seq __attribute__((aligned(64)));
+    uint64_t words[]; // The value, copied a word at a time
+};
+
+/**
+ * @brief The internal structure for a conflating channel.
+ */
+struct conflate
+{
+    uint64_t version __attribute__((aligned(64))); // Latest complete version
+    int waiters;           // Readers blocked in conflate_wait
+    bool closed;           // Set by conflate_close
+    size_t size;           // Value size in bytes
+    size_t nwords;         // Value size rounded up to whole words
+    size_t stride;         // Bytes between slots
+    int nslots;            // 1 for small values, 3 for large ones
+    char *slots;           // The slots, each stride bytes
+    pthread_mutex_t mutex; // Guards sleeping on newer
+    pthread_cond_t newer;  // Signalled when a version is published
+};
+
+static inline struct slot *slot_at(conflate_t c, uint64_t version)
+{
+    return (struct slot *)(c->slots + (version % c->nslots) * c->stride);
+}
+
+conflate_t conflate_init(size_t value_size)
+{
+    if (value_size == 0)
+    {
+        fprintf(stderr, "Error: Conflating channel value size must be positive.\n");
+        return NULL;
+    }
+
+    conflate_t c = (conflate_t)aligned_alloc(64, sizeof(struct conflate));
+    if (!c)
+    {
+        perror("Failed to allocate conflating channel");
+        return NULL;
+    }
+    memset(c, 0, sizeof(*c));
+    c->size = value_size;
+    c->nwords = (value_size + sizeof(uint64_t) - 1) / sizeof(uint64_t);
+    c->nslots = value_size > CONFLATE_SMALL_VALUE ? 3 : 1;
+    // Round each slot up to whole cache lines so slots never share one
+    c->stride = (sizeof(struct slot) + c->nwords * sizeof(uint64_t) + 63) & ~(size_t)63;
+    c->slots = (char *)aligned_alloc(64, c->nslots * c->stride);
+    if (!c->slots)
+    {
+        perror("Failed to allocate conflating channel slots");
+        free(c);
+        return NULL;
+    }
+    memset(c->slots, 0, c->nslots * c->stride);
+    pthread_mutex_init(&c->mutex, NULL);
+    pthread_cond_init(&c->newer, NULL);
+    return c;
+}
+
+void conflate_destroy(conflate_t c)
+{
+    if (!c) return;
+
+    pthread_mutex_destroy(&c->mutex);
+    pthread_cond_destroy(&c->newer);
+    free(c->slots);
+    free(c);
+}
+
+uint64_t conflate_publish(conflate_t c, const void *value)
+{
+    if (!c || !value) return 0;
+
+    uint64_t version = __atomic_load_n(&c->version, __ATOMIC_RELAXED) + 1;
+    struct slot *s = slot_at(c, version);
+
+    // Mark the slot busy before touching the words, readers that see the odd
+    // count or a changed count after their copy retry
+    __atomic_store_n(&s->seq, 2 * version - 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    size_t whole = c->size / sizeof(uint64_t);
+    for (size_t i = 0; i < whole; i++)
+    {
+        uint64_t w;
+        memcpy(&w, (const char *)value + i * sizeof(uint64_t), sizeof(w));
+        __atomic_store_n(&s->words[i], w, __ATOMIC_RELAXED);
+    }
+    if (whole < c->nwords)
+    {
+        uint64_t w = 0;
+        memcpy(&w, (const char *)value + whole * sizeof(uint64_t), c->size % sizeof(uint64_t));
+        __atomic_store_n(&s->words[whole], w, __ATOMIC_RELAXED);
+    }
+    __atomic_store_n(&s->seq, 2 * version, __ATOMIC_RELEASE);
+
+    // Pairs with the waiter count in conflate_wait: either the waiter sees
+    // the new version or we see the waiter
+    __atomic_store_n(&c->version, version, __ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&c->waiters, __ATOMIC_SEQ_CST) > 0)
+    {
+        pthread_mutex_lock(&c->mutex);
+        pthread_cond_broadcast(&c->newer);
+        pthread_mutex_unlock(&c->mutex);
+    }
+    return version;
+}
+
+uint64_t conflate_read(conflate_t c, void *out)
+{
+    if (!c || !out) return 0;
+
+    size_t whole = c->size / sizeof(uint64_t);
+    for (;;)
+    {
+        uint64_t version = __atomic_load_n(&c->version, __ATOMIC_ACQUIRE);
+        if (version == 0)
+        {
+            return 0;
+        }
+        struct slot *s = slot_at(c, version);
+        uint64_t seq = __atomic_load_n(&s->seq, __ATOMIC_ACQUIRE);
+        if (seq != 2 * version)
+        {
+            continue; // The writer has lapped this slot, start over
+        }
+        // Copy straight into out; a torn copy is overwritten on the retry
+        for (size_t i = 0; i < whole; i++)
+        {
+            uint64_t w = __atomic_load_n(&s->words[i], __ATOMIC_RELAXED);
+            memcpy((char *)out + i * sizeof(uint64_t), &w, sizeof(w));
+        }
+        uint64_t tail = whole < c->nwords ? __atomic_load_n(&s->words[whole], __ATOMIC_RELAXED) : 0;
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        if (__atomic_load_n(&s->seq, __ATOMIC_RELAXED) == seq)
+        {
+            memcpy((char *)out + whole * sizeof(uint64_t), &tail, c->size % sizeof(uint64_t));
+            return version;
+        }
+    }
+}
+
+uint64_t conflate_wait(conflate_t c, uint64_t seen, void *out)
+{
+    if (!c || !out) return 0;
+
+    if (__atomic_load_n(&c->version, __ATOMIC_ACQUIRE) <= seen)
+    {
+        pthread_mutex_lock(&c->mutex);
+        __atomic_fetch_add(&c->waiters, 1, __ATOMIC_SEQ_CST);
+        while (__atomic_load_n(&c->version, __ATOMIC_SEQ_CST) <= seen && !c->closed)
+        {
+            pthread_cond_wait(&c->newer, &c->mutex);
+        }
+        __atomic_fetch_sub(&c->waiters, 1, __ATOMIC_RELAXED);
+        pthread_mutex_unlock(&c->mutex);
+    }
+    if (__atomic_load_n(&c->version, __ATOMIC_ACQUIRE) <= seen)
+    {
+        return 0; // Closed with nothing newer
+    }
+    return conflate_read(c, out);
+}
+
+void conflate_close(conflate_t c)
+{
+    if (!c) return;
+
+    pthread_mutex_lock(&c->mutex);
+    c->closed = true;
+    pthread_cond_broadcast(&c->newer);
+    pthread_mutex_unlock(&c->mutex);
+}
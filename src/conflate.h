@@ -0,0 +1,89 @@
+#ifndef CONFLATE_H
+#define CONFLATE_H
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+/**
+ * @brief Values larger than this many bytes rotate through three slots
+ * instead of one, see conflate_init()
+ */
+#define CONFLATE_SMALL_VALUE 64
+
+    /**
+     * @brief opaque type definition for a conflating channel
+     *
+     * A conflating channel holds only the latest value. One writer publishes
+     * without ever blocking, each publish replacing the previous value, and
+     * any number of readers copy out the newest complete value. Versions
+     * start at 1 and grow by one per publish, so a reader can tell how many
+     * updates it skipped.
+     */
+    typedef struct conflate *conflate_t;
+
+    /**
+     * @brief Create a channel for fixed size values. Small values live in a
+     * single seqlock slot. Large values rotate through three seqlock slots, so
+     * the writer fills a slot no reader is copying from and a slow reader
+     * only retries if the writer laps all three during its copy.
+     *
+     * @param value_size size of each value in bytes
+     * @return a new channel, or NULL on error
+     */
+    conflate_t conflate_init(size_t value_size);
+
+    /**
+     * @brief Frees the channel. No thread may be using it.
+     *
+     * @param c the channel
+     */
+    void conflate_destroy(conflate_t c);
+
+    /**
+     * @brief Replaces the current value. Only one thread may publish. Readers
+     * never hold it up; the only lock it takes is the wakeup mutex, and
+     * only while readers are waiting in conflate_wait(), to wake them.
+     *
+     * @param c the channel
+     * @param value value_size bytes to copy in
+     * @return the version of the new value
+     */
+    uint64_t conflate_publish(conflate_t c, const void *value);
+
+    /**
+     * @brief Copies the latest value without blocking.
+     *
+     * @param c the channel
+     * @param out receives value_size bytes
+     * @return the version copied, 0 if nothing was published yet
+     */
+    uint64_t conflate_read(conflate_t c, void *out);
+
+    /**
+     * @brief Blocks until a version newer than seen is published, then
+     * copies the latest value.
+     *
+     * @param c the channel
+     * @param seen the last version the caller has, 0 for none
+     * @param out receives value_size bytes
+     * @return the version copied, 0 if the channel was closed first
+     */
+    uint64_t conflate_wait(conflate_t c, uint64_t seen, void *out);
+
+    /**
+     * @brief Wakes all waiting readers and makes conflate_wait() return 0
+     * unless a newer version is already there. Reads keep working.
+     *
+     * @param c the channel
+     */
+    void conflate_close(conflate_t c);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
+
+#endif
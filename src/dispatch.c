@@ -0,0 +1,118 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include "dispatch.h"
+
+/**
+ * @brief The internal structure for the dispatcher.
+ */
+struct dispatcher
+{
+    queue_t *queues;          // Target queues (not owned)
+    int n;                    // Number of target queues
+    dispatch_policy_t policy; // How to pick a target
+    unsigned int next;        // Round robin cursor, updated atomically
+};
+
+/**
+ * @brief Per-thread xorshift state so random picks never share a cache line
+ */
+static __thread uint32_t rng_state = 0;
+
+static uint32_t rng_next(void)
+{
+    uint32_t x = rng_state;
+    if (x == 0)
+    {
+        // Seed from the address of the thread-local, unique per thread
+        x = (uint32_t)(uintptr_t)&rng_state | 1u;
+    }
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    rng_state = x;
+    return x;
+}
+
+dispatcher_t dispatcher_init(queue_t *queues, int n, dispatch_policy_t policy)
+{
+    if (!queues || n <= 0)
+    {
+        fprintf(stderr, "Error: Dispatcher needs at least one queue.\n");
+        return NULL;
+    }
+
+    dispatcher_t d = (dispatcher_t)malloc(sizeof(struct dispatcher));
+    if (!d)
+    {
+        perror("Failed to allocate dispatcher");
+        return NULL;
+    }
+
+    d->queues = (queue_t *)malloc(n * sizeof(queue_t));
+    if (!d->queues)
+    {
+        perror("Failed to allocate dispatcher queues");
+        free(d);
+        return NULL;
+    }
+    memcpy(d->queues, queues, n * sizeof(queue_t));
+    d->n = n;
+    d->policy = policy;
+    d->next = 0;
+    return d;
+}
+
+void dispatcher_destroy(dispatcher_t d)
+{
+    if (!d) return;
+    free(d->queues);
+    free(d);
+}
+
+int dispatch_pick(dispatcher_t d)
+{
+    if (!d) return -1;
+    if (d->n == 1) return 0;
+
+    switch (d->policy)
+    {
+    case DISPATCH_TWO_CHOICES:
+    {
+        int a = rng_next() % d->n;
+        int b = rng_next() % (d->n - 1);
+        if (b >= a) b++; // Two distinct queues
+        return queue_size(d->queues[b]) < queue_size(d->queues[a]) ? b : a;
+    }
+    case DISPATCH_SHORTEST:
+    {
+        // Start at a random queue so ties do not pile onto queue 0
+        int start = rng_next() % d->n;
+        int best = start;
+        int best_size = queue_size(d->queues[start]);
+        for (int i = 1; i < d->n && best_size > 0; i++)
+        {
+            int j = (start + i) % d->n;
+            int size = queue_size(d->queues[j]);
+            if (size < best_size)
+            {
+                best = j;
+                best_size = size;
+            }
+        }
+        return best;
+    }
+    case DISPATCH_ROUND_ROBIN:
+    default:
+        return __atomic_fetch_add(&d->next, 1, __ATOMIC_RELAXED) % d->n;
+    }
+}
+
+int dispatch(dispatcher_t d, void *data)
+{
+    int i = dispatch_pick(d);
+    if (i < 0) return -1;
+    enqueue(d->queues[i], data);
+    return i;
+}
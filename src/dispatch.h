@@ -0,0 +1,65 @@
+#ifndef DISPATCH_H
+#define DISPATCH_H
+#include "lab.h"
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+    /**
+     * @brief How a dispatcher picks the target queue for each item
+     */
+    typedef enum
+    {
+        DISPATCH_ROUND_ROBIN, // Cycle through the queues in order
+        DISPATCH_TWO_CHOICES, // Shorter of two randomly chosen queues
+        DISPATCH_SHORTEST     // Shortest of all queues (join-shortest-queue)
+    } dispatch_policy_t;
+
+    /**
+     * @brief opaque type definition for a dispatcher
+     */
+    typedef struct dispatcher *dispatcher_t;
+
+    /**
+     * @brief Create a dispatcher that spreads items over an array of queues.
+     * Queue depths are read with queue_size() so no queue lock is taken to
+     * make a choice. The dispatcher does not own the queues.
+     *
+     * @param queues the queues to dispatch to
+     * @param n number of queues
+     * @param policy how to choose the target queue
+     * @return a new dispatcher, or NULL on error
+     */
+    dispatcher_t dispatcher_init(queue_t *queues, int n, dispatch_policy_t policy);
+
+    /**
+     * @brief Frees the dispatcher. The queues are left untouched.
+     *
+     * @param d the dispatcher
+     */
+    void dispatcher_destroy(dispatcher_t d);
+
+    /**
+     * @brief Picks a target queue without enqueuing anything
+     *
+     * @param d the dispatcher
+     * @return index of the chosen queue
+     */
+    int dispatch_pick(dispatcher_t d);
+
+    /**
+     * @brief Enqueues data on the queue chosen by the dispatcher's policy
+     *
+     * @param d the dispatcher
+     * @param data the data to add
+     * @return index of the queue the data was added to, -1 on error
+     */
+    int dispatch(dispatcher_t d, void *data);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
+
+#endif
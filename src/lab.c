@@ -2,7 +2,13 @@
 #include <stdlib.h>
 #include <pthread.h>
 #include <stdbool.h>
+#include <string.h>
 #include "lab.h" // Include the header file provided
+#include "sync.h"
+#include "trace.h"
+#include "clock.h"
+#include "sketch.h"
+#include "arena.h"
 
 /**
  * @brief The internal structure for the queue.
@@ -10,6 +16,7 @@
 struct queue
 {
     void **buffer;         // Array to store queue elements (pointers)
+    int slots;           // Allocated length of buffer (>= capacity, grows on requeue until drained)
     int capacity;        // Maximum number of items in the queue
     int size;            // Current number of items in the queue
     int head;            // Index of the next item to dequeue
@@ -18,8 +25,162 @@ struct queue
     pthread_cond_t not_full; // Condition variable for waiting when queue is full
     pthread_cond_t not_empty; // Condition variable for waiting when queue is empty
     bool shutdown;         // Flag to indicate if the queue is shutting down
+    int producers_waiting; // Producers blocked on not_full
+    int consumers_waiting; // Consumers blocked on not_empty
+    int consumer_batch;    // Items a consumer pulls per shared access (<= 1 disables)
+    uint64_t *stamps;      // Enqueue time per slot, only kept while batch_target is set
+    uint64_t batch_target; // Sojourn time the batch controller aims for (0 disables)
+    int batch_max;         // Upper bound for the controlled batch size
+    int batch;             // Current batch size chosen by the controller
+    trace_t trace;         // Records enqueue/dequeue traffic when set
+    uint16_t trace_id;     // Queue id written to trace records
+    struct meter *meter;   // Windowed analytics, NULL when disabled
+    sketch_t hot_producers; // Enqueues per producer, NULL when disabled
+    sketch_t hot_keys;      // Enqueues per key from enqueue_keyed()
+    arena_t arena;          // Producer regions sealed after each enqueue_batch()
+    struct consumer_cache *caches; // Caches bound to this queue, guarded by cache_lock
 };
 
+/**
+ * @brief Running totals for the current analytics window. Areas are
+ * integrals over time in item-nanoseconds, advanced on every change to the
+ * depth or to the blocked consumer count. Guarded by q->mutex.
+ */
+struct meter
+{
+    uint64_t start;       // Start of the window
+    uint64_t last;        // Time the areas were last advanced to
+    uint64_t arrivals;    // Items enqueued in the window
+    uint64_t departures;  // Items dequeued in the window
+    uint64_t depth_area;  // Integral of size
+    uint64_t idle_area;   // Integral of consumers_waiting
+    uint64_t sojourn_sum; // Time in queue summed over departed items
+};
+
+/**
+ * @brief Per-thread stash of items pulled from a queue by a batching consumer.
+ * A thread caches items for at most one queue at a time.
+ */
+struct consumer_cache
+{
+    queue_t q;                            // Queue the cached items came from, changed under cache_lock
+    struct consumer_cache *next;          // Next cache bound to q, guarded by cache_lock
+    int head;                             // Index of the next item to hand out
+    int count;                            // Number of items still cached
+    void *items[QUEUE_MAX_CONSUMER_BATCH]; // Items in FIFO order
+};
+
+/**
+ * @brief Publishes a new size. Writers hold q->mutex, the atomic store lets
+ * queue_size() read the depth without taking it.
+ */
+static inline void set_size(queue_t q, int size)
+{
+    sync_store(&q->size, size, __ATOMIC_RELAXED);
+}
+
+/**
+ * @brief Publishes the shutdown flag. Writers hold q->mutex, the release
+ * store pairs with the acquire load in is_shutdown().
+ */
+static inline void set_shutdown(queue_t q)
+{
+    sync_store(&q->shutdown, true, __ATOMIC_RELEASE);
+}
+
+/**
+ * @brief Brings the depth and idle areas up to now. Call before changing
+ * q->size or q->consumers_waiting. Caller holds q->mutex.
+ */
+static inline void meter_advance(struct meter *m, queue_t q, uint64_t now)
+{
+    uint64_t dt = now - m->last;
+    m->depth_area += (uint64_t)q->size * dt;
+    m->idle_area += (uint64_t)q->consumers_waiting * dt;
+    m->last = now;
+}
+
+/**
+ * @brief Accounts for n items about to be pushed. Caller holds q->mutex.
+ */
+static inline void meter_arrive(queue_t q, int n, uint64_t now)
+{
+    meter_advance(q->meter, q, now);
+    q->meter->arrivals += n;
+}
+
+/**
+ * @brief Accounts for the n items at the head about to be removed. Caller
+ * holds q->mutex and q->stamps is set.
+ */
+static inline void meter_depart(queue_t q, int n, uint64_t now)
+{
+    meter_advance(q->meter, q, now);
+    q->meter->departures += n;
+    for (int i = 0; i < n; i++)
+    {
+        q->meter->sojourn_sum += now - q->stamps[(q->head + i) % q->slots];
+    }
+}
+
+/**
+ * @brief Blocks on a condition variable while keeping the matching waiter
+ * count up to date for queue_waiting_producers/consumers(). Caller holds
+ * q->mutex.
+ */
+static inline void wait_counted(queue_t q, pthread_cond_t *cond, int *waiting)
+{
+    if (q->meter) meter_advance(q->meter, q, clock_now_ns());
+    sync_store(waiting, *waiting + 1, __ATOMIC_RELAXED);
+    sync_cond_wait(cond, &q->mutex);
+    if (q->meter) meter_advance(q->meter, q, clock_now_ns());
+    sync_store(waiting, *waiting - 1, __ATOMIC_RELAXED);
+}
+
+/**
+ * @brief Stores an item at the tail. Caller holds q->mutex and has checked
+ * there is room.
+ */
+static inline void push_tail(queue_t q, void *data, uint64_t now)
+{
+    q->buffer[q->tail] = data;
+    if (q->stamps) q->stamps[q->tail] = now;
+    q->tail = (q->tail + 1) % q->slots; // Move tail, wrap around if necessary
+}
+
+/**
+ * @brief Additive-increase/multiplicative-decrease update of the batch size,
+ * run on each batch dequeue. The oldest item's sojourn time is compared with
+ * the target: over it, halve the batch so items leave sooner; under it with a
+ * backlog larger than the batch, grow the batch by one to cut lock round
+ * trips. Caller holds q->mutex and the queue is not empty.
+ */
+static void batch_adapt(queue_t q, uint64_t now)
+{
+    uint64_t sojourn = now - q->stamps[q->head];
+    int batch = q->batch;
+    if (sojourn > q->batch_target)
+    {
+        batch = batch / 2 > 1 ? batch / 2 : 1;
+    }
+    else if (q->size > batch && batch < q->batch_max)
+    {
+        batch++;
+    }
+    sync_store(&q->batch, batch, __ATOMIC_RELAXED);
+}
+
+static pthread_key_t cache_key;
+static pthread_once_t cache_key_once = PTHREAD_ONCE_INIT;
+static __thread struct consumer_cache *tl_cache = NULL;
+// Guards binding caches to queues, so destroy and reset can disown the
+// caches of threads that stopped early. Taken before any q->mutex.
+static pthread_mutex_t cache_lock = PTHREAD_MUTEX_INITIALIZER;
+static void cache_disown(queue_t q);
+
+static __thread uint64_t tl_producer_id = 0;
+static uint64_t next_producer_id = 0;
+
 /**
  * @brief Initialize a new queue
  *
@@ -56,11 +217,26 @@ queue_t queue_init(int capacity)
     }
 
     // Initialize queue properties
+    q->slots = capacity;
     q->capacity = capacity;
     q->size = 0;
     q->head = 0;
     q->tail = 0;
     q->shutdown = false;
+    q->producers_waiting = 0;
+    q->consumers_waiting = 0;
+    q->consumer_batch = 0;
+    q->stamps = NULL;
+    q->batch_target = 0;
+    q->batch_max = 1;
+    q->batch = 1;
+    q->trace = NULL;
+    q->trace_id = 0;
+    q->meter = NULL;
+    q->hot_producers = NULL;
+    q->hot_keys = NULL;
+    q->arena = NULL;
+    q->caches = NULL;
 
     // Initialize mutex and condition variables
     if (pthread_mutex_init(&q->mutex, NULL) != 0)
@@ -103,15 +279,18 @@ void queue_destroy(queue_t q)
         return; // Nothing to destroy if queue is NULL
     }
 
+    // Items still cached by any thread go away with the queue
+    cache_disown(q);
+
     // It's good practice to ensure shutdown is called before destroying,
     // but we'll signal just in case to release any potentially stuck threads.
     // Lock needed to safely modify shutdown and broadcast.
-    pthread_mutex_lock(&q->mutex);
-    q->shutdown = true; // Ensure shutdown state is set
+    sync_mutex_lock(&q->mutex);
+    set_shutdown(q); // Ensure shutdown state is set
     // Wake up all waiting threads so they can exit
-    pthread_cond_broadcast(&q->not_full);
-    pthread_cond_broadcast(&q->not_empty);
-    pthread_mutex_unlock(&q->mutex);
+    sync_cond_broadcast(&q->not_full);
+    sync_cond_broadcast(&q->not_empty);
+    sync_mutex_unlock(&q->mutex);
 
 
     // Destroy mutex and condition variables
@@ -120,46 +299,434 @@ void queue_destroy(queue_t q)
     pthread_cond_destroy(&q->not_empty);
 
     // Free the buffer and the queue structure
+    sketch_destroy(q->hot_producers);
+    sketch_destroy(q->hot_keys);
+    free(q->meter);
+    free(q->stamps);
     free(q->buffer);
     free(q);
 }
 
 /**
- * @brief Adds an element to the back of the queue
+ * @brief Reallocates the buffer (and stamps) with a new length and linearizes
+ * the contents so head is at index 0. Caller holds q->mutex.
  *
  * @param q the queue
- * @param data the data to add
+ * @param slots new length, at least q->size
+ * @return 0 on success, -1 on allocation failure
  */
-void enqueue(queue_t q, void *data)
+static int resize_slots(queue_t q, int slots)
 {
-    if (!q) return; // Safety check
+    void **buffer = (void **)malloc(slots * sizeof(void *));
+    uint64_t *stamps = q->stamps ? (uint64_t *)malloc(slots * sizeof(uint64_t)) : NULL;
+    if (!buffer || (q->stamps && !stamps))
+    {
+        free(buffer);
+        free(stamps);
+        return -1;
+    }
+    for (int i = 0; i < q->size; i++)
+    {
+        int j = (q->head + i) % q->slots;
+        buffer[i] = q->buffer[j];
+        if (stamps) stamps[i] = q->stamps[j];
+    }
+    free(q->buffer);
+    free(q->stamps);
+    q->buffer = buffer;
+    q->stamps = stamps;
+    q->slots = slots;
+    q->head = 0;
+    q->tail = q->size % slots;
+    return 0;
+}
 
-    pthread_mutex_lock(&q->mutex);
+/**
+ * @brief Shrinks a buffer that a requeue grew back to capacity once the
+ * extra items have drained. Caller holds q->mutex.
+ */
+static inline void trim_slots(queue_t q)
+{
+    if (q->slots > q->capacity && q->size <= q->capacity)
+    {
+        resize_slots(q, q->capacity); // On failure keep the larger buffer
+    }
+}
+
+/**
+ * @brief Pushes items back onto the front of the queue, preserving their order.
+ * Requeued items may take the queue past its capacity, so the buffer grows
+ * when needed and dequeues shrink it again once the queue is back within
+ * capacity. Used to hand back items that a consumer cached but never used.
+ *
+ * @param q the queue
+ * @param items the items to push back, oldest first
+ * @param n number of items
+ * @return 0 on success, -1 if the buffer could not grow
+ */
+static int requeue_front(queue_t q, void **items, int n)
+{
+    uint64_t now = clock_now_ns(); // Original enqueue times are not kept in the cache
+    sync_mutex_lock(&q->mutex);
+
+    if (q->size + n > q->slots && resize_slots(q, q->size + n) != 0)
+    {
+        sync_mutex_unlock(&q->mutex);
+        perror("Failed to grow queue buffer");
+        return -1;
+    }
+    if (q->meter) meter_arrive(q, n, now);
+
+    // Walk backwards so the oldest item ends up at the head
+    for (int i = n - 1; i >= 0; i--)
+    {
+        q->head = (q->head - 1 + q->slots) % q->slots;
+        q->buffer[q->head] = items[i];
+        if (q->stamps) q->stamps[q->head] = now;
+    }
+    set_size(q, q->size + n);
+
+    sync_cond_broadcast(&q->not_empty);
+    sync_mutex_unlock(&q->mutex);
+    return 0;
+}
+
+/**
+ * @brief Hands any items in the cache back to the queue they came from.
+ * Caller holds cache_lock, which keeps the queue from being destroyed.
+ *
+ * @param c the cache to empty
+ * @return the number of items handed back
+ */
+static int cache_flush_locked(struct consumer_cache *c)
+{
+    int n = c->count;
+    if (n > 0 && c->q)
+    {
+        if (requeue_front(c->q, &c->items[c->head], n) != 0)
+        {
+            return 0; // Leave the items cached rather than lose them
+        }
+    }
+    c->head = 0;
+    c->count = 0;
+    return n;
+}
+
+static int cache_flush(struct consumer_cache *c)
+{
+    sync_mutex_lock(&cache_lock);
+    int n = cache_flush_locked(c);
+    sync_mutex_unlock(&cache_lock);
+    return n;
+}
+
+/**
+ * @brief Removes a cache from its queue's list. Caller holds cache_lock.
+ */
+static void cache_unbind(struct consumer_cache *c)
+{
+    if (!c->q) return;
+    for (struct consumer_cache **p = &c->q->caches; *p; p = &(*p)->next)
+    {
+        if (*p == c)
+        {
+            *p = c->next;
+            break;
+        }
+    }
+    c->next = NULL;
+    __atomic_store_n(&c->q, NULL, __ATOMIC_RELAXED);
+}
+
+/**
+ * @brief Hands the cache's items back to its current queue and binds it to
+ * q. The cache stays with its old queue if the items cannot be handed back.
+ */
+static void cache_bind(struct consumer_cache *c, queue_t q)
+{
+    sync_mutex_lock(&cache_lock);
+    cache_flush_locked(c);
+    if (c->count == 0)
+    {
+        cache_unbind(c);
+        c->next = q->caches;
+        q->caches = c;
+        __atomic_store_n(&c->q, q, __ATOMIC_RELAXED);
+    }
+    sync_mutex_unlock(&cache_lock);
+}
+
+/**
+ * @brief Detaches every cache bound to q and drops the items they hold, so
+ * a thread that stopped early never hands them back to a freed queue.
+ */
+static void cache_disown(queue_t q)
+{
+    sync_mutex_lock(&cache_lock);
+    while (q->caches)
+    {
+        struct consumer_cache *c = q->caches;
+        q->caches = c->next;
+        c->next = NULL;
+        c->head = 0;
+        c->count = 0;
+        __atomic_store_n(&c->q, NULL, __ATOMIC_RELAXED);
+    }
+    sync_mutex_unlock(&cache_lock);
+}
+
+/**
+ * @brief pthread key destructor, returns leftovers when a consumer thread exits.
+ */
+static void cache_release(void *arg)
+{
+    struct consumer_cache *c = (struct consumer_cache *)arg;
+    sync_mutex_lock(&cache_lock);
+    cache_flush_locked(c);
+    cache_unbind(c);
+    sync_mutex_unlock(&cache_lock);
+    free(c);
+    tl_cache = NULL;
+}
+
+static void cache_key_create(void)
+{
+    pthread_key_create(&cache_key, cache_release);
+}
+
+/**
+ * @brief Returns the calling thread's consumer cache, creating it on first use.
+ */
+static struct consumer_cache *cache_get(void)
+{
+    if (!tl_cache)
+    {
+        pthread_once(&cache_key_once, cache_key_create);
+        tl_cache = (struct consumer_cache *)calloc(1, sizeof(struct consumer_cache));
+        if (!tl_cache)
+        {
+            perror("Failed to allocate consumer cache");
+            return NULL;
+        }
+        pthread_setspecific(cache_key, tl_cache);
+    }
+    return tl_cache;
+}
+
+/**
+ * @brief dequeue() for queues in consumer batch mode. Refills the thread's
+ * cache with one shared access and hands items out one at a time, prefetching
+ * the payload of the item that will be returned next.
+ *
+ * @param q the queue
+ * @return the next item, or NULL if the queue was shutdown and is drained
+ */
+static void *dequeue_cached(queue_t q)
+{
+    struct consumer_cache *c = cache_get();
+    if (c && __atomic_load_n(&c->q, __ATOMIC_RELAXED) != q)
+    {
+        cache_bind(c, q);
+    }
+
+    // No cache available for this queue, fall back to a single item
+    if (!c || __atomic_load_n(&c->q, __ATOMIC_RELAXED) != q)
+    {
+        void *data = NULL;
+        return dequeue_batch(q, &data, 1) == 1 ? data : NULL;
+    }
+
+    if (c->count == 0)
+    {
+        int batch = q->consumer_batch;
+        if (batch > QUEUE_MAX_CONSUMER_BATCH) batch = QUEUE_MAX_CONSUMER_BATCH;
+        c->head = 0;
+        c->count = dequeue_batch(q, c->items, batch);
+        if (c->count == 0)
+        {
+            return NULL;
+        }
+    }
+
+    void *data = c->items[c->head++];
+    c->count--;
+    if (c->count > 0)
+    {
+        __builtin_prefetch(c->items[c->head]);
+    }
+    return data;
+}
+
+/**
+ * @brief Returns the calling thread's producer id, numbering threads from 1
+ * in the order they first ask
+ */
+uint64_t queue_producer_id(void)
+{
+    if (tl_producer_id == 0)
+    {
+        tl_producer_id = __atomic_add_fetch(&next_producer_id, 1, __ATOMIC_RELAXED);
+    }
+    return tl_producer_id;
+}
+
+/**
+ * @brief Counts n enqueues by the calling thread, and under a key when one
+ * is given, in the heavy-hitter sketches. Caller holds q->mutex.
+ */
+static inline void sketch_arrive(queue_t q, const uint64_t *key, int n, uint64_t now)
+{
+    sketch_add(q->hot_producers, queue_producer_id(), n, now);
+    if (key) sketch_add(q->hot_keys, *key, n, now);
+}
+
+/**
+ * @brief Appends one element and wakes a consumer. Caller holds q->mutex
+ * and the queue has room.
+ */
+static void push_one(queue_t q, void *data, const uint64_t *key)
+{
+    uint64_t now = q->stamps || q->hot_producers ? clock_now_ns() : 0;
+    if (q->meter) meter_arrive(q, 1, now);
+    if (q->hot_producers) sketch_arrive(q, key, 1, now);
+    push_tail(q, data, now);
+    set_size(q, q->size + 1);              // Increment size
+    if (q->trace) trace_record(q->trace, q->trace_id, TRACE_ENQ, 1, q->size);
+
+    // Signal that the queue is no longer empty
+    sync_cond_signal(&q->not_empty);
+}
+
+/**
+ * @brief Adds an element to the back of the queue, blocking while it is
+ * full. key is counted in the key sketch when not NULL.
+ */
+static void enqueue_one(queue_t q, void *data, const uint64_t *key)
+{
+    sync_mutex_lock(&q->mutex);
 
     // Wait while the queue is full AND not shutting down
-    while (q->size == q->capacity && !q->shutdown)
+    while (q->size >= q->capacity && !q->shutdown)
     {
-        pthread_cond_wait(&q->not_full, &q->mutex);
+        wait_counted(q, &q->not_full, &q->producers_waiting);
     }
 
     // If shutdown was signaled while waiting, just unlock and return
     if (q->shutdown)
     {
-        pthread_mutex_unlock(&q->mutex);
+        sync_mutex_unlock(&q->mutex);
         // Note: The item 'data' is not enqueued and might be lost if the caller doesn't handle it.
         // In the context of main.c, producers stop generating items before shutdown, so this is okay.
         return;
     }
 
-    // Add the data to the buffer
-    q->buffer[q->tail] = data;
-    q->tail = (q->tail + 1) % q->capacity; // Move tail, wrap around if necessary
-    q->size++;                             // Increment size
+    push_one(q, data, key);
+    sync_mutex_unlock(&q->mutex);
+}
 
-    // Signal that the queue is no longer empty
-    pthread_cond_signal(&q->not_empty);
+/**
+ * @brief Adds an element to the back of the queue
+ *
+ * @param q the queue
+ * @param data the data to add
+ */
+void enqueue(queue_t q, void *data)
+{
+    if (!q) return; // Safety check
+    enqueue_one(q, data, NULL);
+}
+
+/**
+ * @brief Adds an element to the back of the queue and attributes it to a
+ * key in the heavy-hitter sketches
+ *
+ * @param q the queue
+ * @param data the data to add
+ * @param key the key the element belongs to
+ */
+void enqueue_keyed(queue_t q, void *data, uint64_t key)
+{
+    if (!q) return;
+    enqueue_one(q, data, &key);
+}
+
+/**
+ * @brief Adds an element to the back of the queue unless it is full
+ *
+ * @param q the queue
+ * @param data the data to add
+ * @return 0 if the element was added, -1 if the queue was full or shut down
+ */
+int try_enqueue(queue_t q, void *data)
+{
+    if (!q) return -1;
+
+    sync_mutex_lock(&q->mutex);
+    if (q->size >= q->capacity || q->shutdown)
+    {
+        sync_mutex_unlock(&q->mutex);
+        return -1;
+    }
+    push_one(q, data, NULL);
+    sync_mutex_unlock(&q->mutex);
+    return 0;
+}
+
+/**
+ * @brief Adds n elements to the back of the queue in order, taking the lock
+ * once per run of free slots instead of once per element.
+ *
+ * @param q the queue
+ * @param items the elements to add
+ * @param n number of elements
+ * @return number of elements added, less than n if the queue was shut down
+ */
+int enqueue_batch(queue_t q, void **items, int n)
+{
+    if (!q || !items || n <= 0) return 0;
+
+    int added = 0;
+    sync_mutex_lock(&q->mutex);
+    while (added < n)
+    {
+        while (q->size >= q->capacity && !q->shutdown)
+        {
+            wait_counted(q, &q->not_full, &q->producers_waiting);
+        }
+        if (q->shutdown)
+        {
+            break;
+        }
+
+        uint64_t now = q->stamps || q->hot_producers ? clock_now_ns() : 0;
+        int room = q->capacity - q->size;
+        int k = n - added < room ? n - added : room;
+        if (q->meter) meter_arrive(q, k, now);
+        if (q->hot_producers) sketch_arrive(q, NULL, k, now);
+        for (int i = 0; i < k; i++)
+        {
+            push_tail(q, items[added + i], now);
+        }
+        added += k;
+        set_size(q, q->size + k);
+        if (q->trace) trace_record(q->trace, q->trace_id, TRACE_ENQ, k, q->size);
 
-    pthread_mutex_unlock(&q->mutex);
+        if (k == 1)
+        {
+            sync_cond_signal(&q->not_empty);
+        }
+        else
+        {
+            sync_cond_broadcast(&q->not_empty);
+        }
+    }
+    sync_mutex_unlock(&q->mutex);
+
+    // The batch's payloads are queued, so their region can be recycled as
+    // soon as consumers release them
+    if (q->arena) arena_seal(q->arena);
+    return added;
 }
 
 /**
@@ -173,40 +740,457 @@ void *dequeue(queue_t q)
     // Safety check for NULL queue
    if (!q) return NULL; // Safety check
 
-    // this check caused the prsogram to core dump
-    if (q->size == 0 && q->shutdown) {
-        pthread_mutex_unlock(&q->mutex);
-        return NULL; // Return NULL if empty and shutting down
+    if (q->consumer_batch > 1)
+    {
+        return dequeue_cached(q);
     }
 
-    pthread_mutex_lock(&q->mutex);
+    sync_mutex_lock(&q->mutex);
 
     // Wait while the queue is empty AND not shutting down
     while (q->size == 0 && !q->shutdown)
     {
-        pthread_cond_wait(&q->not_empty, &q->mutex);
+        wait_counted(q, &q->not_empty, &q->consumers_waiting);
     }
 
     // If the queue is shutting down AND is empty, unlock and return NULL
     if (q->shutdown && q->size == 0)
     {
-        pthread_mutex_unlock(&q->mutex);
+        sync_mutex_unlock(&q->mutex);
         return NULL; // Indicate shutdown and empty queue
     }
 
     // Remove the data from the buffer
+    if (q->meter) meter_depart(q, 1, clock_now_ns());
     void *data = q->buffer[q->head];
-    q->head = (q->head + 1) % q->capacity; // Move head, wrap around if necessary
-    q->size--;                             // Decrement size
+    q->head = (q->head + 1) % q->slots; // Move head, wrap around if necessary
+    set_size(q, q->size - 1);              // Decrement size
+    trim_slots(q);
+    if (q->trace) trace_record(q->trace, q->trace_id, TRACE_DEQ, 1, q->size);
 
     // Signal that the queue is no longer full
-    pthread_cond_signal(&q->not_full);
+    sync_cond_signal(&q->not_full);
 
-    pthread_mutex_unlock(&q->mutex);
+    sync_mutex_unlock(&q->mutex);
 
     return data;
 }
 
+/**
+ * @brief Removes up to max elements from the front of the queue with a
+ * single lock acquisition. Blocks until at least one element is available.
+ *
+ * @param q the queue
+ * @param items array that receives the elements in FIFO order
+ * @param max size of the items array
+ * @return number of elements removed, 0 if the queue was shutdown and empty
+ */
+int dequeue_batch(queue_t q, void **items, int max)
+{
+    if (!q || !items || max <= 0) return 0;
+
+    sync_mutex_lock(&q->mutex);
+
+    while (q->size == 0 && !q->shutdown)
+    {
+        wait_counted(q, &q->not_empty, &q->consumers_waiting);
+    }
+
+    uint64_t now = q->stamps && q->size > 0 ? clock_now_ns() : 0;
+    if (q->batch_target && q->size > 0)
+    {
+        batch_adapt(q, now);
+        if (max > q->batch) max = q->batch;
+    }
+
+    int n = q->size < max ? q->size : max;
+    if (q->meter && n > 0) meter_depart(q, n, now);
+    for (int i = 0; i < n; i++)
+    {
+        items[i] = q->buffer[q->head];
+        q->head = (q->head + 1) % q->slots;
+    }
+    set_size(q, q->size - n);
+    trim_slots(q);
+    if (q->trace && n > 0) trace_record(q->trace, q->trace_id, TRACE_DEQ, n, q->size);
+
+    // More than one slot may have opened up
+    if (n == 1)
+    {
+        sync_cond_signal(&q->not_full);
+    }
+    else if (n > 1)
+    {
+        sync_cond_broadcast(&q->not_full);
+    }
+
+    sync_mutex_unlock(&q->mutex);
+
+    for (int i = 0; i < n; i++)
+    {
+        __builtin_prefetch(items[i]);
+    }
+    return n;
+}
+
+/**
+ * @brief Enables consumer batch mode. Must be set before consumers start.
+ *
+ * @param q the queue
+ * @param batch items pulled per shared access, clamped to QUEUE_MAX_CONSUMER_BATCH
+ */
+void queue_set_consumer_batch(queue_t q, int batch)
+{
+    if (!q) return;
+    if (batch > QUEUE_MAX_CONSUMER_BATCH) batch = QUEUE_MAX_CONSUMER_BATCH;
+    q->consumer_batch = batch;
+}
+
+/**
+ * @brief Allocates the per-slot enqueue stamps shared by the batch controller
+ * and the analytics if neither has done so yet. Caller holds q->mutex.
+ *
+ * @return 0 on success, -1 on allocation failure
+ */
+static int stamps_alloc(queue_t q)
+{
+    if (q->stamps) return 0;
+
+    q->stamps = (uint64_t *)malloc(q->slots * sizeof(uint64_t));
+    if (!q->stamps)
+    {
+        perror("Failed to allocate queue timestamps");
+        return -1;
+    }
+    // Items already queued count as arriving now
+    uint64_t now = clock_now_ns();
+    for (int i = 0; i < q->slots; i++)
+    {
+        q->stamps[i] = now;
+    }
+    return 0;
+}
+
+/**
+ * @brief Enables the adaptive batch size controller. Must be set while no
+ * other thread is using the queue.
+ *
+ * @param q the queue
+ * @param target_ns sojourn time to aim for, 0 disables the controller
+ * @param max_batch largest batch size the controller may choose
+ * @return 0 on success, -1 on allocation failure
+ */
+int queue_set_batch_target(queue_t q, uint64_t target_ns, int max_batch)
+{
+    if (!q) return -1;
+
+    sync_mutex_lock(&q->mutex);
+    if (target_ns == 0)
+    {
+        if (!q->meter)
+        {
+            free(q->stamps);
+            q->stamps = NULL;
+        }
+        q->batch_target = 0;
+        sync_store(&q->batch, 1, __ATOMIC_RELAXED);
+        sync_mutex_unlock(&q->mutex);
+        return 0;
+    }
+
+    if (stamps_alloc(q) != 0)
+    {
+        sync_mutex_unlock(&q->mutex);
+        return -1;
+    }
+    q->batch_target = target_ns;
+    q->batch_max = max_batch > 1 ? max_batch : 1;
+    if (q->batch > q->batch_max)
+    {
+        sync_store(&q->batch, q->batch_max, __ATOMIC_RELAXED);
+    }
+    sync_mutex_unlock(&q->mutex);
+    return 0;
+}
+
+/**
+ * @brief Returns the batch size currently chosen by the controller, 1 when
+ * it is disabled. Read without locking.
+ *
+ * @param q the queue
+ */
+int queue_batch_size(queue_t q)
+{
+    if (!q) return 1;
+    return sync_load(&q->batch, __ATOMIC_RELAXED);
+}
+
+/**
+ * @brief Starts or stops recording traffic. Must be set while no other
+ * thread is using the queue.
+ *
+ * @param q the queue
+ * @param t trace buffer to record into, NULL stops recording
+ * @param id queue id written to each record
+ */
+void queue_set_trace(queue_t q, trace_t t, uint16_t id)
+{
+    if (!q) return;
+    q->trace = t;
+    q->trace_id = id;
+}
+
+/**
+ * @brief Ties a payload arena to the queue so enqueue_batch() seals the
+ * producer's region. Must be set while no other thread is using the queue.
+ *
+ * @param q the queue
+ * @param a the arena, NULL to stop sealing
+ */
+void queue_set_arena(queue_t q, arena_t a)
+{
+    if (!q) return;
+    q->arena = a;
+}
+
+/**
+ * @brief Turns windowed analytics on or off. Must be set while no other
+ * thread is using the queue.
+ *
+ * @param q the queue
+ * @param enable true to start a window now, false to stop
+ * @return 0 on success, -1 on allocation failure
+ */
+int queue_set_stats(queue_t q, bool enable)
+{
+    if (!q) return -1;
+
+    sync_mutex_lock(&q->mutex);
+    if (!enable)
+    {
+        free(q->meter);
+        q->meter = NULL;
+        if (!q->batch_target)
+        {
+            free(q->stamps);
+            q->stamps = NULL;
+        }
+        sync_mutex_unlock(&q->mutex);
+        return 0;
+    }
+
+    if (!q->meter)
+    {
+        struct meter *m = (struct meter *)calloc(1, sizeof(struct meter));
+        if (!m || stamps_alloc(q) != 0)
+        {
+            sync_mutex_unlock(&q->mutex);
+            free(m);
+            if (!m) perror("Failed to allocate queue analytics");
+            return -1;
+        }
+        m->start = m->last = clock_now_ns();
+        q->meter = m;
+    }
+    sync_mutex_unlock(&q->mutex);
+    return 0;
+}
+
+/**
+ * @brief Reports the current analytics window and starts a new one.
+ *
+ * @param q the queue
+ * @param nconsumers consumer threads serving the queue, 0 if unknown
+ * @param out receives the analytics
+ * @return 0 on success, -1 if analytics are not enabled
+ */
+int queue_stats_sample(queue_t q, int nconsumers, struct queue_stats *out)
+{
+    if (!q || !out) return -1;
+
+    sync_mutex_lock(&q->mutex);
+    struct meter *m = q->meter;
+    if (!m)
+    {
+        sync_mutex_unlock(&q->mutex);
+        return -1;
+    }
+    uint64_t now = clock_now_ns();
+    meter_advance(m, q, now);
+    struct meter w = *m;
+    memset(m, 0, sizeof(*m));
+    m->start = m->last = now;
+    sync_mutex_unlock(&q->mutex);
+
+    memset(out, 0, sizeof(*out));
+    out->window_ns = now - w.start;
+    out->arrivals = w.arrivals;
+    out->departures = w.departures;
+    if (out->window_ns == 0)
+    {
+        return 0;
+    }
+
+    double secs = out->window_ns / 1e9;
+    out->arrival_rate = w.arrivals / secs;
+    out->departure_rate = w.departures / secs;
+    out->mean_depth = (double)w.depth_area / out->window_ns;
+    out->mean_idle_consumers = (double)w.idle_area / out->window_ns;
+    if (w.departures > 0)
+    {
+        out->mean_sojourn_ns = (double)w.sojourn_sum / w.departures;
+    }
+    if (out->mean_depth > 0)
+    {
+        // Little's law, L = lambda * W. Items still queued at either edge of
+        // the window make the two sides differ slightly.
+        double little = out->arrival_rate * out->mean_sojourn_ns / 1e9;
+        out->little_error = (out->mean_depth - little) / out->mean_depth;
+    }
+    if (nconsumers > 0)
+    {
+        out->busy_fraction = 1.0 - out->mean_idle_consumers / nconsumers;
+        if (out->busy_fraction < 0) out->busy_fraction = 0;
+        double busy_secs = out->busy_fraction * nconsumers * secs;
+        if (busy_secs > 0 && w.departures > 0)
+        {
+            out->service_rate = w.departures / busy_secs;
+            out->utilization = out->arrival_rate / (nconsumers * out->service_rate);
+        }
+    }
+    return 0;
+}
+
+/**
+ * @brief Turns the heavy-hitter sketches on or off. Any sketches already
+ * running are replaced by empty ones.
+ *
+ * @param q the queue
+ * @param k number of producers and keys to track, 0 to stop
+ * @param window_ns length of the sliding window
+ * @return 0 on success, -1 on invalid arguments or allocation failure
+ */
+int queue_set_sketch(queue_t q, int k, uint64_t window_ns)
+{
+    if (!q) return -1;
+
+    sketch_t producers = NULL, keys = NULL;
+    if (k > 0)
+    {
+        uint64_t now = clock_now_ns();
+        producers = sketch_init(k, window_ns, now);
+        keys = producers ? sketch_init(k, window_ns, now) : NULL;
+        if (!keys)
+        {
+            sketch_destroy(producers);
+            return -1;
+        }
+    }
+
+    sync_mutex_lock(&q->mutex);
+    sketch_t old_producers = q->hot_producers;
+    sketch_t old_keys = q->hot_keys;
+    q->hot_producers = producers;
+    q->hot_keys = keys;
+    sync_mutex_unlock(&q->mutex);
+    sketch_destroy(old_producers);
+    sketch_destroy(old_keys);
+    return 0;
+}
+
+static int hot_top(queue_t q, bool by_key, struct sketch_entry *out, int max)
+{
+    if (!q || !out) return -1;
+
+    sync_mutex_lock(&q->mutex);
+    sketch_t s = by_key ? q->hot_keys : q->hot_producers;
+    int n = s ? sketch_top(s, out, max, clock_now_ns()) : -1;
+    sync_mutex_unlock(&q->mutex);
+    return n;
+}
+
+/**
+ * @brief Reports the producers that enqueued the most over the window
+ *
+ * @param q the queue
+ * @param out receives the entries, heaviest first
+ * @param max size of out
+ * @return number of entries written, -1 if the sketches are off
+ */
+int queue_hot_producers(queue_t q, struct sketch_entry *out, int max)
+{
+    return hot_top(q, false, out, max);
+}
+
+/**
+ * @brief Reports the keys enqueued the most over the window
+ *
+ * @param q the queue
+ * @param out receives the entries, heaviest first
+ * @param max size of out
+ * @return number of entries written, -1 if the sketches are off
+ */
+int queue_hot_keys(queue_t q, struct sketch_entry *out, int max)
+{
+    return hot_top(q, true, out, max);
+}
+
+/**
+ * @brief Returns items cached by the calling thread back to the queue.
+ *
+ * @param q the queue
+ * @return the number of items handed back
+ */
+int queue_consumer_flush(queue_t q)
+{
+    if (!q || !tl_cache || __atomic_load_n(&tl_cache->q, __ATOMIC_RELAXED) != q) return 0;
+    return cache_flush(tl_cache);
+}
+
+/**
+ * @brief Returns a queue nobody is using to its state right after queue_init.
+ *
+ * @param q the queue
+ * @return 0 on success, -1 if a thread is still blocked on the queue
+ */
+int queue_reset(queue_t q)
+{
+    if (!q) return -1;
+
+    sync_mutex_lock(&q->mutex);
+    if (q->producers_waiting > 0 || q->consumers_waiting > 0)
+    {
+        sync_mutex_unlock(&q->mutex);
+        fprintf(stderr, "Error: Cannot reset a queue with blocked threads.\n");
+        return -1;
+    }
+    q->head = 0;
+    q->tail = 0;
+    set_size(q, 0);
+    trim_slots(q);
+    sync_store(&q->shutdown, false, __ATOMIC_RELAXED);
+    q->consumer_batch = 0;
+    free(q->stamps);
+    q->stamps = NULL;
+    q->batch_target = 0;
+    q->batch_max = 1;
+    sync_store(&q->batch, 1, __ATOMIC_RELAXED);
+    q->trace = NULL;
+    q->trace_id = 0;
+    q->arena = NULL;
+    free(q->meter);
+    q->meter = NULL;
+    sketch_destroy(q->hot_producers);
+    sketch_destroy(q->hot_keys);
+    q->hot_producers = NULL;
+    q->hot_keys = NULL;
+    sync_mutex_unlock(&q->mutex);
+
+    // Like queue_destroy, items any thread cached are dropped with the rest
+    cache_disown(q);
+    return 0;
+}
+
 /**
  * @brief Set the shutdown flag in the queue so all threads can
  * complete and exit properly
@@ -217,12 +1201,66 @@ void queue_shutdown(queue_t q)
 {
     if (!q) return;
 
-    pthread_mutex_lock(&q->mutex);
-    q->shutdown = true;
+    sync_mutex_lock(&q->mutex);
+    set_shutdown(q);
     // Wake up ALL waiting threads (producers and consumers)
-    pthread_cond_broadcast(&q->not_full);
-    pthread_cond_broadcast(&q->not_empty);
-    pthread_mutex_unlock(&q->mutex);
+    sync_cond_broadcast(&q->not_full);
+    sync_cond_broadcast(&q->not_empty);
+    sync_mutex_unlock(&q->mutex);
+}
+
+/*
+ * Observer queries. None of these take q->mutex, so monitoring threads and
+ * consumer loops never contend with enqueue/dequeue. Each value is written
+ * atomically under the mutex and read with a single atomic load: it was true
+ * at some instant during the call, but separate queries are not a consistent
+ * snapshot of each other. Items cached by batching consumers are not counted.
+ * Once is_shutdown() returns true it stays true until queue_reset().
+ */
+
+/**
+ * @brief Returns the number of items in the queue without taking the lock.
+ * The value is a snapshot and may be stale by the time the caller uses it.
+ *
+ * @param q the queue
+ */
+int queue_size(queue_t q)
+{
+    if (!q) return 0;
+    return sync_load(&q->size, __ATOMIC_RELAXED);
+}
+
+/**
+ * @brief Returns the maximum number of items the queue holds
+ *
+ * @param q the queue
+ */
+int queue_capacity(queue_t q)
+{
+    if (!q) return 0;
+    return q->capacity; // Never changes after queue_init
+}
+
+/**
+ * @brief Returns the number of producers blocked because the queue is full
+ *
+ * @param q the queue
+ */
+int queue_waiting_producers(queue_t q)
+{
+    if (!q) return 0;
+    return sync_load(&q->producers_waiting, __ATOMIC_RELAXED);
+}
+
+/**
+ * @brief Returns the number of consumers blocked because the queue is empty
+ *
+ * @param q the queue
+ */
+int queue_waiting_consumers(queue_t q)
+{
+    if (!q) return 0;
+    return sync_load(&q->consumers_waiting, __ATOMIC_RELAXED);
 }
 
 /**
@@ -235,10 +1273,7 @@ bool is_empty(queue_t q)
 {
     if (!q) return true; // Consider a NULL queue empty
 
-    pthread_mutex_lock(&q->mutex);
-    bool empty = (q->size == 0);
-    pthread_mutex_unlock(&q->mutex);
-    return empty;
+    return queue_size(q) == 0;
 }
 
 /**
@@ -250,8 +1285,5 @@ bool is_shutdown(queue_t q)
 {
     if (!q) return true; // Consider a NULL queue shutdown
 
-    pthread_mutex_lock(&q->mutex);
-    bool shutdown_status = q->shutdown;
-    pthread_mutex_unlock(&q->mutex);
-    return shutdown_status;
-}
\ No newline at end of file
+    return sync_load(&q->shutdown, __ATOMIC_ACQUIRE);
+}
@@ -2,17 +2,59 @@
 #define LAB_H
 #include <stdlib.h>
 #include <stdbool.h>
+#include <stdint.h>
 
 #ifdef __cplusplus
 extern "C"
 {
 #endif
 
+/**
+ * @brief Upper bound on the number of items a consumer caches per shared access
+ */
+#define QUEUE_MAX_CONSUMER_BATCH 32
+
     /**
      * @brief opaque type definition for a queue
      */
     typedef struct queue *queue_t;
 
+    /**
+     * @brief opaque type definition for a trace buffer, see trace.h
+     */
+    typedef struct trace *trace_t;
+
+    /**
+     * @brief opaque type definition for a payload arena, see arena.h
+     */
+    typedef struct arena *arena_t;
+
+    /**
+     * @brief A heavy hitter reported by queue_hot_producers() and
+     * queue_hot_keys(), see sketch.h
+     */
+    struct sketch_entry;
+
+    /**
+     * @brief Queueing analytics for one window, see queue_stats_sample().
+     * Rates are per second, times in nanoseconds.
+     */
+    struct queue_stats
+    {
+        uint64_t window_ns;         // Length of the window
+        uint64_t arrivals;          // Items enqueued during the window
+        uint64_t departures;        // Items dequeued during the window
+        double arrival_rate;        // Arrivals per second (lambda)
+        double departure_rate;      // Departures per second
+        double mean_depth;          // Time-averaged number of queued items (L)
+        double mean_sojourn_ns;     // Mean time a departing item spent queued (W)
+        double mean_idle_consumers; // Time-averaged consumers blocked on empty
+        double busy_fraction;       // Share of consumer time not blocked on empty
+        double service_rate;        // Departures per second of busy consumer time (mu)
+        double utilization;         // lambda / (consumers * mu)
+        double little_error;        // (L - lambda * W) / L, near 0 when consistent
+    };
+
     /**
      * @brief Initialize a new queue
      *
@@ -36,6 +78,38 @@ extern "C"
      */
     void enqueue(queue_t q, void *data);
 
+    /**
+     * @brief Adds an element to the back of the queue without blocking
+     *
+     * @param q the queue
+     * @param data the data to add
+     * @return 0 if the element was added, -1 if the queue was full or shut down
+     */
+    int try_enqueue(queue_t q, void *data);
+
+    /**
+     * @brief Adds an element to the back of the queue like enqueue() and
+     * counts it under key in the heavy-hitter sketches
+     *
+     * @param q the queue
+     * @param data the data to add
+     * @param key the key the element belongs to, for example a flow or tenant
+     */
+    void enqueue_keyed(queue_t q, void *data, uint64_t key);
+
+    /**
+     * @brief Adds n elements to the back of the queue in order, taking the
+     * lock once per run of free slots instead of once per element. Blocks
+     * while the queue is full. With an arena set, seals the caller's region
+     * afterwards.
+     *
+     * @param q the queue
+     * @param items the elements to add
+     * @param n number of elements
+     * @return number of elements added, less than n if the queue was shut down
+     */
+    int enqueue_batch(queue_t q, void **items, int n);
+
     /**
      * @brief Removes the first element in the queue.
      *
@@ -43,6 +117,172 @@ extern "C"
      */
     void *dequeue(queue_t q);
 
+    /**
+     * @brief Removes up to max elements from the front of the queue with a
+     * single lock acquisition. Blocks until at least one element is available.
+     *
+     * @param q the queue
+     * @param items array that receives the elements in FIFO order
+     * @param max size of the items array
+     * @return number of elements removed, 0 if the queue was shutdown and empty
+     */
+    int dequeue_batch(queue_t q, void **items, int max);
+
+    /**
+     * @brief Enables consumer batch mode. Each dequeue() that finds the calling
+     * thread's cache empty pulls up to batch items in one shared access and
+     * later calls hand them out one at a time, prefetching upcoming payloads.
+     * Cached items are still served after queue_shutdown() and are pushed back
+     * onto the queue when the thread exits or dequeues from another queue.
+     * is_empty() does not count cached items. Set before consumers start.
+     *
+     * @param q the queue
+     * @param batch items per shared access, 0 or 1 disables batching
+     */
+    void queue_set_consumer_batch(queue_t q, int batch);
+
+    /**
+     * @brief Enables the adaptive batch size controller. Every enqueue stamps
+     * its item and every dequeue_batch() compares the oldest item's sojourn
+     * time with target_ns: over target the batch size is halved, under target
+     * with more items queued than one batch it grows by one (AIMD). While
+     * enabled, dequeue_batch() and consumer batch mode take at most
+     * queue_batch_size() items, and producers can use queue_batch_size() to
+     * size their enqueue_batch() calls. Set before other threads use the queue.
+     *
+     * @param q the queue
+     * @param target_ns sojourn time to aim for, 0 disables the controller
+     * @param max_batch largest batch size the controller may choose
+     * @return 0 on success, -1 on allocation failure
+     */
+    int queue_set_batch_target(queue_t q, uint64_t target_ns, int max_batch);
+
+    /**
+     * @brief Returns the batch size currently chosen by the controller, or 1
+     * when it is disabled. Read without locking.
+     *
+     * @param q the queue
+     */
+    int queue_batch_size(queue_t q);
+
+    /**
+     * @brief Records every enqueue and dequeue (time, depth, item count) into
+     * a trace buffer for later replay. Set before other threads use the queue.
+     *
+     * @param q the queue
+     * @param t trace buffer from trace_init(), NULL stops recording
+     * @param id queue id written to each record
+     */
+    void queue_set_trace(queue_t q, trace_t t, uint16_t id);
+
+    /**
+     * @brief Ties a payload arena to the queue. Each enqueue_batch() then
+     * seals the calling thread's region once the batch is queued, so a
+     * region holds whole batches and is recycled once consumers have
+     * released every payload in it with arena_release(). Releasing stays
+     * with the consumer, which alone knows when it is done with a payload.
+     * Set before other threads use the queue.
+     *
+     * @param q the queue
+     * @param a arena producers allocate payloads from, NULL to stop sealing
+     */
+    void queue_set_arena(queue_t q, arena_t a);
+
+    /**
+     * @brief Turns windowed queueing analytics on or off. While enabled each
+     * item is stamped on enqueue and the queue integrates its depth and its
+     * blocked consumer count over time, so queue_stats_sample() can report
+     * rates, mean depth and mean sojourn. Set before other threads use the
+     * queue.
+     *
+     * @param q the queue
+     * @param enable true to start a window now, false to stop and free it
+     * @return 0 on success, -1 on allocation failure
+     */
+    int queue_set_stats(queue_t q, bool enable);
+
+    /**
+     * @brief Reports the window since queue_set_stats() or the previous sample
+     * and starts a new one. Busy fraction, service rate and utilization need
+     * the number of consumers that used the queue for the whole window; pass
+     * 0 to leave them at 0. Items dequeued into a batching consumer's cache
+     * count as departed and are busy time for that consumer.
+     *
+     * @param q the queue
+     * @param nconsumers consumer threads serving the queue
+     * @param out receives the analytics
+     * @return 0 on success, -1 if analytics are not enabled
+     */
+    int queue_stats_sample(queue_t q, int nconsumers, struct queue_stats *out);
+
+    /**
+     * @brief Turns heavy-hitter sketches on or off. While enabled every
+     * enqueue bumps a few count-min counters for the calling producer, and
+     * for its key when added with enqueue_keyed(), so the heaviest producers
+     * and keys over a sliding window can be read without allocating per key.
+     * Producers are identified by queue_producer_id().
+     *
+     * @param q the queue
+     * @param k number of producers and keys to track, at most SKETCH_MAX_TOP,
+     * 0 to stop and free the sketches
+     * @param window_ns length of the sliding window
+     * @return 0 on success, -1 on invalid arguments or allocation failure
+     */
+    int queue_set_sketch(queue_t q, int k, uint64_t window_ns);
+
+    /**
+     * @brief Reports the producers that enqueued the most over the sketch
+     * window, heaviest first
+     *
+     * @param q the queue
+     * @param out receives the entries
+     * @param max size of out
+     * @return number of entries written, -1 if sketches are not enabled
+     */
+    int queue_hot_producers(queue_t q, struct sketch_entry *out, int max);
+
+    /**
+     * @brief Reports the keys enqueued the most with enqueue_keyed() over the
+     * sketch window, heaviest first
+     *
+     * @param q the queue
+     * @param out receives the entries
+     * @param max size of out
+     * @return number of entries written, -1 if sketches are not enabled
+     */
+    int queue_hot_keys(queue_t q, struct sketch_entry *out, int max);
+
+    /**
+     * @brief Returns the calling thread's producer id as reported by
+     * queue_hot_producers(). Threads are numbered from 1 in the order they
+     * first enqueue into a sketched queue or call this.
+     */
+    uint64_t queue_producer_id(void);
+
+    /**
+     * @brief Pushes items cached by the calling thread back onto the front of
+     * the queue, so other consumers can take them. Items still cached by
+     * consumers that stopped early are dropped when the queue is destroyed
+     * or reset.
+     *
+     * @param q the queue
+     * @return the number of items handed back
+     */
+    int queue_consumer_flush(queue_t q);
+
+    /**
+     * @brief Turns a queue back into a fresh, empty, running queue without
+     * freeing or reinitializing anything. Consumer batching, the batch
+     * controller, tracing, the arena, analytics and sketches are switched
+     * off and items still queued are dropped. Call only once every thread
+     * has returned from the queue, typically after queue_shutdown() and
+     * draining.
+     *
+     * @param q the queue
+     * @return 0 on success, -1 if a thread is still blocked on the queue
+     */
+    int queue_reset(queue_t q);
+
     /**
      * @brief Set the shutdown flag in the queue so all threads can
      * complete and exit properly
@@ -51,6 +291,43 @@ extern "C"
      */
    void queue_shutdown(queue_t q);
 
+    /*
+     * The queries below never take the queue's lock. Each returns a value
+     * that was true at some instant during the call; separate queries are not
+     * a consistent snapshot of each other. Items cached by batching consumers
+     * are not counted. Once is_shutdown() returns true it stays true until
+     * queue_reset().
+     */
+
+    /**
+     * @brief Returns the number of items in the queue without taking the lock.
+     * The value is a snapshot and may be stale by the time the caller uses it.
+     *
+     * @param q the queue
+     */
+    int queue_size(queue_t q);
+
+    /**
+     * @brief Returns the maximum number of items the queue holds
+     *
+     * @param q the queue
+     */
+    int queue_capacity(queue_t q);
+
+    /**
+     * @brief Returns the number of producers blocked because the queue is full
+     *
+     * @param q the queue
+     */
+    int queue_waiting_producers(queue_t q);
+
+    /**
+     * @brief Returns the number of consumers blocked because the queue is empty
+     *
+     * @param q the queue
+     */
+    int queue_waiting_consumers(queue_t q);
+
     /**
      * @brief Returns true is the queue is empty
      *
@@ -59,7 +336,7 @@ extern "C"
     bool is_empty(queue_t q);
 
     /**
-     * @brief
+     * @brief Returns true if the queue is in shutdown mode
      *
      * @param q The queue
      */
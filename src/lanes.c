@@ -0,0 +1,346 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <errno.h>
+#include <pthread.h>
+#include <time.h>
+#include "lanes.h"
+#include "clock.h"
+
+/**
+ * @brief One consumer's lane, a ring of items with their enqueue times
+ */
+struct lane
+{
+    pthread_mutex_t mutex;
+    pthread_cond_t not_empty; // Signalled for this lane's consumer
+    pthread_cond_t not_full;  // Signalled for producers waiting on this lane
+    void **items;
+    uint64_t *stamps;
+    int head;
+    int size;
+    uint64_t local;           // Items the owner took from this lane
+    uint64_t stolen;          // Items the owner took from other lanes
+} __attribute__((aligned(64)));
+
+/**
+ * @brief The internal structure for a multi-lane queue.
+ */
+struct laneq
+{
+    struct lane *lanes;
+    int nlanes;
+    int capacity;      // Items per lane
+    uint64_t steal_ns; // Age after which any consumer may take an item
+    int total;         // Items in all lanes, counted while the lane is locked
+    bool shutdown;     // Set before every lane is woken
+};
+
+static inline bool is_down(laneq_t lq)
+{
+    return __atomic_load_n(&lq->shutdown, __ATOMIC_ACQUIRE);
+}
+
+laneq_t laneq_init(int nlanes, int lane_capacity, uint64_t steal_ns)
+{
+    if (nlanes <= 0 || lane_capacity <= 0)
+    {
+        fprintf(stderr, "Error: Invalid multi-lane queue arguments.\n");
+        return NULL;
+    }
+
+    laneq_t lq = (laneq_t)calloc(1, sizeof(struct laneq));
+    if (!lq)
+    {
+        perror("Failed to allocate multi-lane queue");
+        return NULL;
+    }
+    lq->lanes = (struct lane *)aligned_alloc(64, nlanes * sizeof(struct lane));
+    if (!lq->lanes)
+    {
+        perror("Failed to allocate lanes");
+        free(lq);
+        return NULL;
+    }
+    lq->nlanes = nlanes;
+    lq->capacity = lane_capacity;
+    lq->steal_ns = steal_ns;
+
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC); // Deadlines use clock_now_ns
+    for (int i = 0; i < nlanes; i++)
+    {
+        struct lane *l = &lq->lanes[i];
+        l->items = (void **)malloc(lane_capacity * sizeof(void *));
+        l->stamps = (uint64_t *)malloc(lane_capacity * sizeof(uint64_t));
+        if (!l->items || !l->stamps)
+        {
+            perror("Failed to allocate lane buffer");
+            free(l->items);
+            free(l->stamps);
+            lq->nlanes = i;
+            laneq_destroy(lq);
+            pthread_condattr_destroy(&attr);
+            return NULL;
+        }
+        l->head = 0;
+        l->size = 0;
+        l->local = 0;
+        l->stolen = 0;
+        pthread_mutex_init(&l->mutex, NULL);
+        pthread_cond_init(&l->not_empty, &attr);
+        pthread_cond_init(&l->not_full, NULL);
+    }
+    pthread_condattr_destroy(&attr);
+    return lq;
+}
+
+void laneq_destroy(laneq_t lq)
+{
+    if (!lq) return;
+
+    for (int i = 0; i < lq->nlanes; i++)
+    {
+        struct lane *l = &lq->lanes[i];
+        pthread_mutex_destroy(&l->mutex);
+        pthread_cond_destroy(&l->not_empty);
+        pthread_cond_destroy(&l->not_full);
+        free(l->items);
+        free(l->stamps);
+    }
+    free(lq->lanes);
+    free(lq);
+}
+
+/**
+ * @brief Wakes every lane's consumer. Used when the queue goes from empty
+ * to non-empty, since consumers of empty lanes sleep without a deadline
+ * while nothing is queued anywhere.
+ */
+static void wake_all(laneq_t lq)
+{
+    for (int i = 0; i < lq->nlanes; i++)
+    {
+        struct lane *l = &lq->lanes[i];
+        pthread_mutex_lock(&l->mutex);
+        pthread_cond_broadcast(&l->not_empty);
+        pthread_mutex_unlock(&l->mutex);
+    }
+}
+
+/**
+ * @brief Appends to a lane if it has room. Caller holds l->mutex.
+ */
+static bool lane_push(laneq_t lq, struct lane *l, void *data)
+{
+    if (l->size == lq->capacity)
+    {
+        return false;
+    }
+    int tail = (l->head + l->size) % lq->capacity;
+    l->items[tail] = data;
+    l->stamps[tail] = clock_now_ns();
+    l->size++;
+    pthread_cond_signal(&l->not_empty);
+    return true;
+}
+
+/**
+ * @brief Removes a lane's oldest item. Caller holds l->mutex and the lane is
+ * not empty.
+ */
+static void *lane_pop(laneq_t lq, struct lane *l)
+{
+    void *data = l->items[l->head];
+    l->head = (l->head + 1) % lq->capacity;
+    l->size--;
+    __atomic_fetch_sub(&lq->total, 1, __ATOMIC_SEQ_CST);
+    pthread_cond_signal(&l->not_full);
+    return data;
+}
+
+static int shortest_lane(laneq_t lq)
+{
+    int best = 0;
+    for (int i = 1; i < lq->nlanes; i++)
+    {
+        // Unlocked reads, a stale size only makes the choice less balanced
+        if (__atomic_load_n(&lq->lanes[i].size, __ATOMIC_RELAXED) <
+            __atomic_load_n(&lq->lanes[best].size, __ATOMIC_RELAXED))
+        {
+            best = i;
+        }
+    }
+    return best;
+}
+
+void laneq_enqueue(laneq_t lq, void *data, int hint)
+{
+    if (!lq) return;
+
+    int lane = hint < 0 ? shortest_lane(lq) : hint % lq->nlanes;
+    bool pushed = false;
+    bool first = false; // This item made the queue non-empty
+    for (int k = 0; k < lq->nlanes && !pushed; k++)
+    {
+        struct lane *l = &lq->lanes[(lane + k) % lq->nlanes];
+        pthread_mutex_lock(&l->mutex);
+        if (is_down(lq))
+        {
+            pthread_mutex_unlock(&l->mutex);
+            return;
+        }
+        pushed = lane_push(lq, l, data);
+        if (pushed)
+        {
+            first = __atomic_fetch_add(&lq->total, 1, __ATOMIC_SEQ_CST) == 0;
+        }
+        pthread_mutex_unlock(&l->mutex);
+    }
+
+    if (!pushed)
+    {
+        // Every lane is full, wait for room on the hinted one
+        struct lane *l = &lq->lanes[lane];
+        pthread_mutex_lock(&l->mutex);
+        while (l->size == lq->capacity && !is_down(lq))
+        {
+            pthread_cond_wait(&l->not_full, &l->mutex);
+        }
+        if (!is_down(lq) && lane_push(lq, l, data))
+        {
+            first = __atomic_fetch_add(&lq->total, 1, __ATOMIC_SEQ_CST) == 0;
+        }
+        pthread_mutex_unlock(&l->mutex);
+    }
+
+    if (first)
+    {
+        wake_all(lq);
+    }
+}
+
+/**
+ * @brief Takes the head of another lane if it is older than the steal delay.
+ * Otherwise lowers *deadline to when the oldest foreign head becomes fair
+ * game.
+ */
+static void *steal(laneq_t lq, int self, uint64_t now, uint64_t *deadline)
+{
+    for (int k = 1; k < lq->nlanes; k++)
+    {
+        struct lane *l = &lq->lanes[(self + k) % lq->nlanes];
+        if (__atomic_load_n(&l->size, __ATOMIC_RELAXED) == 0)
+        {
+            continue;
+        }
+        pthread_mutex_lock(&l->mutex);
+        if (l->size > 0)
+        {
+            uint64_t due = l->stamps[l->head] + lq->steal_ns;
+            if (due <= now)
+            {
+                void *data = lane_pop(lq, l);
+                pthread_mutex_unlock(&l->mutex);
+                return data;
+            }
+            if (due < *deadline)
+            {
+                *deadline = due;
+            }
+        }
+        pthread_mutex_unlock(&l->mutex);
+    }
+    return NULL;
+}
+
+void *laneq_dequeue(laneq_t lq, int lane)
+{
+    if (!lq || lane < 0 || lane >= lq->nlanes) return NULL;
+
+    struct lane *own = &lq->lanes[lane];
+    for (;;)
+    {
+        pthread_mutex_lock(&own->mutex);
+        if (own->size > 0)
+        {
+            void *data = lane_pop(lq, own);
+            own->local++;
+            pthread_mutex_unlock(&own->mutex);
+            return data;
+        }
+        pthread_mutex_unlock(&own->mutex);
+
+        uint64_t now = clock_now_ns();
+        uint64_t deadline = UINT64_MAX;
+        void *data = steal(lq, lane, now, &deadline);
+        if (data)
+        {
+            pthread_mutex_lock(&own->mutex);
+            own->stolen++;
+            pthread_mutex_unlock(&own->mutex);
+            return data;
+        }
+
+        pthread_mutex_lock(&own->mutex);
+        if (own->size == 0)
+        {
+            int total = __atomic_load_n(&lq->total, __ATOMIC_SEQ_CST);
+            if (total == 0 && is_down(lq))
+            {
+                pthread_mutex_unlock(&own->mutex);
+                return NULL;
+            }
+            if (total == 0)
+            {
+                // Nothing anywhere, an enqueue that changes that wakes us
+                pthread_cond_wait(&own->not_empty, &own->mutex);
+            }
+            else
+            {
+                // Items elsewhere, wake up when the oldest may be taken. An
+                // item we did not see yet is due no sooner than steal_ns.
+                if (deadline == UINT64_MAX || deadline > now + lq->steal_ns)
+                {
+                    deadline = now + lq->steal_ns;
+                }
+                struct timespec ts = {(time_t)(deadline / 1000000000ull),
+                                      (long)(deadline % 1000000000ull)};
+                pthread_cond_timedwait(&own->not_empty, &own->mutex, &ts);
+            }
+        }
+        pthread_mutex_unlock(&own->mutex);
+    }
+}
+
+void laneq_shutdown(laneq_t lq)
+{
+    if (!lq) return;
+
+    // Each lane's mutex is taken after the store, so a thread that read the
+    // old value under that mutex is already waiting and gets the broadcast
+    __atomic_store_n(&lq->shutdown, true, __ATOMIC_RELEASE);
+    for (int i = 0; i < lq->nlanes; i++)
+    {
+        struct lane *l = &lq->lanes[i];
+        pthread_mutex_lock(&l->mutex);
+        pthread_cond_broadcast(&l->not_empty);
+        pthread_cond_broadcast(&l->not_full);
+        pthread_mutex_unlock(&l->mutex);
+    }
+}
+
+void laneq_stats(laneq_t lq, uint64_t *local, uint64_t *stolen)
+{
+    uint64_t l = 0, s = 0;
+    for (int i = 0; lq && i < lq->nlanes; i++)
+    {
+        pthread_mutex_lock(&lq->lanes[i].mutex);
+        l += lq->lanes[i].local;
+        s += lq->lanes[i].stolen;
+        pthread_mutex_unlock(&lq->lanes[i].mutex);
+    }
+    if (local) *local = l;
+    if (stolen) *stolen = s;
+}
@@ -0,0 +1,89 @@
+#ifndef LANES_H
+#define LANES_H
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+/**
+ * @brief Hint for items with no preferred consumer
+ */
+#define LANEQ_ANY (-1)
+
+    /**
+     * @brief opaque type definition for a multi-lane queue
+     *
+     * Each consumer owns one lane and producers pick the lane with a hint,
+     * usually the consumer pinned to the CPU whose state the item touches.
+     * A consumer serves its own lane first, in FIFO order. It takes the
+     * oldest item of another lane only once that item has waited longer
+     * than the steal delay, so hinted items stay local while their consumer
+     * keeps up and no item waits much longer than the delay when it does not.
+     */
+    typedef struct laneq *laneq_t;
+
+    /**
+     * @brief Create a multi-lane queue
+     *
+     * @param nlanes number of lanes, one per consumer
+     * @param lane_capacity most items per lane
+     * @param steal_ns how long an item waits for its own consumer before any
+     * consumer may take it
+     * @return a new queue, or NULL on error
+     */
+    laneq_t laneq_init(int nlanes, int lane_capacity, uint64_t steal_ns);
+
+    /**
+     * @brief Frees the queue. No thread may be using it.
+     *
+     * @param lq the queue
+     */
+    void laneq_destroy(laneq_t lq);
+
+    /**
+     * @brief Adds an item to the hinted lane. If that lane is full the item
+     * goes to the first lane with room; if all are full the call blocks until
+     * the hinted lane has room.
+     *
+     * @param lq the queue
+     * @param data the item
+     * @param hint lane index, or LANEQ_ANY for the shortest lane. Hints of
+     * nlanes or more wrap, so a CPU number works when consumer i runs on CPU i.
+     */
+    void laneq_enqueue(laneq_t lq, void *data, int hint);
+
+    /**
+     * @brief Removes an item for the consumer of a lane, preferring its own
+     * lane and taking from others only after the steal delay
+     *
+     * @param lq the queue
+     * @param lane the calling consumer's lane
+     * @return the item, or NULL once the queue is shut down and empty
+     */
+    void *laneq_dequeue(laneq_t lq, int lane);
+
+    /**
+     * @brief Wakes every blocked thread; consumers drain what is left and
+     * then get NULL
+     *
+     * @param lq the queue
+     */
+    void laneq_shutdown(laneq_t lq);
+
+    /**
+     * @brief Reports how many items consumers took from their own lane and
+     * how many they took from other lanes
+     *
+     * @param lq the queue
+     * @param local receives the count of items served on their hinted lane
+     * @param stolen receives the count of items taken from another lane
+     */
+    void laneq_stats(laneq_t lq, uint64_t *local, uint64_t *stolen);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
+
+#endif
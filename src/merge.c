@@ -0,0 +1,412 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <pthread.h>
+#include <time.h>
+#include "merge.h"
+#include "clock.h"
+
+/**
+ * @brief What a lane's key in the loser tree stands for. At equal times a
+ * waiting lane sorts before an item, so an item is only released when it
+ * is strictly earlier than every watermark still in play.
+ */
+enum key_kind
+{
+    KEY_WAIT = 0, // Empty and live, the value is its watermark
+    KEY_ITEM = 1, // The value is the timestamp of its head item
+    KEY_DONE = 2  // Closed and drained, or idle; never holds the merge back
+};
+
+struct key
+{
+    uint64_t value;
+    enum key_kind kind;
+};
+
+/**
+ * @brief One producer's lane, a ring of items with their timestamps
+ */
+struct merge_lane
+{
+    void **items;
+    uint64_t *stamps;
+    int head;
+    int size;
+    uint64_t watermark; // Nothing earlier will be pushed
+    uint64_t active_ns; // Last push or advance, for the idle timeout
+    bool closed;
+    pthread_cond_t not_full;
+};
+
+/**
+ * @brief The internal structure for a merge stage.
+ *
+ * keys[] holds each lane's key as of the last time the tree looked at it.
+ * A lane's key only grows while it is not the winner (pushes and advances
+ * can only move it later), so a stale key is a lower bound and the tree is
+ * refreshed lazily: when a stale lane wins it is re-read and replayed.
+ * The one exception, an idle lane sending again, forces a rebuild.
+ */
+struct merge
+{
+    pthread_mutex_t mutex;
+    pthread_cond_t changed; // Signalled for the consumer when a lane changes
+    struct merge_lane *lanes;
+    int nlanes;
+    int capacity;
+    int leaves;             // nlanes rounded up to a power of two
+    uint64_t idle_ns;
+    struct key *keys;       // One per leaf, padding leaves are KEY_DONE
+    int *tree;              // tree[0] is the winner, tree[1..] the losers
+    int *scratch;           // Winners while building, 2 * leaves
+    bool rebuild;
+    bool consumer_waiting;
+    int open;               // Lanes not closed
+    int total;              // Items buffered in all lanes
+    uint64_t last_ts;       // Latest timestamp emitted
+    uint64_t emitted;
+    uint64_t late;
+};
+
+static bool key_less(const struct key *a, const struct key *b)
+{
+    if (a->value != b->value)
+    {
+        return a->value < b->value;
+    }
+    return a->kind < b->kind;
+}
+
+/**
+ * @brief Whether leaf a wins against leaf b, lower index breaking ties
+ */
+static bool beats(merge_t m, int a, int b)
+{
+    if (key_less(&m->keys[a], &m->keys[b]))
+    {
+        return true;
+    }
+    if (key_less(&m->keys[b], &m->keys[a]))
+    {
+        return false;
+    }
+    return a < b;
+}
+
+static struct key lane_key(merge_t m, int i, uint64_t now)
+{
+    struct merge_lane *l = &m->lanes[i];
+    if (l->size > 0)
+    {
+        return (struct key){l->stamps[l->head], KEY_ITEM};
+    }
+    if (l->closed || (m->idle_ns && now - l->active_ns >= m->idle_ns))
+    {
+        return (struct key){UINT64_MAX, KEY_DONE};
+    }
+    return (struct key){l->watermark, KEY_WAIT};
+}
+
+/**
+ * @brief Re-reads every lane and plays the whole tournament. Caller holds
+ * m->mutex.
+ */
+static void build(merge_t m, uint64_t now)
+{
+    int k = m->leaves;
+    for (int i = 0; i < m->nlanes; i++)
+    {
+        m->keys[i] = lane_key(m, i, now);
+    }
+    for (int i = 0; i < k; i++)
+    {
+        m->scratch[k + i] = i;
+    }
+    for (int n = k - 1; n >= 1; n--)
+    {
+        int a = m->scratch[2 * n];
+        int b = m->scratch[2 * n + 1];
+        bool a_wins = beats(m, a, b);
+        m->scratch[n] = a_wins ? a : b;
+        m->tree[n] = a_wins ? b : a;
+    }
+    m->tree[0] = k > 1 ? m->scratch[1] : 0;
+    m->rebuild = false;
+}
+
+/**
+ * @brief Replays the matches from a leaf to the root after its key
+ * changed. Only valid for the current winner. Caller holds m->mutex.
+ */
+static void replay(merge_t m, int leaf)
+{
+    int w = leaf;
+    for (int n = (m->leaves + leaf) / 2; n >= 1; n /= 2)
+    {
+        if (beats(m, m->tree[n], w))
+        {
+            int t = m->tree[n];
+            m->tree[n] = w;
+            w = t;
+        }
+    }
+    m->tree[0] = w;
+}
+
+merge_t merge_init(int nlanes, int lane_capacity, uint64_t idle_ns)
+{
+    if (nlanes <= 0 || lane_capacity <= 0)
+    {
+        fprintf(stderr, "Error: Invalid merge stage arguments.\n");
+        return NULL;
+    }
+
+    merge_t m = (merge_t)calloc(1, sizeof(struct merge));
+    if (!m)
+    {
+        perror("Failed to allocate merge stage");
+        return NULL;
+    }
+    int leaves = 1;
+    while (leaves < nlanes)
+    {
+        leaves *= 2;
+    }
+    m->lanes = (struct merge_lane *)calloc(nlanes, sizeof(struct merge_lane));
+    m->keys = (struct key *)malloc(leaves * sizeof(struct key));
+    m->tree = (int *)malloc(leaves * sizeof(int));
+    m->scratch = (int *)malloc(2 * leaves * sizeof(int));
+    if (!m->lanes || !m->keys || !m->tree || !m->scratch)
+    {
+        perror("Failed to allocate merge tree");
+        free(m->lanes);
+        free(m->keys);
+        free(m->tree);
+        free(m->scratch);
+        free(m);
+        return NULL;
+    }
+    m->nlanes = nlanes;
+    m->capacity = lane_capacity;
+    m->leaves = leaves;
+    m->idle_ns = idle_ns;
+    m->open = nlanes;
+
+    uint64_t now = clock_now_ns();
+    for (int i = 0; i < nlanes; i++)
+    {
+        struct merge_lane *l = &m->lanes[i];
+        l->items = (void **)malloc(lane_capacity * sizeof(void *));
+        l->stamps = (uint64_t *)malloc(lane_capacity * sizeof(uint64_t));
+        if (!l->items || !l->stamps)
+        {
+            perror("Failed to allocate merge lane buffer");
+            free(l->items);
+            free(l->stamps);
+            m->nlanes = i;
+            merge_destroy(m);
+            return NULL;
+        }
+        l->active_ns = now;
+        pthread_cond_init(&l->not_full, NULL);
+    }
+    for (int i = nlanes; i < leaves; i++)
+    {
+        m->keys[i] = (struct key){UINT64_MAX, KEY_DONE};
+    }
+
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC); // Deadlines use clock_now_ns
+    pthread_cond_init(&m->changed, &attr);
+    pthread_condattr_destroy(&attr);
+    pthread_mutex_init(&m->mutex, NULL);
+    m->rebuild = true;
+    return m;
+}
+
+void merge_destroy(merge_t m)
+{
+    if (!m) return;
+
+    for (int i = 0; i < m->nlanes; i++)
+    {
+        pthread_cond_destroy(&m->lanes[i].not_full);
+        free(m->lanes[i].items);
+        free(m->lanes[i].stamps);
+    }
+    pthread_mutex_destroy(&m->mutex);
+    pthread_cond_destroy(&m->changed);
+    free(m->lanes);
+    free(m->keys);
+    free(m->tree);
+    free(m->scratch);
+    free(m);
+}
+
+/**
+ * @brief Records producer activity on a lane and wakes the consumer.
+ * Caller holds m->mutex.
+ */
+static void lane_touched(merge_t m, int lane)
+{
+    m->lanes[lane].active_ns = clock_now_ns();
+    if (m->keys[lane].kind == KEY_DONE)
+    {
+        // The tree wrote this lane off as idle, its key is no longer a
+        // lower bound
+        m->rebuild = true;
+    }
+    if (m->consumer_waiting)
+    {
+        pthread_cond_signal(&m->changed);
+    }
+}
+
+int merge_push(merge_t m, int lane, void *data, uint64_t ts)
+{
+    if (!m || lane < 0 || lane >= m->nlanes) return -1;
+
+    struct merge_lane *l = &m->lanes[lane];
+    pthread_mutex_lock(&m->mutex);
+    while (l->size == m->capacity && !l->closed)
+    {
+        pthread_cond_wait(&l->not_full, &m->mutex);
+    }
+    if (l->closed || ts < l->watermark)
+    {
+        pthread_mutex_unlock(&m->mutex);
+        return -1;
+    }
+    int tail = (l->head + l->size) % m->capacity;
+    l->items[tail] = data;
+    l->stamps[tail] = ts;
+    l->size++;
+    l->watermark = ts;
+    m->total++;
+    lane_touched(m, lane);
+    pthread_mutex_unlock(&m->mutex);
+    return 0;
+}
+
+int merge_advance(merge_t m, int lane, uint64_t ts)
+{
+    if (!m || lane < 0 || lane >= m->nlanes) return -1;
+
+    struct merge_lane *l = &m->lanes[lane];
+    pthread_mutex_lock(&m->mutex);
+    if (l->closed)
+    {
+        pthread_mutex_unlock(&m->mutex);
+        return -1;
+    }
+    if (ts > l->watermark)
+    {
+        l->watermark = ts;
+    }
+    lane_touched(m, lane);
+    pthread_mutex_unlock(&m->mutex);
+    return 0;
+}
+
+void merge_close_lane(merge_t m, int lane)
+{
+    if (!m || lane < 0 || lane >= m->nlanes) return;
+
+    struct merge_lane *l = &m->lanes[lane];
+    pthread_mutex_lock(&m->mutex);
+    if (!l->closed)
+    {
+        l->closed = true;
+        m->open--;
+        pthread_cond_broadcast(&l->not_full);
+        if (m->consumer_waiting)
+        {
+            pthread_cond_signal(&m->changed);
+        }
+    }
+    pthread_mutex_unlock(&m->mutex);
+}
+
+void *merge_pop(merge_t m, uint64_t *ts)
+{
+    if (!m) return NULL;
+
+    pthread_mutex_lock(&m->mutex);
+    for (;;)
+    {
+        uint64_t now = m->idle_ns ? clock_now_ns() : 0;
+        if (m->rebuild)
+        {
+            build(m, now);
+        }
+        int w = m->tree[0];
+        struct key k = lane_key(m, w, now);
+        if (k.value != m->keys[w].value || k.kind != m->keys[w].kind)
+        {
+            // The winner's key was stale, settle it and play again
+            m->keys[w] = k;
+            replay(m, w);
+            continue;
+        }
+
+        if (k.kind == KEY_ITEM)
+        {
+            struct merge_lane *l = &m->lanes[w];
+            void *data = l->items[l->head];
+            l->head = (l->head + 1) % m->capacity;
+            l->size--;
+            m->total--;
+            if (k.value < m->last_ts)
+            {
+                m->late++;
+            }
+            else
+            {
+                m->last_ts = k.value;
+            }
+            m->emitted++;
+            m->keys[w] = lane_key(m, w, now);
+            replay(m, w);
+            pthread_cond_signal(&l->not_full);
+            pthread_mutex_unlock(&m->mutex);
+            if (ts)
+            {
+                *ts = k.value;
+            }
+            return data;
+        }
+
+        if (k.kind == KEY_DONE && m->open == 0 && m->total == 0)
+        {
+            pthread_mutex_unlock(&m->mutex);
+            return NULL;
+        }
+
+        // Held back by an empty live lane, or every live lane is idle
+        m->consumer_waiting = true;
+        if (k.kind == KEY_WAIT && m->idle_ns)
+        {
+            uint64_t deadline = m->lanes[w].active_ns + m->idle_ns;
+            struct timespec dl = {(time_t)(deadline / 1000000000ull),
+                                  (long)(deadline % 1000000000ull)};
+            pthread_cond_timedwait(&m->changed, &m->mutex, &dl);
+        }
+        else
+        {
+            pthread_cond_wait(&m->changed, &m->mutex);
+        }
+        m->consumer_waiting = false;
+    }
+}
+
+void merge_stats(merge_t m, uint64_t *emitted, uint64_t *late)
+{
+    if (!m) return;
+
+    pthread_mutex_lock(&m->mutex);
+    if (emitted) *emitted = m->emitted;
+    if (late) *late = m->late;
+    pthread_mutex_unlock(&m->mutex);
+}
@@ -0,0 +1,102 @@
+#ifndef MERGE_H
+#define MERGE_H
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+    /**
+     * @brief opaque type definition for an event-time merge stage
+     *
+     * Each producer owns one input lane and pushes items in timestamp order.
+     * The consumer pops items in global timestamp order: the head of a lane
+     * is only released once every other lane either holds an item, has
+     * closed, or has a watermark (a promise that nothing earlier will
+     * arrive) at or past it. A lane that stays empty without advancing its
+     * watermark for longer than the idle timeout stops holding the merge
+     * back; anything it sends later that is older than what was already
+     * emitted is delivered at once and counted as late.
+     *
+     * The lanes are merged with a loser tree, so an item costs O(log lanes)
+     * comparisons.
+     */
+    typedef struct merge *merge_t;
+
+    /**
+     * @brief Create a merge stage
+     *
+     * @param nlanes number of input lanes, one per producer
+     * @param lane_capacity most items buffered per lane before push blocks
+     * @param idle_ns how long an empty lane may hold the merge back, 0 to
+     * wait for it indefinitely
+     * @return a new merge stage, or NULL on error
+     */
+    merge_t merge_init(int nlanes, int lane_capacity, uint64_t idle_ns);
+
+    /**
+     * @brief Frees the merge stage. No thread may be using it.
+     *
+     * @param m the merge stage
+     */
+    void merge_destroy(merge_t m);
+
+    /**
+     * @brief Adds an item to a lane, blocking while the lane is full. The
+     * item's timestamp also advances the lane's watermark.
+     *
+     * @param m the merge stage
+     * @param lane the producer's lane
+     * @param data the item
+     * @param ts the item's event time, not less than the lane's watermark
+     * @return 0 on success, -1 if the lane is invalid or closed or ts is
+     * behind its watermark
+     */
+    int merge_push(merge_t m, int lane, void *data, uint64_t ts);
+
+    /**
+     * @brief Promises that a lane will send nothing earlier than ts. Idle
+     * producers call this as a heartbeat so the merge can move on without
+     * waiting for the idle timeout.
+     *
+     * @param m the merge stage
+     * @param lane the producer's lane
+     * @param ts the new watermark, ignored if behind the current one
+     * @return 0 on success, -1 if the lane is invalid or closed
+     */
+    int merge_advance(merge_t m, int lane, uint64_t ts);
+
+    /**
+     * @brief Ends a lane's stream. Its buffered items are still delivered.
+     *
+     * @param m the merge stage
+     * @param lane the producer's lane
+     */
+    void merge_close_lane(merge_t m, int lane);
+
+    /**
+     * @brief Removes the earliest item once no lane can still send anything
+     * earlier, blocking until then. Only one thread may pop.
+     *
+     * @param m the merge stage
+     * @param ts receives the item's timestamp, may be NULL
+     * @return the item, or NULL once every lane is closed and drained
+     */
+    void *merge_pop(merge_t m, uint64_t *ts);
+
+    /**
+     * @brief Reports how many items were emitted and how many of them were
+     * late, older than an item emitted before them
+     *
+     * @param m the merge stage
+     * @param emitted receives the count of popped items
+     * @param late receives the count of popped items that broke time order
+     */
+    void merge_stats(merge_t m, uint64_t *emitted, uint64_t *late);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
+
+#endif
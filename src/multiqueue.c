@@ -0,0 +1,404 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <sched.h>
+#include "multiqueue.h"
+#include "clock.h"
+
+#define EMPTY_STAMP UINT64_MAX // Head stamp of an empty internal queue
+#define MIN_SLOTS 16           // Initial ring length of an internal queue
+#define PICK_ATTEMPTS 8        // Random picks before falling back to a scan
+#define PUSH_FAILURES 8        // Failed ring growths before an enqueue gives up
+
+/**
+ * @brief A stamped item in an internal queue
+ */
+struct entry
+{
+    uint64_t stamp; // Time the item was enqueued
+    void *data;     // The item
+};
+
+/**
+ * @brief One internal FIFO queue. Aligned so neighbours never share a line.
+ */
+struct subqueue
+{
+    pthread_mutex_t lock; // Protects the ring
+    uint64_t top;         // Stamp of the head item, read without the lock
+    struct entry *ring;   // Circular buffer of items
+    int slots;            // Allocated length of ring
+    int head;             // Index of the oldest item
+    int size;             // Number of items in the ring
+} __attribute__((aligned(64)));
+
+/**
+ * @brief The internal structure for the multiqueue.
+ */
+struct multiqueue
+{
+    struct subqueue *queues;  // The k * nthreads internal queues
+    int nqueues;              // Number of internal queues
+    int capacity;             // Maximum number of items overall
+    int size;                 // Items reserved or present, updated atomically
+    bool shutdown;            // Flag to indicate if the queue is shutting down
+    int producers_waiting;    // Producers asleep on not_full
+    int consumers_waiting;    // Consumers asleep on not_empty
+    pthread_mutex_t sleep;    // Only taken to sleep or to wake a sleeper
+    pthread_cond_t not_full;  // Signalled when an item is removed
+    pthread_cond_t not_empty; // Signalled when an item is added
+};
+
+static __thread uint32_t rng_state = 0;
+
+static uint32_t rng_next(void)
+{
+    uint32_t x = rng_state;
+    if (x == 0)
+    {
+        x = (uint32_t)(uintptr_t)&rng_state | 1u;
+    }
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    rng_state = x;
+    return x;
+}
+
+multiqueue_t multiqueue_init(int capacity, int nthreads, int k)
+{
+    if (capacity <= 0 || nthreads <= 0 || k <= 0)
+    {
+        fprintf(stderr, "Error: Multiqueue capacity, threads and k must be positive.\n");
+        return NULL;
+    }
+
+    multiqueue_t mq = (multiqueue_t)calloc(1, sizeof(struct multiqueue));
+    if (!mq)
+    {
+        perror("Failed to allocate multiqueue structure");
+        return NULL;
+    }
+
+    // Two picks need at least two internal queues
+    mq->nqueues = k * nthreads < 2 ? 2 : k * nthreads;
+    mq->queues = (struct subqueue *)aligned_alloc(64, mq->nqueues * sizeof(struct subqueue));
+    if (!mq->queues)
+    {
+        perror("Failed to allocate multiqueue internal queues");
+        free(mq);
+        return NULL;
+    }
+
+    int slots = capacity < MIN_SLOTS ? capacity : MIN_SLOTS;
+    for (int i = 0; i < mq->nqueues; i++)
+    {
+        struct subqueue *s = &mq->queues[i];
+        s->ring = (struct entry *)malloc(slots * sizeof(struct entry));
+        if (!s->ring)
+        {
+            perror("Failed to allocate multiqueue ring");
+            while (--i >= 0)
+            {
+                free(mq->queues[i].ring);
+                pthread_mutex_destroy(&mq->queues[i].lock);
+            }
+            free(mq->queues);
+            free(mq);
+            return NULL;
+        }
+        pthread_mutex_init(&s->lock, NULL);
+        s->top = EMPTY_STAMP;
+        s->slots = slots;
+        s->head = 0;
+        s->size = 0;
+    }
+
+    mq->capacity = capacity;
+    pthread_mutex_init(&mq->sleep, NULL);
+    pthread_cond_init(&mq->not_full, NULL);
+    pthread_cond_init(&mq->not_empty, NULL);
+    return mq;
+}
+
+void multiqueue_destroy(multiqueue_t mq)
+{
+    if (!mq) return;
+
+    multiqueue_shutdown(mq);
+
+    for (int i = 0; i < mq->nqueues; i++)
+    {
+        pthread_mutex_destroy(&mq->queues[i].lock);
+        free(mq->queues[i].ring);
+    }
+    pthread_mutex_destroy(&mq->sleep);
+    pthread_cond_destroy(&mq->not_full);
+    pthread_cond_destroy(&mq->not_empty);
+    free(mq->queues);
+    free(mq);
+}
+
+/**
+ * @brief Appends an item to an internal queue, growing the ring if needed.
+ * Caller holds s->lock.
+ *
+ * @return 0 on success, -1 if the ring could not grow
+ */
+static int subqueue_push(struct subqueue *s, struct entry e)
+{
+    if (s->size == s->slots)
+    {
+        int slots = s->slots * 2;
+        struct entry *ring = (struct entry *)malloc(slots * sizeof(struct entry));
+        if (!ring)
+        {
+            return -1;
+        }
+        for (int i = 0; i < s->size; i++)
+        {
+            ring[i] = s->ring[(s->head + i) % s->slots];
+        }
+        free(s->ring);
+        s->ring = ring;
+        s->slots = slots;
+        s->head = 0;
+    }
+
+    s->ring[(s->head + s->size) % s->slots] = e;
+    if (s->size++ == 0)
+    {
+        __atomic_store_n(&s->top, e.stamp, __ATOMIC_RELEASE);
+    }
+    return 0;
+}
+
+/**
+ * @brief Removes the head of an internal queue. Caller holds s->lock and
+ * has checked that the queue is not empty.
+ */
+static void *subqueue_pop(struct subqueue *s)
+{
+    void *data = s->ring[s->head].data;
+    s->head = (s->head + 1) % s->slots;
+    s->size--;
+    uint64_t top = s->size ? s->ring[s->head].stamp : EMPTY_STAMP;
+    __atomic_store_n(&s->top, top, __ATOMIC_RELEASE);
+    return data;
+}
+
+/**
+ * @brief Reserves room for one item, sleeping while the multiqueue is full
+ *
+ * @return false if the multiqueue was shut down
+ */
+static bool reserve_slot(multiqueue_t mq)
+{
+    for (;;)
+    {
+        if (__atomic_load_n(&mq->shutdown, __ATOMIC_ACQUIRE))
+        {
+            return false;
+        }
+        int size = __atomic_load_n(&mq->size, __ATOMIC_RELAXED);
+        if (size < mq->capacity)
+        {
+            if (__atomic_compare_exchange_n(&mq->size, &size, size + 1, false,
+                                            __ATOMIC_SEQ_CST, __ATOMIC_RELAXED))
+            {
+                return true;
+            }
+            continue;
+        }
+
+        pthread_mutex_lock(&mq->sleep);
+        __atomic_add_fetch(&mq->producers_waiting, 1, __ATOMIC_SEQ_CST);
+        while (__atomic_load_n(&mq->size, __ATOMIC_SEQ_CST) >= mq->capacity &&
+               !mq->shutdown)
+        {
+            pthread_cond_wait(&mq->not_full, &mq->sleep);
+        }
+        __atomic_sub_fetch(&mq->producers_waiting, 1, __ATOMIC_SEQ_CST);
+        pthread_mutex_unlock(&mq->sleep);
+    }
+}
+
+int multiqueue_enqueue(multiqueue_t mq, void *data)
+{
+    if (!mq) return -1;
+
+    if (!reserve_slot(mq))
+    {
+        return -1; // Shutdown, the item is not enqueued
+    }
+
+    struct entry e = {clock_now_ns(), data};
+    int failures = 0;
+    for (;;)
+    {
+        struct subqueue *s = &mq->queues[rng_next() % mq->nqueues];
+        if (pthread_mutex_trylock(&s->lock) != 0)
+        {
+            continue; // Busy, pick another one
+        }
+        int rc = subqueue_push(s, e);
+        pthread_mutex_unlock(&s->lock);
+        if (rc == 0)
+        {
+            break;
+        }
+        if (++failures == PUSH_FAILURES)
+        {
+            // Out of memory, hand the reserved slot back and wake anyone
+            // whose decision depended on it
+            perror("Failed to grow multiqueue ring");
+            __atomic_sub_fetch(&mq->size, 1, __ATOMIC_SEQ_CST);
+            pthread_mutex_lock(&mq->sleep);
+            pthread_cond_signal(&mq->not_full);
+            pthread_cond_broadcast(&mq->not_empty);
+            pthread_mutex_unlock(&mq->sleep);
+            return -1;
+        }
+    }
+
+    if (__atomic_load_n(&mq->consumers_waiting, __ATOMIC_SEQ_CST) > 0)
+    {
+        pthread_mutex_lock(&mq->sleep);
+        pthread_cond_signal(&mq->not_empty);
+        pthread_mutex_unlock(&mq->sleep);
+    }
+    return 0;
+}
+
+/**
+ * @brief Tries to pop from the older of two random internal queues,
+ * falling back to a scan of all of them.
+ *
+ * @param out receives the item
+ * @return true if an item was removed
+ */
+static bool try_pop(multiqueue_t mq, void **out)
+{
+    for (int attempt = 0; attempt <= PICK_ATTEMPTS; attempt++)
+    {
+        struct subqueue *s;
+        if (attempt < PICK_ATTEMPTS)
+        {
+            int i = rng_next() % mq->nqueues;
+            int j = rng_next() % (mq->nqueues - 1);
+            if (j >= i) j++;
+            uint64_t ti = __atomic_load_n(&mq->queues[i].top, __ATOMIC_ACQUIRE);
+            uint64_t tj = __atomic_load_n(&mq->queues[j].top, __ATOMIC_ACQUIRE);
+            if (ti == EMPTY_STAMP && tj == EMPTY_STAMP)
+            {
+                continue;
+            }
+            s = &mq->queues[tj < ti ? j : i];
+            if (pthread_mutex_trylock(&s->lock) != 0)
+            {
+                continue;
+            }
+        }
+        else
+        {
+            // Nearly empty, take the oldest head we can find
+            uint64_t best = EMPTY_STAMP;
+            s = NULL;
+            for (int i = 0; i < mq->nqueues; i++)
+            {
+                uint64_t t = __atomic_load_n(&mq->queues[i].top, __ATOMIC_ACQUIRE);
+                if (t < best)
+                {
+                    best = t;
+                    s = &mq->queues[i];
+                }
+            }
+            if (!s)
+            {
+                return false;
+            }
+            pthread_mutex_lock(&s->lock);
+        }
+
+        if (s->size > 0)
+        {
+            *out = subqueue_pop(s);
+            pthread_mutex_unlock(&s->lock);
+            return true;
+        }
+        pthread_mutex_unlock(&s->lock);
+    }
+    return false;
+}
+
+void *multiqueue_dequeue(multiqueue_t mq)
+{
+    if (!mq) return NULL;
+
+    void *data = NULL;
+    for (;;)
+    {
+        if (__atomic_load_n(&mq->size, __ATOMIC_SEQ_CST) > 0)
+        {
+            if (try_pop(mq, &data))
+            {
+                break;
+            }
+            // A producer reserved a slot but has not pushed yet
+            sched_yield();
+            continue;
+        }
+
+        pthread_mutex_lock(&mq->sleep);
+        __atomic_add_fetch(&mq->consumers_waiting, 1, __ATOMIC_SEQ_CST);
+        while (__atomic_load_n(&mq->size, __ATOMIC_SEQ_CST) == 0 && !mq->shutdown)
+        {
+            pthread_cond_wait(&mq->not_empty, &mq->sleep);
+        }
+        __atomic_sub_fetch(&mq->consumers_waiting, 1, __ATOMIC_SEQ_CST);
+        bool done = mq->shutdown && __atomic_load_n(&mq->size, __ATOMIC_SEQ_CST) == 0;
+        pthread_mutex_unlock(&mq->sleep);
+        if (done)
+        {
+            return NULL;
+        }
+    }
+
+    __atomic_sub_fetch(&mq->size, 1, __ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&mq->producers_waiting, __ATOMIC_SEQ_CST) > 0)
+    {
+        pthread_mutex_lock(&mq->sleep);
+        pthread_cond_signal(&mq->not_full);
+        pthread_mutex_unlock(&mq->sleep);
+    }
+    return data;
+}
+
+void multiqueue_shutdown(multiqueue_t mq)
+{
+    if (!mq) return;
+
+    pthread_mutex_lock(&mq->sleep);
+    __atomic_store_n(&mq->shutdown, true, __ATOMIC_RELEASE);
+    pthread_cond_broadcast(&mq->not_full);
+    pthread_cond_broadcast(&mq->not_empty);
+    pthread_mutex_unlock(&mq->sleep);
+}
+
+int multiqueue_size(multiqueue_t mq)
+{
+    if (!mq) return 0;
+    return __atomic_load_n(&mq->size, __ATOMIC_RELAXED);
+}
+
+bool multiqueue_is_empty(multiqueue_t mq)
+{
+    return multiqueue_size(mq) == 0;
+}
+
+bool multiqueue_is_shutdown(multiqueue_t mq)
+{
+    if (!mq) return true;
+    return __atomic_load_n(&mq->shutdown, __ATOMIC_ACQUIRE);
+}
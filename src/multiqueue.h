@@ -0,0 +1,98 @@
+#ifndef MULTIQUEUE_H
+#define MULTIQUEUE_H
+#include <stdlib.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+    /**
+     * @brief opaque type definition for a relaxed FIFO multiqueue
+     *
+     * A multiqueue spreads items over k * nthreads internal FIFO queues, each
+     * with its own lock. Enqueue stamps the item and appends it to a random
+     * internal queue. Dequeue looks at the heads of two random internal
+     * queues and removes the older one. Threads rarely touch the same lock,
+     * so throughput scales with the number of threads.
+     *
+     * Ordering is relaxed: an item may be returned while older items are
+     * still queued. With n = k * nthreads internal queues the expected rank
+     * error (the number of older items still present when an item is
+     * returned) is O(n), and O(n log n) with high probability. See Alistarh
+     * et al., "The Power of Choice in Priority Scheduling", PODC 2017. Items
+     * enqueued by the same thread into the same internal queue keep their
+     * order, nothing else is guaranteed.
+     */
+    typedef struct multiqueue *multiqueue_t;
+
+    /**
+     * @brief Initialize a new multiqueue
+     *
+     * @param capacity the maximum number of items across all internal queues
+     * @param nthreads expected number of threads using the queue
+     * @param k internal queues per thread, 2 is a good default
+     * @return A fully initialized multiqueue, or NULL on error
+     */
+    multiqueue_t multiqueue_init(int capacity, int nthreads, int k);
+
+    /**
+     * @brief Frees all memory, items still queued are dropped
+     *
+     * @param mq the multiqueue
+     */
+    void multiqueue_destroy(multiqueue_t mq);
+
+    /**
+     * @brief Adds an element, blocking while the multiqueue is full.
+     * Does nothing after shutdown.
+     *
+     * @param mq the multiqueue
+     * @param data the data to add
+     * @return 0 if the element was added, -1 if the multiqueue was shut down
+     * or an internal queue could not grow
+     */
+    int multiqueue_enqueue(multiqueue_t mq, void *data);
+
+    /**
+     * @brief Removes an approximately oldest element, blocking while empty
+     *
+     * @param mq the multiqueue
+     * @return the data, or NULL if the multiqueue was shutdown and is empty
+     */
+    void *multiqueue_dequeue(multiqueue_t mq);
+
+    /**
+     * @brief Set the shutdown flag and wake all waiting threads
+     *
+     * @param mq the multiqueue
+     */
+    void multiqueue_shutdown(multiqueue_t mq);
+
+    /**
+     * @brief Returns the number of items, without locking
+     *
+     * @param mq the multiqueue
+     */
+    int multiqueue_size(multiqueue_t mq);
+
+    /**
+     * @brief Returns true if the multiqueue is empty
+     *
+     * @param mq the multiqueue
+     */
+    bool multiqueue_is_empty(multiqueue_t mq);
+
+    /**
+     * @brief Returns true if the multiqueue is in shutdown mode
+     *
+     * @param mq the multiqueue
+     */
+    bool multiqueue_is_shutdown(multiqueue_t mq);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
+
+#endif
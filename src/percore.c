@@ -0,0 +1,313 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <pthread.h>
+#include <sched.h>
+#include "percore.h"
+
+#define PERCORE_SPINS_BEFORE_YIELD 256 // Empty polls before giving up the CPU
+
+/**
+ * @brief Single-producer single-consumer ring. Each side keeps its own index
+ * on its own cache line plus a cached copy of the other side's index, so the
+ * shared line is only read when the cached copy says full or empty.
+ */
+struct spsc
+{
+    uint64_t head __attribute__((aligned(64))); // Next slot to read, consumer only
+    uint64_t tail_cache;                        // Consumer's copy of tail
+    uint64_t tail __attribute__((aligned(64))); // Next slot to write, producer only
+    uint64_t head_cache;                        // Producer's copy of head
+    void **slots;
+    uint64_t mask;
+};
+
+/**
+ * @brief Message counters of one core, written only by that core
+ */
+struct core_count
+{
+    uint64_t sent __attribute__((aligned(64))); // Counted before the push
+    uint64_t delivered;                         // Counted after the handler
+};
+
+/**
+ * @brief The internal structure for the runtime.
+ */
+struct percore
+{
+    int ncores;
+    struct spsc *rings;          // rings[to * ncores + from]
+    struct core_count *counts;   // counts[core]
+    int *cpus;                   // CPU per core, NULL when unpinned
+    percore_handler_fn handler;
+    void *ctx;
+    percore_main_fn main;        // Set for the duration of percore_run
+    void *main_ctx;
+    int finished;                // Workers whose main has returned
+};
+
+struct worker_arg
+{
+    percore_t p;
+    int self;
+};
+
+static inline struct spsc *ring_at(percore_t p, int from, int to)
+{
+    return &p->rings[to * p->ncores + from];
+}
+
+static bool spsc_push(struct spsc *r, void *msg)
+{
+    if (r->tail - r->head_cache > r->mask)
+    {
+        r->head_cache = __atomic_load_n(&r->head, __ATOMIC_ACQUIRE);
+        if (r->tail - r->head_cache > r->mask)
+        {
+            return false;
+        }
+    }
+    r->slots[r->tail & r->mask] = msg;
+    __atomic_store_n(&r->tail, r->tail + 1, __ATOMIC_RELEASE);
+    return true;
+}
+
+/**
+ * @brief Takes up to max messages, returning how many were written to out
+ */
+static int spsc_pop(struct spsc *r, void **out, int max)
+{
+    if (r->head == r->tail_cache)
+    {
+        r->tail_cache = __atomic_load_n(&r->tail, __ATOMIC_ACQUIRE);
+        if (r->head == r->tail_cache)
+        {
+            return 0;
+        }
+    }
+    uint64_t avail = r->tail_cache - r->head;
+    int n = avail < (uint64_t)max ? (int)avail : max;
+    for (int i = 0; i < n; i++)
+    {
+        out[i] = r->slots[(r->head + i) & r->mask];
+    }
+    __atomic_store_n(&r->head, r->head + n, __ATOMIC_RELEASE);
+    return n;
+}
+
+percore_t percore_init(int ncores, int ring_size, const int *cpus,
+                       percore_handler_fn handler, void *ctx)
+{
+    if (ncores <= 0 || ring_size <= 0 || !handler)
+    {
+        fprintf(stderr, "Error: Invalid per-core runtime arguments.\n");
+        return NULL;
+    }
+
+    percore_t p = (percore_t)calloc(1, sizeof(struct percore));
+    if (!p)
+    {
+        perror("Failed to allocate per-core runtime");
+        return NULL;
+    }
+    uint64_t size = 1;
+    while (size < (uint64_t)ring_size)
+    {
+        size <<= 1;
+    }
+
+    p->ncores = ncores;
+    p->handler = handler;
+    p->ctx = ctx;
+    p->rings = (struct spsc *)aligned_alloc(64, (size_t)ncores * ncores * sizeof(struct spsc));
+    if (!p->rings)
+    {
+        perror("Failed to allocate per-core rings");
+        free(p);
+        return NULL;
+    }
+    memset(p->rings, 0, (size_t)ncores * ncores * sizeof(struct spsc));
+    p->counts = (struct core_count *)aligned_alloc(64, ncores * sizeof(struct core_count));
+    if (!p->counts)
+    {
+        perror("Failed to allocate per-core counters");
+        percore_destroy(p);
+        return NULL;
+    }
+    memset(p->counts, 0, ncores * sizeof(struct core_count));
+    for (int i = 0; i < ncores * ncores; i++)
+    {
+        // Rings from a core to itself are never used
+        if (i / ncores == i % ncores)
+        {
+            continue;
+        }
+        p->rings[i].mask = size - 1;
+        p->rings[i].slots = (void **)malloc(size * sizeof(void *));
+        if (!p->rings[i].slots)
+        {
+            perror("Failed to allocate per-core ring slots");
+            percore_destroy(p);
+            return NULL;
+        }
+    }
+    if (cpus)
+    {
+        p->cpus = (int *)malloc(ncores * sizeof(int));
+        if (!p->cpus)
+        {
+            perror("Failed to allocate per-core CPU list");
+            percore_destroy(p);
+            return NULL;
+        }
+        memcpy(p->cpus, cpus, ncores * sizeof(int));
+    }
+    return p;
+}
+
+void percore_destroy(percore_t p)
+{
+    if (!p) return;
+
+    for (int i = 0; i < p->ncores * p->ncores; i++)
+    {
+        free(p->rings[i].slots);
+    }
+    free(p->rings);
+    free(p->counts);
+    free(p->cpus);
+    free(p);
+}
+
+int percore_count(percore_t p)
+{
+    return p ? p->ncores : 0;
+}
+
+int percore_poll(percore_t p, int self, int max)
+{
+    void *msgs[max > 0 ? max : 1];
+    int total = 0;
+    for (int from = 0; from < p->ncores; from++)
+    {
+        if (from == self)
+        {
+            continue;
+        }
+        int n = spsc_pop(ring_at(p, from, self), msgs, max);
+        for (int i = 0; i < n; i++)
+        {
+            p->handler(p, self, from, msgs[i], p->ctx);
+        }
+        total += n;
+    }
+    if (total > 0)
+    {
+        struct core_count *c = &p->counts[self];
+        __atomic_store_n(&c->delivered, c->delivered + total, __ATOMIC_RELEASE);
+    }
+    return total;
+}
+
+void percore_send(percore_t p, int from, int to, void *msg)
+{
+    struct spsc *r = ring_at(p, from, to);
+    struct core_count *c = &p->counts[from];
+    int idle = 0;
+    __atomic_store_n(&c->sent, c->sent + 1, __ATOMIC_RELEASE);
+    while (!spsc_push(r, msg))
+    {
+        // Keep our own inbound rings moving so the receiver can make room
+        if (percore_poll(p, from, 16) == 0 && ++idle % PERCORE_SPINS_BEFORE_YIELD == 0)
+        {
+            sched_yield();
+        }
+    }
+}
+
+/**
+ * @brief Returns true if no message was in flight at some instant during
+ * the call. All delivered counts are read before any sent count; since a
+ * message is counted as sent before it is pushed and as delivered only after
+ * its handler (and any sends it made) returned, equal sums mean that when
+ * the last delivered count was read nothing was queued or being handled.
+ */
+static bool quiescent(percore_t p)
+{
+    uint64_t delivered = 0, sent = 0;
+    for (int i = 0; i < p->ncores; i++)
+    {
+        delivered += __atomic_load_n(&p->counts[i].delivered, __ATOMIC_ACQUIRE);
+    }
+    for (int i = 0; i < p->ncores; i++)
+    {
+        sent += __atomic_load_n(&p->counts[i].sent, __ATOMIC_ACQUIRE);
+    }
+    return sent == delivered;
+}
+
+static void *worker(void *arg)
+{
+    struct worker_arg *a = (struct worker_arg *)arg;
+    percore_t p = a->p;
+    if (p->cpus)
+    {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(p->cpus[a->self], &set);
+        if (pthread_setaffinity_np(pthread_self(), sizeof(set), &set) != 0)
+        {
+            fprintf(stderr, "Warning: Could not pin core %d to CPU %d.\n", a->self, p->cpus[a->self]);
+        }
+    }
+
+    p->main(p, a->self, p->main_ctx);
+    __atomic_fetch_add(&p->finished, 1, __ATOMIC_ACQ_REL);
+
+    // Other cores and handlers may still be sending, deliver until every
+    // main has returned and no message is left anywhere
+    int idle = 0;
+    while (__atomic_load_n(&p->finished, __ATOMIC_ACQUIRE) < p->ncores || !quiescent(p))
+    {
+        if (percore_poll(p, a->self, 64) == 0 && ++idle % PERCORE_SPINS_BEFORE_YIELD == 0)
+        {
+            sched_yield();
+        }
+    }
+    return NULL;
+}
+
+int percore_run(percore_t p, percore_main_fn main, void *ctx)
+{
+    if (!p || !main) return -1;
+
+    pthread_t threads[p->ncores];
+    struct worker_arg args[p->ncores];
+    p->main = main;
+    p->main_ctx = ctx;
+    p->finished = 0;
+
+    int started = 0;
+    for (; started < p->ncores; started++)
+    {
+        args[started] = (struct worker_arg){p, started};
+        if (pthread_create(&threads[started], NULL, worker, &args[started]) != 0)
+        {
+            perror("Failed to start per-core worker");
+            break;
+        }
+    }
+    if (started < p->ncores)
+    {
+        // Count the missing workers as finished so the others can exit
+        __atomic_fetch_add(&p->finished, p->ncores - started, __ATOMIC_ACQ_REL);
+    }
+    for (int i = 0; i < started; i++)
+    {
+        pthread_join(threads[i], NULL);
+    }
+    return started == p->ncores ? 0 : -1;
+}
@@ -0,0 +1,101 @@
+#ifndef PERCORE_H
+#define PERCORE_H
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+    /**
+     * @brief opaque type definition for a thread-per-core runtime
+     *
+     * The runtime runs one worker thread per core, each optionally pinned.
+     * Cores share nothing but a mesh of single-producer single-consumer rings,
+     * one for every ordered pair of cores. A message from core a to core b
+     * goes through ring (a, b), so no ring ever has two writers or two readers
+     * and no locks or read-modify-write atomics are needed. Each core polls
+     * its inbound rings itself, in batches.
+     */
+    typedef struct percore *percore_t;
+
+    /**
+     * @brief Handles one message on the core it was sent to. The handler may
+     * send messages itself.
+     */
+    typedef void (*percore_handler_fn)(percore_t p, int self, int from, void *msg, void *ctx);
+
+    /**
+     * @brief Body of a worker, run once on each core by percore_run(). It
+     * must call percore_poll() often enough to keep its inbound rings moving.
+     */
+    typedef void (*percore_main_fn)(percore_t p, int self, void *ctx);
+
+    /**
+     * @brief Create the runtime. No threads start until percore_run().
+     *
+     * @param ncores number of workers
+     * @param ring_size slots per ring, rounded up to a power of two
+     * @param cpus CPU to pin each worker to, NULL leaves them unpinned
+     * @param handler called for every delivered message
+     * @param ctx passed to the handler
+     * @return a new runtime, or NULL on error
+     */
+    percore_t percore_init(int ncores, int ring_size, const int *cpus,
+                           percore_handler_fn handler, void *ctx);
+
+    /**
+     * @brief Frees the runtime and its rings. Messages still in flight are
+     * dropped.
+     *
+     * @param p the runtime
+     */
+    void percore_destroy(percore_t p);
+
+    /**
+     * @brief Starts one worker per core, runs main on each and waits until
+     * all of them have returned. Workers keep delivering messages until every
+     * main has returned and every ring is empty.
+     *
+     * @param p the runtime
+     * @param main body run on each core
+     * @param ctx passed to main
+     * @return 0 on success, -1 if a worker could not be started
+     */
+    int percore_run(percore_t p, percore_main_fn main, void *ctx);
+
+    /**
+     * @brief Sends a message to another core. Must be called on core from.
+     * While ring (from, to) is full the sender polls its own inbound rings,
+     * so two cores sending to each other cannot deadlock.
+     *
+     * @param p the runtime
+     * @param from the calling core
+     * @param to destination core, not from
+     * @param msg the message, any non-NULL pointer
+     */
+    void percore_send(percore_t p, int from, int to, void *msg);
+
+    /**
+     * @brief Delivers up to max messages from each inbound ring of the
+     * calling core to the handler
+     *
+     * @param p the runtime
+     * @param self the calling core
+     * @param max most messages taken from each ring
+     * @return number of messages delivered
+     */
+    int percore_poll(percore_t p, int self, int max);
+
+    /**
+     * @brief Returns the number of cores
+     *
+     * @param p the runtime
+     */
+    int percore_count(percore_t p);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
+
+#endif
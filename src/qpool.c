@@ -0,0 +1,220 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include "qpool.h"
+
+/**
+ * @brief Idle queues owned by one thread. Only the owner touches items and
+ * count; next and prev link the cache into its pool's list under p->mutex.
+ */
+struct pool_cache
+{
+    queue_pool_t pool;
+    int count;
+    queue_t items[QUEUE_POOL_CACHE];
+    struct pool_cache *next;
+    struct pool_cache *prev;
+};
+
+/**
+ * @brief The internal structure for a queue pool.
+ */
+struct queue_pool
+{
+    int capacity;              // Capacity of every queue
+    int max_idle;              // Most queues kept in shared
+    pthread_mutex_t mutex;     // Guards shared, nshared and caches
+    queue_t *shared;           // Idle queues not in any cache
+    int nshared;
+    pthread_key_t key;         // Finds the calling thread's cache
+    struct pool_cache *caches; // Every thread's cache, for queue_pool_destroy
+};
+
+/**
+ * @brief Moves up to n queues from a cache to the shared list, destroying
+ * what does not fit under max_idle.
+ */
+static void cache_spill(struct pool_cache *c, int n)
+{
+    queue_pool_t p = c->pool;
+    queue_t extra[QUEUE_POOL_CACHE];
+    int nextra = 0;
+
+    pthread_mutex_lock(&p->mutex);
+    while (n-- > 0 && c->count > 0)
+    {
+        queue_t q = c->items[--c->count];
+        if (p->nshared < p->max_idle)
+        {
+            p->shared[p->nshared++] = q;
+        }
+        else
+        {
+            extra[nextra++] = q;
+        }
+    }
+    pthread_mutex_unlock(&p->mutex);
+
+    for (int i = 0; i < nextra; i++)
+    {
+        queue_destroy(extra[i]);
+    }
+}
+
+/**
+ * @brief pthread key destructor, hands a finished thread's queues back to
+ * the shared list.
+ */
+static void cache_release(void *arg)
+{
+    struct pool_cache *c = (struct pool_cache *)arg;
+    queue_pool_t p = c->pool;
+    cache_spill(c, c->count);
+
+    pthread_mutex_lock(&p->mutex);
+    if (c->prev) c->prev->next = c->next;
+    else p->caches = c->next;
+    if (c->next) c->next->prev = c->prev;
+    pthread_mutex_unlock(&p->mutex);
+    free(c);
+}
+
+static struct pool_cache *cache_get(queue_pool_t p)
+{
+    struct pool_cache *c = (struct pool_cache *)pthread_getspecific(p->key);
+    if (c)
+    {
+        return c;
+    }
+
+    c = (struct pool_cache *)calloc(1, sizeof(struct pool_cache));
+    if (!c)
+    {
+        perror("Failed to allocate queue pool cache");
+        return NULL;
+    }
+    c->pool = p;
+    pthread_mutex_lock(&p->mutex);
+    c->next = p->caches;
+    if (c->next) c->next->prev = c;
+    p->caches = c;
+    pthread_mutex_unlock(&p->mutex);
+    pthread_setspecific(p->key, c);
+    return c;
+}
+
+queue_pool_t queue_pool_init(int capacity, int max_idle)
+{
+    if (capacity <= 0 || max_idle < 0)
+    {
+        fprintf(stderr, "Error: Invalid queue pool arguments.\n");
+        return NULL;
+    }
+
+    queue_pool_t p = (queue_pool_t)calloc(1, sizeof(struct queue_pool));
+    if (!p)
+    {
+        perror("Failed to allocate queue pool");
+        return NULL;
+    }
+    p->shared = (queue_t *)malloc((max_idle > 0 ? max_idle : 1) * sizeof(queue_t));
+    if (!p->shared)
+    {
+        perror("Failed to allocate queue pool list");
+        free(p);
+        return NULL;
+    }
+    if (pthread_key_create(&p->key, cache_release) != 0)
+    {
+        fprintf(stderr, "Error: Failed to create queue pool key.\n");
+        free(p->shared);
+        free(p);
+        return NULL;
+    }
+    p->capacity = capacity;
+    p->max_idle = max_idle;
+    pthread_mutex_init(&p->mutex, NULL);
+    return p;
+}
+
+void queue_pool_destroy(queue_pool_t p)
+{
+    if (!p) return;
+
+    // Deleting the key first means no thread exit runs cache_release later
+    pthread_key_delete(p->key);
+    while (p->caches)
+    {
+        struct pool_cache *c = p->caches;
+        p->caches = c->next;
+        for (int i = 0; i < c->count; i++)
+        {
+            queue_destroy(c->items[i]);
+        }
+        free(c);
+    }
+    for (int i = 0; i < p->nshared; i++)
+    {
+        queue_destroy(p->shared[i]);
+    }
+    pthread_mutex_destroy(&p->mutex);
+    free(p->shared);
+    free(p);
+}
+
+queue_t queue_pool_get(queue_pool_t p)
+{
+    if (!p) return NULL;
+
+    struct pool_cache *c = cache_get(p);
+    if (c && c->count > 0)
+    {
+        return c->items[--c->count];
+    }
+
+    if (c)
+    {
+        // Refill half the cache with one trip to the shared list
+        pthread_mutex_lock(&p->mutex);
+        while (p->nshared > 0 && c->count < QUEUE_POOL_CACHE / 2)
+        {
+            c->items[c->count++] = p->shared[--p->nshared];
+        }
+        pthread_mutex_unlock(&p->mutex);
+        if (c->count > 0)
+        {
+            return c->items[--c->count];
+        }
+    }
+    return queue_init(p->capacity);
+}
+
+int queue_pool_put(queue_pool_t p, queue_t q)
+{
+    if (!p || !q) return -1;
+
+    // A queue with blocked threads stays with the caller, destroying it
+    // would free it under them
+    if (queue_reset(q) != 0)
+    {
+        return -1;
+    }
+    if (queue_capacity(q) != p->capacity)
+    {
+        queue_destroy(q);
+        return 0;
+    }
+
+    struct pool_cache *c = cache_get(p);
+    if (!c)
+    {
+        queue_destroy(q);
+        return 0;
+    }
+    if (c->count == QUEUE_POOL_CACHE)
+    {
+        cache_spill(c, QUEUE_POOL_CACHE / 2);
+    }
+    c->items[c->count++] = q;
+    return 0;
+}
@@ -0,0 +1,70 @@
+#ifndef QPOOL_H
+#define QPOOL_H
+#include "lab.h"
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+/**
+ * @brief Queues each thread keeps for itself before handing extras to the
+ * shared list
+ */
+#define QUEUE_POOL_CACHE 8
+
+    /**
+     * @brief opaque type definition for a pool of same-capacity queues
+     *
+     * Getting and putting a queue normally touches only the calling thread's
+     * cache. The shared list, under a lock, is used only when a cache runs
+     * empty or overflows. A queue put back is recycled with queue_reset(),
+     * so its buffer, mutex and condition variables are reused as they are.
+     */
+    typedef struct queue_pool *queue_pool_t;
+
+    /**
+     * @brief Create a pool of queues
+     *
+     * @param capacity capacity of every queue in the pool
+     * @param max_idle most idle queues kept in the shared list, the rest are
+     * destroyed
+     * @return a new pool, or NULL on error
+     */
+    queue_pool_t queue_pool_init(int capacity, int max_idle);
+
+    /**
+     * @brief Frees the pool and every idle queue it holds, including those
+     * in other threads' caches. No thread may be using the pool, and queues
+     * still checked out must be destroyed by their owners.
+     *
+     * @param p the pool
+     */
+    void queue_pool_destroy(queue_pool_t p);
+
+    /**
+     * @brief Takes an empty, running queue from the pool, creating one if the
+     * pool has none
+     *
+     * @param p the pool
+     * @return a queue, or NULL on error
+     */
+    queue_t queue_pool_get(queue_pool_t p);
+
+    /**
+     * @brief Returns a queue to the pool. The queue must be quiesced: every
+     * other thread has returned from it. Items still in it are dropped, and
+     * queues of another capacity are destroyed instead of pooled.
+     *
+     * @param p the pool
+     * @param q a queue from queue_pool_get()
+     * @return 0 if the pool took the queue, -1 if threads are still blocked
+     * on it, in which case it stays with the caller
+     */
+    int queue_pool_put(queue_pool_t p, queue_t q);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
+
+#endif
@@ -0,0 +1,206 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <pthread.h>
+#include "rpc.h"
+#include "subscribe.h"
+
+#define RPC_SPINS 200 // Checks of a reply slot before the caller sleeps on it
+
+/**
+ * @brief A reply slot. done and sleeping are the only fields both sides
+ * touch; the caller sleeps on ready only after announcing it in sleeping.
+ */
+struct rpc_call
+{
+    void *request;
+    void *reply;
+    int done;              // Set by the worker once reply is written
+    int sleeping;          // Set by a caller about to wait on ready
+    pthread_mutex_t mutex; // Guards sleeping on ready
+    pthread_cond_t ready;  // Signalled when done is set for a sleeper
+} __attribute__((aligned(64)));
+
+/**
+ * @brief The internal structure for an RPC channel.
+ */
+struct rpc
+{
+    queue_t requests;      // Calls waiting for a worker
+    queue_t free;          // Reply slots not in use
+    struct rpc_call *calls;
+    int ncalls;
+    rpc_handler_fn handler;
+    void *ctx;
+    subscription_t workers;
+};
+
+static void complete(struct rpc_call *c, void *reply)
+{
+    c->reply = reply;
+    // Pairs with the sleeping flag in rpc_wait: either the caller sees done
+    // or we see that it sleeps
+    __atomic_store_n(&c->done, 1, __ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&c->sleeping, __ATOMIC_SEQ_CST))
+    {
+        pthread_mutex_lock(&c->mutex);
+        pthread_cond_signal(&c->ready);
+        pthread_mutex_unlock(&c->mutex);
+    }
+}
+
+static void serve(void **items, int n, void *ctx)
+{
+    rpc_t r = (rpc_t)ctx;
+    for (int i = 0; i < n; i++)
+    {
+        struct rpc_call *c = (struct rpc_call *)items[i];
+        complete(c, r->handler(c->request, r->ctx));
+    }
+}
+
+rpc_t rpc_init(int capacity, int max_outstanding, rpc_handler_fn handler, void *ctx,
+               int nworkers, int max_batch)
+{
+    if (capacity <= 0 || max_outstanding <= 0 || !handler || nworkers <= 0 || max_batch <= 0)
+    {
+        fprintf(stderr, "Error: Invalid RPC channel arguments.\n");
+        return NULL;
+    }
+
+    rpc_t r = (rpc_t)calloc(1, sizeof(struct rpc));
+    if (!r)
+    {
+        perror("Failed to allocate RPC channel");
+        return NULL;
+    }
+    r->handler = handler;
+    r->ctx = ctx;
+    r->requests = queue_init(capacity);
+    r->free = queue_init(max_outstanding);
+    r->calls = (struct rpc_call *)aligned_alloc(64, max_outstanding * sizeof(struct rpc_call));
+    if (!r->requests || !r->free || !r->calls)
+    {
+        perror("Failed to allocate RPC channel");
+        rpc_destroy(r);
+        return NULL;
+    }
+    for (int i = 0; i < max_outstanding; i++)
+    {
+        struct rpc_call *c = &r->calls[i];
+        c->done = 0;
+        c->sleeping = 0;
+        pthread_mutex_init(&c->mutex, NULL);
+        pthread_cond_init(&c->ready, NULL);
+        r->ncalls++;
+        enqueue(r->free, c);
+    }
+
+    r->workers = queue_subscribe(r->requests, serve, r, max_batch, nworkers);
+    if (!r->workers)
+    {
+        rpc_destroy(r);
+        return NULL;
+    }
+    return r;
+}
+
+void rpc_destroy(rpc_t r)
+{
+    if (!r) return;
+
+    queue_unsubscribe(r->workers);
+    for (int i = 0; i < r->ncalls; i++)
+    {
+        pthread_mutex_destroy(&r->calls[i].mutex);
+        pthread_cond_destroy(&r->calls[i].ready);
+    }
+    free(r->calls);
+    queue_destroy(r->requests);
+    queue_destroy(r->free);
+    free(r);
+}
+
+rpc_call_t rpc_send(rpc_t r, void *request)
+{
+    if (!r) return NULL;
+
+    struct rpc_call *c = (struct rpc_call *)dequeue(r->free);
+    if (!c)
+    {
+        return NULL;
+    }
+    c->request = request;
+    enqueue(r->requests, c);
+    return c;
+}
+
+void *rpc_wait(rpc_t r, rpc_call_t c)
+{
+    if (!r || !c) return NULL;
+
+    for (int i = 0; i < RPC_SPINS && !__atomic_load_n(&c->done, __ATOMIC_ACQUIRE); i++)
+    {
+#if defined(__x86_64__) || defined(__i386__)
+        __builtin_ia32_pause();
+#endif
+    }
+    if (!__atomic_load_n(&c->done, __ATOMIC_ACQUIRE))
+    {
+        pthread_mutex_lock(&c->mutex);
+        __atomic_store_n(&c->sleeping, 1, __ATOMIC_SEQ_CST);
+        while (!__atomic_load_n(&c->done, __ATOMIC_SEQ_CST))
+        {
+            pthread_cond_wait(&c->ready, &c->mutex);
+        }
+        c->sleeping = 0;
+        pthread_mutex_unlock(&c->mutex);
+    }
+
+    void *reply = c->reply;
+    c->done = 0;
+    enqueue(r->free, c);
+    return reply;
+}
+
+void *rpc_call(rpc_t r, void *request)
+{
+    return rpc_wait(r, rpc_send(r, request));
+}
+
+int rpc_call_batch(rpc_t r, void **requests, void **replies, int n)
+{
+    if (!r || !requests || !replies || n < 0) return -1;
+
+    void *calls[r->ncalls];
+    for (int done = 0; done < n;)
+    {
+        int want = n - done < r->ncalls ? n - done : r->ncalls;
+        int got = dequeue_batch(r->free, calls, want);
+        if (got == 0)
+        {
+            return done;
+        }
+        for (int i = 0; i < got; i++)
+        {
+            ((struct rpc_call *)calls[i])->request = requests[done + i];
+        }
+        // Short only if the channel is shutting down; the calls that made it
+        // in are still served
+        int sent = enqueue_batch(r->requests, calls, got);
+        if (sent < got)
+        {
+            enqueue_batch(r->free, calls + sent, got - sent);
+        }
+        for (int i = 0; i < sent; i++)
+        {
+            replies[done + i] = rpc_wait(r, (rpc_call_t)calls[i]);
+        }
+        done += sent;
+        if (sent < got)
+        {
+            return done;
+        }
+    }
+    return n;
+}
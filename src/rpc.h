@@ -0,0 +1,100 @@
+#ifndef RPC_H
+#define RPC_H
+#include "lab.h"
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+    /**
+     * @brief opaque type definition for an in-process RPC channel
+     *
+     * Requests travel to worker threads over a queue_t. Each request carries
+     * one of a fixed set of preallocated reply slots, and the caller waits on
+     * that slot directly, so replies need no shared queue and no
+     * demultiplexing. A caller may have many calls in flight at once and
+     * collect the replies in any order.
+     */
+    typedef struct rpc *rpc_t;
+
+    /**
+     * @brief A call in flight, the handle for its reply slot
+     */
+    typedef struct rpc_call *rpc_call_t;
+
+    /**
+     * @brief Serves one request on a worker thread and returns the reply
+     */
+    typedef void *(*rpc_handler_fn)(void *request, void *ctx);
+
+    /**
+     * @brief Create a channel and start its workers
+     *
+     * @param capacity capacity of the request queue
+     * @param max_outstanding number of reply slots, the most calls in flight
+     * @param handler serves each request
+     * @param ctx passed to the handler
+     * @param nworkers number of worker threads
+     * @param max_batch most requests a worker takes per dequeue
+     * @return a new channel, or NULL on error
+     */
+    rpc_t rpc_init(int capacity, int max_outstanding, rpc_handler_fn handler, void *ctx,
+                   int nworkers, int max_batch);
+
+    /**
+     * @brief Serves the requests already sent, stops the workers and frees the
+     * channel. Calls that were never waited on are lost.
+     *
+     * @param r the channel
+     */
+    void rpc_destroy(rpc_t r);
+
+    /**
+     * @brief Sends a request without waiting for the reply. Blocks while all
+     * reply slots are in use.
+     *
+     * @param r the channel
+     * @param request passed to the handler
+     * @return the call, to be passed to rpc_wait() exactly once
+     */
+    rpc_call_t rpc_send(rpc_t r, void *request);
+
+    /**
+     * @brief Waits for the reply to a call and releases its slot
+     *
+     * @param r the channel
+     * @param c a call from rpc_send()
+     * @return the handler's reply
+     */
+    void *rpc_wait(rpc_t r, rpc_call_t c);
+
+    /**
+     * @brief Sends a request and waits for its reply
+     *
+     * @param r the channel
+     * @param request passed to the handler
+     * @return the handler's reply
+     */
+    void *rpc_call(rpc_t r, void *request);
+
+    /**
+     * @brief Sends n requests and waits for all the replies. Requests are
+     * sent with enqueue_batch() in groups of up to max_outstanding. If the
+     * channel shuts down part way, the requests already sent are still
+     * waited for and the rest are not sent.
+     *
+     * @param r the channel
+     * @param requests the requests
+     * @param replies receives the reply to requests[i] in replies[i]
+     * @param n number of requests
+     * @return number of requests completed, n unless the channel shut down,
+     * or -1 on error
+     */
+    int rpc_call_batch(rpc_t r, void **requests, void **replies, int n);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
+
+#endif
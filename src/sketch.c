@@ -0,0 +1,251 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include "sketch.h"
+
+/**
+ * @brief A space-saving slot: a tracked key and its estimate
+ */
+struct top_slot
+{
+    uint64_t key;
+    uint64_t count;
+};
+
+/**
+ * @brief One window pane, a count-min table and its heavy hitters
+ */
+struct pane
+{
+    uint32_t counts[SKETCH_DEPTH][SKETCH_WIDTH];
+    struct top_slot top[SKETCH_MAX_TOP];
+    int ntop;
+    int min_slot; // Slot with the smallest count once the table is full
+};
+
+/**
+ * @brief The internal structure for a sketch.
+ */
+struct sketch
+{
+    struct pane panes[2];
+    struct pane *cur;
+    struct pane *prev;
+    int k;
+    uint64_t window_ns;
+    uint64_t pane_start; // When cur started
+    uint64_t created;    // Before one full window the rate uses the time so far
+};
+
+static void pane_clear(struct pane *p)
+{
+    memset(p->counts, 0, sizeof(p->counts));
+    p->ntop = 0;
+    p->min_slot = 0;
+}
+
+sketch_t sketch_init(int k, uint64_t window_ns, uint64_t now)
+{
+    if (k <= 0 || k > SKETCH_MAX_TOP || window_ns == 0)
+    {
+        fprintf(stderr, "Error: Invalid sketch arguments.\n");
+        return NULL;
+    }
+
+    sketch_t s = (sketch_t)malloc(sizeof(struct sketch));
+    if (!s)
+    {
+        perror("Failed to allocate sketch");
+        return NULL;
+    }
+    pane_clear(&s->panes[0]);
+    pane_clear(&s->panes[1]);
+    s->cur = &s->panes[0];
+    s->prev = &s->panes[1];
+    s->k = k;
+    s->window_ns = window_ns;
+    s->pane_start = now;
+    s->created = now;
+    return s;
+}
+
+void sketch_destroy(sketch_t s)
+{
+    free(s);
+}
+
+/**
+ * @brief Counter index of a key in each row, by double hashing one 64-bit
+ * mix (splitmix64's finalizer)
+ */
+static void key_slots(uint64_t key, uint32_t idx[SKETCH_DEPTH])
+{
+    uint64_t h = key + 0x9e3779b97f4a7c15ull;
+    h = (h ^ (h >> 30)) * 0xbf58476d1ce4e5b9ull;
+    h = (h ^ (h >> 27)) * 0x94d049bb133111ebull;
+    h ^= h >> 31;
+    uint32_t h1 = (uint32_t)h;
+    uint32_t h2 = (uint32_t)(h >> 32) | 1;
+    for (int r = 0; r < SKETCH_DEPTH; r++)
+    {
+        idx[r] = (h1 + r * h2) & (SKETCH_WIDTH - 1);
+    }
+}
+
+static uint64_t pane_estimate(const struct pane *p, const uint32_t idx[SKETCH_DEPTH])
+{
+    uint32_t est = UINT32_MAX;
+    for (int r = 0; r < SKETCH_DEPTH; r++)
+    {
+        if (p->counts[r][idx[r]] < est) est = p->counts[r][idx[r]];
+    }
+    return est;
+}
+
+static void find_min_slot(struct pane *p)
+{
+    int m = 0;
+    for (int i = 1; i < p->ntop; i++)
+    {
+        if (p->top[i].count < p->top[m].count) m = i;
+    }
+    p->min_slot = m;
+}
+
+/**
+ * @brief Moves to the pane holding now. A gap of two windows or more
+ * leaves nothing from before it.
+ */
+static void rotate(sketch_t s, uint64_t now)
+{
+    if (now - s->pane_start < s->window_ns)
+    {
+        return;
+    }
+    struct pane *old = s->prev;
+    s->prev = s->cur;
+    s->cur = old;
+    pane_clear(s->cur);
+    if (now - s->pane_start >= 2 * s->window_ns)
+    {
+        pane_clear(s->prev);
+        s->pane_start = now;
+    }
+    else
+    {
+        s->pane_start += s->window_ns;
+    }
+}
+
+void sketch_add(sketch_t s, uint64_t key, uint32_t n, uint64_t now)
+{
+    if (!s || n == 0) return;
+
+    rotate(s, now);
+    struct pane *p = s->cur;
+    uint32_t idx[SKETCH_DEPTH];
+    key_slots(key, idx);
+
+    // Conservative update: only counters at the current minimum rise, which
+    // keeps collisions from inflating the other rows
+    uint64_t est = pane_estimate(p, idx) + n;
+    if (est > UINT32_MAX) est = UINT32_MAX;
+    for (int r = 0; r < SKETCH_DEPTH; r++)
+    {
+        if (p->counts[r][idx[r]] < est) p->counts[r][idx[r]] = (uint32_t)est;
+    }
+
+    // A key at or below the smallest tracked count cannot enter the table,
+    // and if it is already in it its count is unchanged, so most keys stop
+    // here
+    bool full = p->ntop == s->k;
+    if (full && est <= p->top[p->min_slot].count)
+    {
+        return;
+    }
+    for (int i = 0; i < p->ntop; i++)
+    {
+        if (p->top[i].key == key)
+        {
+            p->top[i].count = est;
+            if (full && i == p->min_slot) find_min_slot(p);
+            return;
+        }
+    }
+    int slot = full ? p->min_slot : p->ntop++;
+    p->top[slot].key = key;
+    p->top[slot].count = est;
+    if (p->ntop == s->k) find_min_slot(p);
+}
+
+/**
+ * @brief How much of the previous pane is still inside the window, in
+ * 1/1024ths
+ */
+static uint64_t prev_weight(sketch_t s, uint64_t now)
+{
+    uint64_t into = now - s->pane_start;
+    if (into >= s->window_ns) return 0;
+    return ((s->window_ns - into) * 1024) / s->window_ns;
+}
+
+static uint64_t window_estimate(sketch_t s, uint64_t key, uint64_t weight)
+{
+    uint32_t idx[SKETCH_DEPTH];
+    key_slots(key, idx);
+    // The previous pane's share assumes its events were spread evenly, round up
+    return pane_estimate(s->cur, idx) + (pane_estimate(s->prev, idx) * weight + 1023) / 1024;
+}
+
+uint64_t sketch_estimate(sketch_t s, uint64_t key, uint64_t now)
+{
+    if (!s) return 0;
+
+    rotate(s, now);
+    return window_estimate(s, key, prev_weight(s, now));
+}
+
+static int by_count_desc(const void *a, const void *b)
+{
+    const struct sketch_entry *x = (const struct sketch_entry *)a;
+    const struct sketch_entry *y = (const struct sketch_entry *)b;
+    return x->count < y->count ? 1 : x->count > y->count ? -1 : 0;
+}
+
+int sketch_top(sketch_t s, struct sketch_entry *out, int max, uint64_t now)
+{
+    if (!s || !out || max <= 0) return 0;
+
+    rotate(s, now);
+    uint64_t weight = prev_weight(s, now);
+    uint64_t span = now - s->created < s->window_ns ? now - s->created : s->window_ns;
+    double secs = span > 0 ? span / 1e9 : 1e-9;
+
+    // Candidates are the keys either pane tracks, re-estimated over the window
+    struct sketch_entry cand[2 * SKETCH_MAX_TOP];
+    int n = 0;
+    const struct pane *panes[2] = {s->cur, s->prev};
+    for (int pi = 0; pi < 2; pi++)
+    {
+        for (int i = 0; i < panes[pi]->ntop; i++)
+        {
+            uint64_t key = panes[pi]->top[i].key;
+            bool seen = false;
+            for (int j = 0; j < n && !seen; j++)
+            {
+                seen = cand[j].key == key;
+            }
+            if (seen || (pi == 1 && weight == 0)) continue;
+            cand[n].key = key;
+            cand[n].count = window_estimate(s, key, weight);
+            cand[n].rate = cand[n].count / secs;
+            n++;
+        }
+    }
+    qsort(cand, n, sizeof(cand[0]), by_count_desc);
+    if (n > max) n = max;
+    if (n > s->k) n = s->k;
+    memcpy(out, cand, n * sizeof(cand[0]));
+    return n;
+}
@@ -0,0 +1,105 @@
+#ifndef SKETCH_H
+#define SKETCH_H
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+/**
+ * @brief Counters per count-min row, a power of two
+ */
+#define SKETCH_WIDTH 1024
+
+/**
+ * @brief Count-min rows; an estimate is the smallest of this many counters
+ */
+#define SKETCH_DEPTH 4
+
+/**
+ * @brief Largest number of heavy hitters a sketch tracks
+ */
+#define SKETCH_MAX_TOP 64
+
+    /**
+     * @brief A heavy hitter reported by sketch_top()
+     */
+    struct sketch_entry
+    {
+        uint64_t key;
+        uint64_t count; // Estimated occurrences in the last window
+        double rate;    // count per second over the window
+    };
+
+    /**
+     * @brief opaque type definition for a heavy-hitter sketch
+     *
+     * A count-min sketch with conservative update estimates how often each
+     * key occurred, and a space-saving table keeps the k keys with the
+     * largest estimates. Counts cover a sliding window made of two panes of
+     * window_ns each: the current pane and the previous one, weighted by
+     * how much of it still falls in the window. That weighting assumes the
+     * previous pane's events were spread evenly, so the window count is an
+     * approximation: a key that burst at the end of the previous pane is
+     * undercounted, one that burst at its start overcounted. Within a pane
+     * the count-min error only ever adds. All memory is allocated up front.
+     * A sketch is not thread safe; callers serialize access.
+     */
+    typedef struct sketch *sketch_t;
+
+    /**
+     * @brief Create a sketch
+     *
+     * @param k number of heavy hitters to track, at most SKETCH_MAX_TOP
+     * @param window_ns length of the sliding window
+     * @param now current time from clock_now_ns()
+     * @return a new sketch, or NULL on error
+     */
+    sketch_t sketch_init(int k, uint64_t window_ns, uint64_t now);
+
+    /**
+     * @brief Frees the sketch
+     *
+     * @param s the sketch
+     */
+    void sketch_destroy(sketch_t s);
+
+    /**
+     * @brief Counts n occurrences of a key
+     *
+     * @param s the sketch
+     * @param key the key
+     * @param n number of occurrences
+     * @param now current time from clock_now_ns()
+     */
+    void sketch_add(sketch_t s, uint64_t key, uint32_t n, uint64_t now);
+
+    /**
+     * @brief Estimates how often a key occurred in the window. The estimate
+     * is never below the key's count in the current pane, but the previous
+     * pane's share is approximate, see sketch_t.
+     *
+     * @param s the sketch
+     * @param key the key
+     * @param now current time from clock_now_ns()
+     * @return estimated occurrences
+     */
+    uint64_t sketch_estimate(sketch_t s, uint64_t key, uint64_t now);
+
+    /**
+     * @brief Reports the heaviest keys in the window, heaviest first
+     *
+     * @param s the sketch
+     * @param out receives the entries
+     * @param max size of out
+     * @param now current time from clock_now_ns()
+     * @return number of entries written
+     */
+    int sketch_top(sketch_t s, struct sketch_entry *out, int max, uint64_t now);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
+
+#endif
@@ -0,0 +1,396 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "stream.h"
+#include "subscribe.h"
+#include "clock.h"
+
+#define STREAM_MAX_OPS 16    // Operators per stage
+#define STREAM_MAX_STAGES 8  // Stages per stream
+#define STREAM_DRAIN_BATCH 16 // Items a stage thread takes per dequeue_batch
+
+enum op_kind
+{
+    OP_MAP,
+    OP_FILTER,
+    OP_BATCH,
+    OP_WINDOW
+};
+
+/**
+ * @brief One operator. Batch and window operators buffer items in pending.
+ */
+struct op
+{
+    enum op_kind kind;
+    union
+    {
+        stream_map_fn map;
+        stream_filter_fn filter;
+        stream_window_fn window;
+    } fn;
+    void *ctx;
+    int count;            // Items that close a batch or window, 0 for no limit
+    uint64_t span_ns;     // Age that closes a batch or window, 0 for no limit
+    pthread_mutex_t lock; // Guards the pending state below
+    void **pending;       // Items collected so far
+    int npending;
+    int cap;
+    uint64_t opened;      // When the first pending item arrived
+};
+
+/**
+ * @brief Fused operators that run back to back in the same thread
+ */
+struct stage
+{
+    struct op ops[STREAM_MAX_OPS];
+    int nops;
+    queue_t in;          // Input queue, NULL for the first stage
+    int nthreads;        // Threads draining in
+    subscription_t sub;  // Runs the stage's threads
+    struct stream *s;
+    int index;
+};
+
+/**
+ * @brief The internal structure for a stream.
+ */
+struct stream
+{
+    struct stage stages[STREAM_MAX_STAGES];
+    int nstages;
+    int capacity;        // Capacity of the queues between stages
+    stream_sink_fn sink;
+    void *sink_ctx;
+    bool started;
+    bool closed;
+};
+
+stream_t stream_init(int queue_capacity)
+{
+    if (queue_capacity <= 0)
+    {
+        fprintf(stderr, "Error: Stream queue capacity must be positive.\n");
+        return NULL;
+    }
+
+    stream_t s = (stream_t)calloc(1, sizeof(struct stream));
+    if (!s)
+    {
+        perror("Failed to allocate stream");
+        return NULL;
+    }
+    s->capacity = queue_capacity;
+    s->nstages = 1;
+    s->stages[0].s = s;
+    return s;
+}
+
+/**
+ * @brief Appends a blank operator to the last stage
+ */
+static struct op *add_op(stream_t s, enum op_kind kind, void *ctx)
+{
+    if (!s || s->started)
+    {
+        fprintf(stderr, "Error: Operators must be added before stream_start.\n");
+        return NULL;
+    }
+    struct stage *st = &s->stages[s->nstages - 1];
+    if (st->nops == STREAM_MAX_OPS)
+    {
+        fprintf(stderr, "Error: Too many operators in one stage.\n");
+        return NULL;
+    }
+    struct op *op = &st->ops[st->nops++];
+    memset(op, 0, sizeof(*op));
+    op->kind = kind;
+    op->ctx = ctx;
+    pthread_mutex_init(&op->lock, NULL);
+    return op;
+}
+
+int stream_map(stream_t s, stream_map_fn fn, void *ctx)
+{
+    struct op *op = fn ? add_op(s, OP_MAP, ctx) : NULL;
+    if (!op) return -1;
+    op->fn.map = fn;
+    return 0;
+}
+
+int stream_filter(stream_t s, stream_filter_fn fn, void *ctx)
+{
+    struct op *op = fn ? add_op(s, OP_FILTER, ctx) : NULL;
+    if (!op) return -1;
+    op->fn.filter = fn;
+    return 0;
+}
+
+/**
+ * @brief Sets up the pending buffer of a batch or window operator
+ */
+static int collect_init(struct op *op, int count, uint64_t span_ns)
+{
+    op->count = count;
+    op->span_ns = span_ns;
+    op->cap = count > 0 ? count : 16;
+    op->pending = (void **)malloc(op->cap * sizeof(void *));
+    if (!op->pending)
+    {
+        perror("Failed to allocate stream operator buffer");
+        return -1;
+    }
+    return 0;
+}
+
+int stream_batch(stream_t s, int count, uint64_t span_ns)
+{
+    if (count <= 0) return -1;
+    struct op *op = add_op(s, OP_BATCH, NULL);
+    if (!op) return -1;
+    return collect_init(op, count, span_ns);
+}
+
+int stream_window(stream_t s, int count, uint64_t span_ns, stream_window_fn fn, void *ctx)
+{
+    if (!fn || count < 0 || (count == 0 && span_ns == 0)) return -1;
+    struct op *op = add_op(s, OP_WINDOW, ctx);
+    if (!op) return -1;
+    op->fn.window = fn;
+    return collect_init(op, count, span_ns);
+}
+
+int stream_parallel(stream_t s, int nthreads)
+{
+    if (!s || s->started || nthreads <= 0) return -1;
+    if (s->nstages == STREAM_MAX_STAGES)
+    {
+        fprintf(stderr, "Error: Too many stages in one stream.\n");
+        return -1;
+    }
+    struct stage *st = &s->stages[s->nstages];
+    st->s = s;
+    st->index = s->nstages;
+    st->nthreads = nthreads;
+    s->nstages++;
+    return 0;
+}
+
+int stream_sink(stream_t s, stream_sink_fn fn, void *ctx)
+{
+    if (!s || s->started) return -1;
+    s->sink = fn;
+    s->sink_ctx = ctx;
+    return 0;
+}
+
+/**
+ * @brief Turns the pending items of a batch or window operator into one
+ * item and resets it. Caller holds op->lock.
+ */
+static void *emit(struct op *op)
+{
+    void *out;
+    if (op->kind == OP_BATCH)
+    {
+        struct stream_batch *b = (struct stream_batch *)malloc(
+            sizeof(struct stream_batch) + op->npending * sizeof(void *));
+        if (!b)
+        {
+            perror("Failed to allocate stream batch");
+            op->npending = 0;
+            return NULL;
+        }
+        b->n = op->npending;
+        memcpy(b->items, op->pending, op->npending * sizeof(void *));
+        out = b;
+    }
+    else
+    {
+        out = op->fn.window(op->pending, op->npending, op->ctx);
+    }
+    op->npending = 0;
+    return out;
+}
+
+/**
+ * @brief Adds an item to a batch or window operator
+ *
+ * @return the emitted item when the batch or window closed, otherwise NULL
+ */
+static void *collect(struct op *op, void *item)
+{
+    void *out = NULL;
+    uint64_t now = clock_now_ns();
+
+    pthread_mutex_lock(&op->lock);
+    if (op->npending == 0)
+    {
+        op->opened = now;
+    }
+    if (op->npending == op->cap)
+    {
+        void **pending = (void **)realloc(op->pending, op->cap * 2 * sizeof(void *));
+        if (!pending)
+        {
+            pthread_mutex_unlock(&op->lock);
+            perror("Failed to grow stream window");
+            return NULL;
+        }
+        op->pending = pending;
+        op->cap *= 2;
+    }
+    op->pending[op->npending++] = item;
+
+    if ((op->count > 0 && op->npending >= op->count) ||
+        (op->span_ns > 0 && now - op->opened >= op->span_ns))
+    {
+        out = emit(op);
+    }
+    pthread_mutex_unlock(&op->lock);
+    return out;
+}
+
+/**
+ * @brief Runs an item through a stage starting at operator k, then hands it
+ * to the next stage's queue or to the sink
+ */
+static void run(struct stage *st, int k, void *item)
+{
+    for (; k < st->nops; k++)
+    {
+        struct op *op = &st->ops[k];
+        switch (op->kind)
+        {
+        case OP_MAP:
+            item = op->fn.map(item, op->ctx);
+            break;
+        case OP_FILTER:
+            if (!op->fn.filter(item, op->ctx))
+            {
+                item = NULL;
+            }
+            break;
+        case OP_BATCH:
+        case OP_WINDOW:
+            item = collect(op, item);
+            break;
+        }
+        if (!item)
+        {
+            return;
+        }
+    }
+
+    stream_t s = st->s;
+    if (st->index + 1 < s->nstages)
+    {
+        enqueue(s->stages[st->index + 1].in, item);
+    }
+    else if (s->sink)
+    {
+        s->sink(item, s->sink_ctx);
+    }
+}
+
+/**
+ * @brief Emits partial batches and windows of a stage whose input is done
+ */
+static void flush(struct stage *st)
+{
+    for (int k = 0; k < st->nops; k++)
+    {
+        struct op *op = &st->ops[k];
+        if (op->kind != OP_BATCH && op->kind != OP_WINDOW)
+        {
+            continue;
+        }
+        pthread_mutex_lock(&op->lock);
+        void *out = op->npending > 0 ? emit(op) : NULL;
+        pthread_mutex_unlock(&op->lock);
+        if (out)
+        {
+            run(st, k + 1, out);
+        }
+    }
+}
+
+static void stage_handler(void **items, int n, void *ctx)
+{
+    struct stage *st = (struct stage *)ctx;
+    for (int i = 0; i < n; i++)
+    {
+        run(st, 0, items[i]);
+    }
+}
+
+int stream_start(stream_t s)
+{
+    if (!s || s->started) return -1;
+
+    for (int i = 1; i < s->nstages; i++)
+    {
+        struct stage *st = &s->stages[i];
+        st->in = queue_init(s->capacity);
+        if (!st->in)
+        {
+            fprintf(stderr, "Error: Failed to set up stream stage %d.\n", i);
+            return -1;
+        }
+    }
+    // Start downstream stages first so nothing waits on a missing consumer
+    for (int i = s->nstages - 1; i >= 1; i--)
+    {
+        struct stage *st = &s->stages[i];
+        st->sub = queue_subscribe(st->in, stage_handler, st, STREAM_DRAIN_BATCH, st->nthreads);
+        if (!st->sub)
+        {
+            fprintf(stderr, "Error: Failed to start stream stage %d.\n", i);
+            return -1;
+        }
+    }
+    s->started = true;
+    return 0;
+}
+
+void stream_push(stream_t s, void *item)
+{
+    if (!s || !s->started || s->closed) return;
+    run(&s->stages[0], 0, item);
+}
+
+void stream_close(stream_t s)
+{
+    if (!s || !s->started || s->closed) return;
+
+    flush(&s->stages[0]);
+    for (int i = 1; i < s->nstages; i++)
+    {
+        struct stage *st = &s->stages[i];
+        queue_unsubscribe(st->sub); // Drains the queue into the stage
+        st->sub = NULL;
+        flush(st);
+    }
+    s->closed = true;
+}
+
+void stream_destroy(stream_t s)
+{
+    if (!s) return;
+
+    stream_close(s);
+    for (int i = 0; i < s->nstages; i++)
+    {
+        struct stage *st = &s->stages[i];
+        for (int k = 0; k < st->nops; k++)
+        {
+            pthread_mutex_destroy(&st->ops[k].lock);
+            free(st->ops[k].pending);
+        }
+        queue_unsubscribe(st->sub); // Only set if stream_start failed
+        queue_destroy(st->in);
+    }
+    free(s);
+}
@@ -0,0 +1,143 @@
+#ifndef STREAM_H
+#define STREAM_H
+#include <stdint.h>
+#include <stdbool.h>
+#include "lab.h"
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+    /**
+     * @brief opaque type definition for a stream processing graph
+     *
+     * A stream is declared as a chain of operators ending in a sink. Adjacent
+     * operators are fused into one stage and run inline, one after the other,
+     * in the same thread with no queue between them. A queue_t is inserted
+     * only where stream_parallel() starts a new stage run by its own threads.
+     * The first stage runs on the thread calling stream_push().
+     *
+     * Batch and window operators keep state. When their stage has more than
+     * one thread the state is shared under a lock, so items from different
+     * threads may land in the same batch. Time limits are checked when an
+     * item reaches the operator and at stream_close(); there is no timer.
+     */
+    typedef struct stream *stream_t;
+
+    /**
+     * @brief Transforms an item. Returning NULL drops it.
+     */
+    typedef void *(*stream_map_fn)(void *item, void *ctx);
+
+    /**
+     * @brief Returns true to keep an item. Dropped items are not freed.
+     */
+    typedef bool (*stream_filter_fn)(void *item, void *ctx);
+
+    /**
+     * @brief Folds a complete window of items into one item. The array is
+     * owned by the stream, the items themselves by the function.
+     */
+    typedef void *(*stream_window_fn)(void **items, int n, void *ctx);
+
+    /**
+     * @brief Receives every item that reaches the end of the stream
+     */
+    typedef void (*stream_sink_fn)(void *item, void *ctx);
+
+    /**
+     * @brief The item emitted by stream_batch(), free with free()
+     */
+    struct stream_batch
+    {
+        int n;
+        void *items[];
+    };
+
+    /**
+     * @brief Create an empty stream
+     *
+     * @param queue_capacity capacity of the queues inserted at stage boundaries
+     * @return a new stream, or NULL on error
+     */
+    stream_t stream_init(int queue_capacity);
+
+    /**
+     * @brief Appends a map operator
+     *
+     * @return 0 on success, -1 on error
+     */
+    int stream_map(stream_t s, stream_map_fn fn, void *ctx);
+
+    /**
+     * @brief Appends a filter operator
+     *
+     * @return 0 on success, -1 on error
+     */
+    int stream_filter(stream_t s, stream_filter_fn fn, void *ctx);
+
+    /**
+     * @brief Appends an operator that groups items into a struct stream_batch
+     * of count items, or fewer once span_ns has passed since the batch started
+     *
+     * @param count items per batch
+     * @param span_ns maximum age of a batch, 0 for no limit
+     * @return 0 on success, -1 on error
+     */
+    int stream_batch(stream_t s, int count, uint64_t span_ns);
+
+    /**
+     * @brief Appends a tumbling window operator that closes a window after
+     * count items or span_ns, whichever comes first, and emits fn's result
+     *
+     * @param count items per window, 0 for no limit
+     * @param span_ns length of a window, 0 for no limit
+     * @return 0 on success, -1 on error
+     */
+    int stream_window(stream_t s, int count, uint64_t span_ns, stream_window_fn fn, void *ctx);
+
+    /**
+     * @brief Starts a new stage run by nthreads threads behind a queue_t.
+     * Operators appended afterwards run in the new stage.
+     *
+     * @return 0 on success, -1 on error
+     */
+    int stream_parallel(stream_t s, int nthreads);
+
+    /**
+     * @brief Sets the function that receives the stream's output
+     *
+     * @return 0 on success, -1 on error
+     */
+    int stream_sink(stream_t s, stream_sink_fn fn, void *ctx);
+
+    /**
+     * @brief Starts the stage threads. No operators may be added afterwards.
+     *
+     * @return 0 on success, -1 on error
+     */
+    int stream_start(stream_t s);
+
+    /**
+     * @brief Feeds an item into the stream. The first stage runs inline on
+     * the calling thread. Only one thread may push at a time.
+     */
+    void stream_push(stream_t s, void *item);
+
+    /**
+     * @brief Flushes partial batches and windows, drains every stage in order
+     * and joins the stage threads
+     */
+    void stream_close(stream_t s);
+
+    /**
+     * @brief Frees the stream, closing it first if needed
+     */
+    void stream_destroy(stream_t s);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
+
+#endif
@@ -0,0 +1,90 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include "subscribe.h"
+
+/**
+ * @brief The internal structure for a subscription.
+ */
+struct subscription
+{
+    queue_t q;                // Queue being consumed
+    queue_handler_fn handler; // Called for every batch
+    void *ctx;                // Passed to the handler
+    int max_batch;            // Most items per handler call
+    int nthreads;             // Number of consumer threads
+    pthread_t *threads;       // The consumer threads
+};
+
+static void *subscriber(void *arg)
+{
+    subscription_t s = (subscription_t)arg;
+    void **items = (void **)malloc(s->max_batch * sizeof(void *));
+    if (!items)
+    {
+        perror("Failed to allocate subscriber batch");
+        return NULL;
+    }
+
+    int n;
+    while ((n = dequeue_batch(s->q, items, s->max_batch)) > 0)
+    {
+        s->handler(items, n, s->ctx);
+    }
+    free(items);
+    return NULL;
+}
+
+subscription_t queue_subscribe(queue_t q, queue_handler_fn handler, void *ctx,
+                               int max_batch, int nthreads)
+{
+    if (!q || !handler || max_batch <= 0 || nthreads <= 0)
+    {
+        fprintf(stderr, "Error: Invalid subscription arguments.\n");
+        return NULL;
+    }
+
+    subscription_t s = (subscription_t)malloc(sizeof(struct subscription));
+    if (!s)
+    {
+        perror("Failed to allocate subscription");
+        return NULL;
+    }
+    s->threads = (pthread_t *)malloc(nthreads * sizeof(pthread_t));
+    if (!s->threads)
+    {
+        perror("Failed to allocate subscriber threads");
+        free(s);
+        return NULL;
+    }
+    s->q = q;
+    s->handler = handler;
+    s->ctx = ctx;
+    s->max_batch = max_batch;
+    s->nthreads = 0;
+
+    for (int i = 0; i < nthreads; i++)
+    {
+        if (pthread_create(&s->threads[i], NULL, subscriber, s) != 0)
+        {
+            perror("Failed to start subscriber thread");
+            queue_unsubscribe(s); // Stops the threads started so far
+            return NULL;
+        }
+        s->nthreads++;
+    }
+    return s;
+}
+
+void queue_unsubscribe(subscription_t s)
+{
+    if (!s) return;
+
+    queue_shutdown(s->q);
+    for (int i = 0; i < s->nthreads; i++)
+    {
+        pthread_join(s->threads[i], NULL);
+    }
+    free(s->threads);
+    free(s);
+}
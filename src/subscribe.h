@@ -0,0 +1,52 @@
+#ifndef SUBSCRIBE_H
+#define SUBSCRIBE_H
+#include "lab.h"
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+    /**
+     * @brief Called with up to max_batch items taken from the queue in FIFO
+     * order. The array is reused after the call returns, the items belong to
+     * the handler.
+     */
+    typedef void (*queue_handler_fn)(void **items, int n, void *ctx);
+
+    /**
+     * @brief opaque type definition for a subscription
+     */
+    typedef struct subscription *subscription_t;
+
+    /**
+     * @brief Starts nthreads consumer threads that drain the queue with
+     * dequeue_batch() and hand each batch to the handler. A thread blocks only
+     * when the queue is empty, so one wakeup and one handler call cover every
+     * item that piled up in the meantime. The threads exit once the queue is
+     * shut down and drained.
+     *
+     * @param q the queue to consume
+     * @param handler called for every batch
+     * @param ctx passed to the handler
+     * @param max_batch most items per handler call
+     * @param nthreads number of consumer threads
+     * @return a new subscription, or NULL on error
+     */
+    subscription_t queue_subscribe(queue_t q, queue_handler_fn handler, void *ctx,
+                                   int max_batch, int nthreads);
+
+    /**
+     * @brief Shuts down the queue, waits for the consumer threads to hand the
+     * remaining items to the handler and exit, then frees the subscription.
+     * The queue itself is left for the caller to destroy.
+     *
+     * @param s the subscription
+     */
+    void queue_unsubscribe(subscription_t s);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
+
+#endif
@@ -0,0 +1,67 @@
+#ifndef SYNC_H
+#define SYNC_H
+#include <pthread.h>
+
+/*
+ * Synchronization primitives used by the queue engines. Normal builds map
+ * them straight onto pthreads and GCC atomics. Building with -DQUEUE_SCHED
+ * (make sched-check) routes them through the deterministic scheduler in
+ * tests/detsched.c instead, which decides at every call which thread runs
+ * next so interleavings can be explored and replayed from a seed. Threads
+ * the scheduler does not manage still get the real primitives.
+ */
+
+#ifdef QUEUE_SCHED
+
+void sched_point(void);
+int sync_mutex_lock(pthread_mutex_t *m);
+int sync_mutex_unlock(pthread_mutex_t *m);
+int sync_cond_wait(pthread_cond_t *c, pthread_mutex_t *m);
+int sync_cond_signal(pthread_cond_t *c);
+int sync_cond_broadcast(pthread_cond_t *c);
+
+#define SYNC_POINT() sched_point()
+
+#else
+
+#define SYNC_POINT() ((void)0)
+
+static inline int sync_mutex_lock(pthread_mutex_t *m)
+{
+    return pthread_mutex_lock(m);
+}
+
+static inline int sync_mutex_unlock(pthread_mutex_t *m)
+{
+    return pthread_mutex_unlock(m);
+}
+
+static inline int sync_cond_wait(pthread_cond_t *c, pthread_mutex_t *m)
+{
+    return pthread_cond_wait(c, m);
+}
+
+static inline int sync_cond_signal(pthread_cond_t *c)
+{
+    return pthread_cond_signal(c);
+}
+
+static inline int sync_cond_broadcast(pthread_cond_t *c)
+{
+    return pthread_cond_broadcast(c);
+}
+
+#endif
+
+/**
+ * @brief Atomic load and store that are also scheduling points
+ */
+#define sync_load(p, order) (SYNC_POINT(), __atomic_load_n((p), (order)))
+#define sync_store(p, v, order)              \
+    do                                       \
+    {                                        \
+        SYNC_POINT();                        \
+        __atomic_store_n((p), (v), (order)); \
+    } while (0)
+
+#endif
@@ -0,0 +1,179 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "trace.h"
+#include "clock.h"
+
+#define TRACE_MAGIC 0x31435254u // "TRC1"
+
+/**
+ * @brief The internal structure for a trace buffer.
+ */
+struct trace
+{
+    struct trace_rec *recs; // Preallocated records
+    size_t max;             // Length of recs
+    size_t next;            // Next record to claim, updated atomically
+};
+
+/**
+ * @brief File header written before the records
+ */
+struct trace_header
+{
+    uint32_t magic;
+    uint32_t rec_size;
+    uint64_t count;
+};
+
+trace_t trace_init(size_t max_records)
+{
+    if (max_records == 0)
+    {
+        fprintf(stderr, "Error: Trace needs room for at least one record.\n");
+        return NULL;
+    }
+
+    trace_t t = (trace_t)malloc(sizeof(struct trace));
+    if (!t)
+    {
+        perror("Failed to allocate trace");
+        return NULL;
+    }
+    t->recs = (struct trace_rec *)malloc(max_records * sizeof(struct trace_rec));
+    if (!t->recs)
+    {
+        perror("Failed to allocate trace records");
+        free(t);
+        return NULL;
+    }
+    t->max = max_records;
+    t->next = 0;
+    return t;
+}
+
+void trace_destroy(trace_t t)
+{
+    if (!t) return;
+    free(t->recs);
+    free(t);
+}
+
+void trace_record(trace_t t, uint16_t queue, enum trace_op op, int count, int depth)
+{
+    // The count field holds at most UINT8_MAX items, so larger operations
+    // are split into several records that replay to the same total
+    int nrec = count > UINT8_MAX ? (count + UINT8_MAX - 1) / UINT8_MAX : 1;
+    size_t first = __atomic_fetch_add(&t->next, nrec, __ATOMIC_RELAXED);
+    if (first >= t->max)
+    {
+        return; // Full, counted by trace_dropped()
+    }
+    uint64_t now = clock_now_ns();
+    int left = count;
+    for (int k = 0; k < nrec && first + k < t->max; k++)
+    {
+        int n = left > UINT8_MAX ? UINT8_MAX : left;
+        left -= n;
+        struct trace_rec *r = &t->recs[first + k];
+        r->ts_ns = now;
+        // Depth as if the items still to come in later records had not moved yet
+        r->depth = (uint32_t)(op == TRACE_ENQ ? depth - left : depth + left);
+        r->queue = queue;
+        r->op = (uint8_t)op;
+        r->count = (uint8_t)n;
+    }
+}
+
+size_t trace_dropped(trace_t t)
+{
+    size_t n = __atomic_load_n(&t->next, __ATOMIC_RELAXED);
+    return n > t->max ? n - t->max : 0;
+}
+
+/**
+ * @brief Orders records by time, then by the order they were claimed in.
+ * Records of one split operation share a timestamp, and so can an enqueue
+ * and the dequeue that follows it, so ties must keep their claim order.
+ * Sorts pointers into recs, whose addresses give the claim order.
+ */
+static int cmp_ts(const void *a, const void *b)
+{
+    const struct trace_rec *x = *(const struct trace_rec *const *)a;
+    const struct trace_rec *y = *(const struct trace_rec *const *)b;
+    if (x->ts_ns != y->ts_ns)
+    {
+        return (x->ts_ns > y->ts_ns) - (x->ts_ns < y->ts_ns);
+    }
+    return (x > y) - (x < y);
+}
+
+long trace_write(trace_t t, FILE *f)
+{
+    if (!t || !f) return -1;
+
+    size_t n = __atomic_load_n(&t->next, __ATOMIC_ACQUIRE);
+    if (n > t->max) n = t->max;
+
+    // Records are claimed in order but stamped a moment later
+    struct trace_rec **order = (struct trace_rec **)malloc((n ? n : 1) * sizeof(struct trace_rec *));
+    struct trace_rec *sorted = (struct trace_rec *)malloc((n ? n : 1) * sizeof(struct trace_rec));
+    if (!order || !sorted)
+    {
+        perror("Failed to sort trace");
+        free(order);
+        free(sorted);
+        return -1;
+    }
+    for (size_t i = 0; i < n; i++)
+    {
+        order[i] = &t->recs[i];
+    }
+    qsort(order, n, sizeof(struct trace_rec *), cmp_ts);
+    for (size_t i = 0; i < n; i++)
+    {
+        sorted[i] = *order[i];
+    }
+    memcpy(t->recs, sorted, n * sizeof(struct trace_rec));
+    free(order);
+    free(sorted);
+
+    struct trace_header h = {TRACE_MAGIC, sizeof(struct trace_rec), n};
+    if (fwrite(&h, sizeof(h), 1, f) != 1 ||
+        fwrite(t->recs, sizeof(struct trace_rec), n, f) != n)
+    {
+        perror("Failed to write trace");
+        return -1;
+    }
+    return (long)n;
+}
+
+long trace_read(FILE *f, struct trace_rec **recs)
+{
+    struct trace_header h;
+    if (!f || !recs || fread(&h, sizeof(h), 1, f) != 1)
+    {
+        fprintf(stderr, "Error: Could not read trace header.\n");
+        return -1;
+    }
+    if (h.magic != TRACE_MAGIC || h.rec_size != sizeof(struct trace_rec))
+    {
+        fprintf(stderr, "Error: Not a trace file.\n");
+        return -1;
+    }
+
+    *recs = (struct trace_rec *)malloc((h.count ? h.count : 1) * sizeof(struct trace_rec));
+    if (!*recs)
+    {
+        perror("Failed to allocate trace records");
+        return -1;
+    }
+    if (fread(*recs, sizeof(struct trace_rec), h.count, f) != h.count)
+    {
+        fprintf(stderr, "Error: Trace file is truncated.\n");
+        free(*recs);
+        *recs = NULL;
+        return -1;
+    }
+    return (long)h.count;
+}
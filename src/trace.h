@@ -0,0 +1,83 @@
+#ifndef TRACE_H
+#define TRACE_H
+#include <stdio.h>
+#include <stdint.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+    /**
+     * @brief Kinds of traced queue operation
+     */
+    enum trace_op
+    {
+        TRACE_ENQ = 1, // Items were added
+        TRACE_DEQ = 2  // Items were removed
+    };
+
+    /**
+     * @brief One traced operation, 16 bytes on disk
+     */
+    struct trace_rec
+    {
+        uint64_t ts_ns;  // Monotonic time of the operation
+        uint32_t depth;  // Queue depth after the operation
+        uint16_t queue;  // Id given to the queue when tracing started
+        uint8_t op;      // enum trace_op
+        uint8_t count;   // Items moved, larger operations span several records
+    };
+
+    /**
+     * @brief opaque type definition for a trace buffer
+     */
+    typedef struct trace *trace_t;
+
+    /**
+     * @brief Create a trace buffer. Several queues may share one buffer,
+     * records are claimed with an atomic counter.
+     *
+     * @param max_records records kept, later ones are counted as dropped
+     * @return the trace, or NULL on error
+     */
+    trace_t trace_init(size_t max_records);
+
+    /**
+     * @brief Frees the trace buffer
+     */
+    void trace_destroy(trace_t t);
+
+    /**
+     * @brief Appends a record stamped with the current time. An operation
+     * that moved more than UINT8_MAX items is written as several records
+     * with the same time whose counts add up to count.
+     */
+    void trace_record(trace_t t, uint16_t queue, enum trace_op op, int count, int depth);
+
+    /**
+     * @brief Returns the number of records that did not fit
+     */
+    size_t trace_dropped(trace_t t);
+
+    /**
+     * @brief Writes all records to a file in time order
+     *
+     * @return the number of records written, -1 on error
+     */
+    long trace_write(trace_t t, FILE *f);
+
+    /**
+     * @brief Reads a file written by trace_write
+     *
+     * @param recs receives a malloc'd array the caller frees
+     * @return the number of records read, -1 on error
+     */
+    long trace_read(FILE *f, struct trace_rec **recs);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
+
+#endif
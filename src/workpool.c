@@ -0,0 +1,138 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include "workpool.h"
+#include "lab.h"
+#include "subscribe.h"
+
+/**
+ * @brief A task waiting in the queue
+ */
+struct task
+{
+    workpool_fn fn;
+    void *arg;
+};
+
+/**
+ * @brief The internal structure for a worker pool.
+ */
+struct workpool
+{
+    queue_t q;
+    subscription_t workers;
+    enum workpool_policy policy;
+    struct workpool_stats stats; // Updated with atomics
+};
+
+static void run_tasks(void **items, int n, void *ctx)
+{
+    workpool_t p = (workpool_t)ctx;
+    for (int i = 0; i < n; i++)
+    {
+        struct task *t = (struct task *)items[i];
+        t->fn(t->arg);
+        free(t);
+    }
+    __atomic_fetch_add(&p->stats.completed, n, __ATOMIC_RELAXED);
+}
+
+workpool_t workpool_init(int nworkers, int capacity, enum workpool_policy policy)
+{
+    if (nworkers <= 0 || capacity <= 0)
+    {
+        fprintf(stderr, "Error: Invalid worker pool arguments.\n");
+        return NULL;
+    }
+
+    workpool_t p = (workpool_t)calloc(1, sizeof(struct workpool));
+    if (!p)
+    {
+        perror("Failed to allocate worker pool");
+        return NULL;
+    }
+    p->policy = policy;
+    p->q = queue_init(capacity);
+    if (!p->q)
+    {
+        free(p);
+        return NULL;
+    }
+    // One task per dequeue, so a long task does not hold queued ones hostage
+    p->workers = queue_subscribe(p->q, run_tasks, p, 1, nworkers);
+    if (!p->workers)
+    {
+        queue_destroy(p->q);
+        free(p);
+        return NULL;
+    }
+    return p;
+}
+
+void workpool_destroy(workpool_t p)
+{
+    if (!p) return;
+
+    queue_unsubscribe(p->workers); // Shuts the queue down and drains it
+    queue_destroy(p->q);
+    free(p);
+}
+
+void workpool_shutdown(workpool_t p)
+{
+    if (!p) return;
+    queue_shutdown(p->q);
+}
+
+static int run_inline(workpool_fn fn, void *arg, uint64_t *counter)
+{
+    fn(arg);
+    __atomic_fetch_add(counter, 1, __ATOMIC_RELAXED);
+    return 1;
+}
+
+int workpool_submit(workpool_t p, workpool_fn fn, void *arg, bool tiny)
+{
+    if (!p || !fn || is_shutdown(p->q)) return -1;
+
+    bool caller_runs = p->policy == WORKPOOL_CALLER_RUNS;
+    if (caller_runs && tiny && queue_waiting_consumers(p->q) == 0)
+    {
+        return run_inline(fn, arg, &p->stats.ran_busy);
+    }
+
+    struct task *t = (struct task *)malloc(sizeof(struct task));
+    if (!t)
+    {
+        perror("Failed to allocate task");
+        return -1;
+    }
+    t->fn = fn;
+    t->arg = arg;
+    if (caller_runs)
+    {
+        if (try_enqueue(p->q, t) != 0)
+        {
+            free(t);
+            // Shutdown is final, so a refusal seen after it was not a full queue
+            if (is_shutdown(p->q)) return -1;
+            return run_inline(fn, arg, &p->stats.ran_full);
+        }
+    }
+    else if (enqueue_batch(p->q, (void **)&t, 1) != 1) // Reports a shutdown, unlike enqueue
+    {
+        free(t);
+        return -1;
+    }
+    __atomic_fetch_add(&p->stats.queued, 1, __ATOMIC_RELAXED);
+    return 0;
+}
+
+void workpool_stats(workpool_t p, struct workpool_stats *out)
+{
+    if (!p || !out) return;
+
+    out->queued = __atomic_load_n(&p->stats.queued, __ATOMIC_RELAXED);
+    out->ran_full = __atomic_load_n(&p->stats.ran_full, __ATOMIC_RELAXED);
+    out->ran_busy = __atomic_load_n(&p->stats.ran_busy, __ATOMIC_RELAXED);
+    out->completed = __atomic_load_n(&p->stats.completed, __ATOMIC_RELAXED);
+}
@@ -0,0 +1,97 @@
+#ifndef WORKPOOL_H
+#define WORKPOOL_H
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+    /**
+     * @brief What a submitter does when the pool cannot take a task
+     */
+    enum workpool_policy
+    {
+        WORKPOOL_BLOCK,      // Wait in enqueue until the queue has room
+        WORKPOOL_CALLER_RUNS // Run the task on the submitting thread
+    };
+
+    /**
+     * @brief A task, run once with its argument
+     */
+    typedef void (*workpool_fn)(void *arg);
+
+    /**
+     * @brief Counters for how tasks were run, see workpool_stats()
+     */
+    struct workpool_stats
+    {
+        uint64_t queued;      // Tasks handed to the workers
+        uint64_t ran_full;    // Run by the submitter because the queue was full
+        uint64_t ran_busy;    // Tiny tasks run by the submitter because no worker was idle
+        uint64_t completed;   // Tasks the workers finished
+    };
+
+    /**
+     * @brief opaque type definition for a worker pool
+     *
+     * Worker threads run tasks taken from a queue_t. Under the caller-runs
+     * policy a submitter never blocks: when the queue is full it runs the
+     * task itself, which slows it down exactly as much as the pool is
+     * behind, and a task marked tiny is run inline whenever no worker is
+     * idle, since the handoff would cost more than the task.
+     */
+    typedef struct workpool *workpool_t;
+
+    /**
+     * @brief Create a pool and start its workers
+     *
+     * @param nworkers number of worker threads
+     * @param capacity most tasks waiting for a worker
+     * @param policy what submit does when the queue is full
+     * @return a new pool, or NULL on error
+     */
+    workpool_t workpool_init(int nworkers, int capacity, enum workpool_policy policy);
+
+    /**
+     * @brief Runs the tasks still queued, stops the workers and frees the pool
+     *
+     * @param p the pool
+     */
+    void workpool_destroy(workpool_t p);
+
+    /**
+     * @brief Stops accepting tasks. Queued tasks still run, and later
+     * submits fail instead of running inline.
+     *
+     * @param p the pool
+     */
+    void workpool_shutdown(workpool_t p);
+
+    /**
+     * @brief Submits a task
+     *
+     * @param p the pool
+     * @param fn the task
+     * @param arg passed to the task
+     * @param tiny the task is cheaper than a handoff; under caller-runs it
+     * only goes to a worker that is idle right now
+     * @return 0 if a worker will run the task, 1 if it already ran on the
+     * calling thread, -1 on error or once the pool is being destroyed
+     */
+    int workpool_submit(workpool_t p, workpool_fn fn, void *arg, bool tiny);
+
+    /**
+     * @brief Reads the pool's counters
+     *
+     * @param p the pool
+     * @param out receives the counters
+     */
+    void workpool_stats(workpool_t p, struct workpool_stats *out);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
+
+#endif
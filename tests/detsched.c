@@ -0,0 +1,482 @@
+#ifdef QUEUE_SCHED
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "detsched.h"
+#include "../src/sync.h"
+
+#define MAX_MUTEXES 32
+
+enum tstate
+{
+    T_RUNNABLE,
+    T_BLOCKED_MUTEX, // Waiting for obj to be unlocked
+    T_BLOCKED_COND,  // Waiting for obj to be signalled
+    T_DONE
+};
+
+struct sthread
+{
+    pthread_t pt;
+    enum tstate state;
+    void *obj;
+    pthread_cond_t turn; // Signalled when this thread may run
+    void *(*fn)(void *);
+    void *arg;
+};
+
+enum mode
+{
+    MODE_RANDOM,
+    MODE_DFS
+};
+
+/**
+ * @brief State of the current run. Guarded by lock, but only the thread
+ * holding the baton (current) ever changes it while the run is active.
+ */
+static struct
+{
+    pthread_mutex_t lock;
+    pthread_cond_t finished;
+    struct sthread threads[SCHED_MAX_THREADS];
+    int nthreads;
+    int current;
+    bool active;
+
+    enum mode mode;
+    uint64_t rng;
+    uint64_t seed;
+    int prefix[SCHED_MAX_STEPS]; // Choices to replay in DFS mode
+    int prefix_len;
+    int choices[SCHED_MAX_STEPS]; // Choices made in this run
+    int options[SCHED_MAX_STEPS]; // Number of alternatives at each choice
+    int nsteps;
+    bool truncated; // A choice past SCHED_MAX_STEPS was forced to 0
+
+    struct
+    {
+        pthread_mutex_t *m;
+        int owner;
+    } mutexes[MAX_MUTEXES];
+    int nmutexes;
+} S = {.lock = PTHREAD_MUTEX_INITIALIZER, .finished = PTHREAD_COND_INITIALIZER};
+
+static __thread int self = -1;
+
+static void report(const char *what)
+{
+    fprintf(stderr, "detsched: %s after %d steps", what, S.nsteps);
+    if (S.mode == MODE_RANDOM)
+    {
+        fprintf(stderr, ", replay with seed %llu\n", (unsigned long long)S.seed);
+    }
+    else
+    {
+        fprintf(stderr, ", choices:");
+        for (int i = 0; i < S.nsteps; i++)
+        {
+            fprintf(stderr, " %d", S.choices[i]);
+        }
+        fprintf(stderr, "\n");
+    }
+}
+
+/**
+ * @brief Picks one of n alternatives and records the decision. Past
+ * SCHED_MAX_STEPS nothing can be recorded, so the run is marked truncated
+ * and fails rather than counting unexplored choices as covered.
+ */
+static int choose(int n)
+{
+    if (n <= 1)
+    {
+        return 0;
+    }
+    if (S.nsteps >= SCHED_MAX_STEPS)
+    {
+        S.truncated = true;
+        return 0;
+    }
+
+    int k;
+    if (S.nsteps < S.prefix_len)
+    {
+        k = S.prefix[S.nsteps] < n ? S.prefix[S.nsteps] : 0;
+    }
+    else if (S.mode == MODE_RANDOM)
+    {
+        // xorshift64*
+        S.rng ^= S.rng >> 12;
+        S.rng ^= S.rng << 25;
+        S.rng ^= S.rng >> 27;
+        k = (int)((S.rng * 2685821657736338717ull) >> 33) % n;
+    }
+    else
+    {
+        k = 0;
+    }
+    S.choices[S.nsteps] = k;
+    S.options[S.nsteps] = n;
+    S.nsteps++;
+    return k;
+}
+
+/**
+ * @brief Hands the baton to a runnable thread. Caller holds S.lock.
+ */
+static void schedule(void)
+{
+    int runnable[SCHED_MAX_THREADS];
+    int n = 0;
+    bool all_done = true;
+    for (int i = 0; i < S.nthreads; i++)
+    {
+        if (S.threads[i].state == T_RUNNABLE)
+        {
+            runnable[n++] = i;
+        }
+        if (S.threads[i].state != T_DONE)
+        {
+            all_done = false;
+        }
+    }
+
+    if (all_done)
+    {
+        S.current = -1;
+        pthread_cond_signal(&S.finished);
+        return;
+    }
+    if (n == 0)
+    {
+        // Threads that can never be woken cannot be unwound, give up loudly
+        report("deadlock");
+        abort();
+    }
+
+    S.current = runnable[choose(n)];
+    pthread_cond_signal(&S.threads[S.current].turn);
+}
+
+/**
+ * @brief Lets the scheduler run someone else, returns when it is our turn
+ * again. Caller holds S.lock.
+ */
+static void yield_locked(void)
+{
+    schedule();
+    while (S.current != self)
+    {
+        pthread_cond_wait(&S.threads[self].turn, &S.lock);
+    }
+}
+
+/**
+ * @brief Wakes every thread blocked on obj in the given state
+ */
+static void wake_all(enum tstate state, void *obj)
+{
+    for (int i = 0; i < S.nthreads; i++)
+    {
+        if (S.threads[i].state == state && S.threads[i].obj == obj)
+        {
+            S.threads[i].state = T_RUNNABLE;
+            S.threads[i].obj = NULL;
+        }
+    }
+}
+
+static int *mutex_owner(pthread_mutex_t *m)
+{
+    for (int i = 0; i < S.nmutexes; i++)
+    {
+        if (S.mutexes[i].m == m)
+        {
+            return &S.mutexes[i].owner;
+        }
+    }
+    if (S.nmutexes == MAX_MUTEXES)
+    {
+        report("too many mutexes");
+        abort();
+    }
+    S.mutexes[S.nmutexes].m = m;
+    S.mutexes[S.nmutexes].owner = -1;
+    return &S.mutexes[S.nmutexes++].owner;
+}
+
+void sched_point(void)
+{
+    if (self < 0) return;
+    pthread_mutex_lock(&S.lock);
+    yield_locked();
+    pthread_mutex_unlock(&S.lock);
+}
+
+int sync_mutex_lock(pthread_mutex_t *m)
+{
+    if (self < 0) return pthread_mutex_lock(m);
+
+    pthread_mutex_lock(&S.lock);
+    for (;;)
+    {
+        yield_locked();
+        int *owner = mutex_owner(m);
+        if (*owner < 0)
+        {
+            *owner = self;
+            break;
+        }
+        if (*owner == self)
+        {
+            report("recursive lock");
+            abort();
+        }
+        S.threads[self].state = T_BLOCKED_MUTEX;
+        S.threads[self].obj = m;
+    }
+    pthread_mutex_unlock(&S.lock);
+    return 0;
+}
+
+/**
+ * @brief Releases m on behalf of the current thread. Caller holds S.lock.
+ */
+static void release_locked(pthread_mutex_t *m)
+{
+    int *owner = mutex_owner(m);
+    if (*owner != self)
+    {
+        report("unlock of a mutex the thread does not hold");
+        abort();
+    }
+    *owner = -1;
+    wake_all(T_BLOCKED_MUTEX, m);
+}
+
+int sync_mutex_unlock(pthread_mutex_t *m)
+{
+    if (self < 0) return pthread_mutex_unlock(m);
+
+    pthread_mutex_lock(&S.lock);
+    release_locked(m);
+    yield_locked();
+    pthread_mutex_unlock(&S.lock);
+    return 0;
+}
+
+int sync_cond_wait(pthread_cond_t *c, pthread_mutex_t *m)
+{
+    if (self < 0) return pthread_cond_wait(c, m);
+
+    pthread_mutex_lock(&S.lock);
+    release_locked(m);
+    S.threads[self].state = T_BLOCKED_COND;
+    S.threads[self].obj = c;
+    yield_locked();
+    pthread_mutex_unlock(&S.lock);
+    return sync_mutex_lock(m);
+}
+
+int sync_cond_signal(pthread_cond_t *c)
+{
+    if (self < 0) return pthread_cond_signal(c);
+
+    pthread_mutex_lock(&S.lock);
+    int waiters[SCHED_MAX_THREADS];
+    int n = 0;
+    for (int i = 0; i < S.nthreads; i++)
+    {
+        if (S.threads[i].state == T_BLOCKED_COND && S.threads[i].obj == c)
+        {
+            waiters[n++] = i;
+        }
+    }
+    if (n > 0)
+    {
+        // Which waiter wakes up is part of the schedule too
+        int w = waiters[choose(n)];
+        S.threads[w].state = T_RUNNABLE;
+        S.threads[w].obj = NULL;
+    }
+    yield_locked();
+    pthread_mutex_unlock(&S.lock);
+    return 0;
+}
+
+int sync_cond_broadcast(pthread_cond_t *c)
+{
+    if (self < 0) return pthread_cond_broadcast(c);
+
+    pthread_mutex_lock(&S.lock);
+    wake_all(T_BLOCKED_COND, c);
+    yield_locked();
+    pthread_mutex_unlock(&S.lock);
+    return 0;
+}
+
+static void *trampoline(void *arg)
+{
+    int id = (int)(intptr_t)arg;
+    pthread_mutex_lock(&S.lock);
+    self = id;
+    while (S.current != self)
+    {
+        pthread_cond_wait(&S.threads[self].turn, &S.lock);
+    }
+    pthread_mutex_unlock(&S.lock);
+
+    S.threads[id].fn(S.threads[id].arg);
+
+    pthread_mutex_lock(&S.lock);
+    S.threads[id].state = T_DONE;
+    self = -1;
+    schedule();
+    pthread_mutex_unlock(&S.lock);
+    return NULL;
+}
+
+void sched_spawn(void *(*fn)(void *), void *arg)
+{
+    pthread_mutex_lock(&S.lock);
+    if (S.nthreads == SCHED_MAX_THREADS || S.active)
+    {
+        pthread_mutex_unlock(&S.lock);
+        fprintf(stderr, "detsched: cannot spawn more threads\n");
+        abort();
+    }
+    int id = S.nthreads++;
+    struct sthread *t = &S.threads[id];
+    t->state = T_RUNNABLE;
+    t->obj = NULL;
+    t->fn = fn;
+    t->arg = arg;
+    pthread_cond_init(&t->turn, NULL);
+    pthread_mutex_unlock(&S.lock);
+    pthread_create(&t->pt, NULL, trampoline, (void *)(intptr_t)id);
+}
+
+int sched_run(void)
+{
+    pthread_mutex_lock(&S.lock);
+    S.active = true;
+    schedule();
+    while (S.current != -1)
+    {
+        pthread_cond_wait(&S.finished, &S.lock);
+    }
+    S.active = false;
+    pthread_mutex_unlock(&S.lock);
+
+    for (int i = 0; i < S.nthreads; i++)
+    {
+        pthread_join(S.threads[i].pt, NULL);
+        pthread_cond_destroy(&S.threads[i].turn);
+    }
+    return S.nsteps;
+}
+
+/**
+ * @brief Resets per-run state and runs the body once
+ */
+static bool run_once(sched_body_fn body, void *ctx)
+{
+    S.nthreads = 0;
+    S.current = -1;
+    S.nsteps = 0;
+    S.truncated = false;
+    S.nmutexes = 0;
+    S.rng = S.seed * 0x9E3779B97F4A7C15ull + 1;
+    bool ok = body(ctx);
+    if (!ok)
+    {
+        report("check failed");
+    }
+    else if (S.truncated)
+    {
+        // The recorded choices stop at the limit, so they cannot replay it
+        fprintf(stderr, "detsched: step limit of %d reached, shrink the scenario\n", SCHED_MAX_STEPS);
+        ok = false;
+    }
+    return ok;
+}
+
+int64_t sched_explore_random(sched_body_fn body, void *ctx, uint64_t seed, int runs)
+{
+    S.mode = MODE_RANDOM;
+    S.prefix_len = 0;
+    for (int i = 0; i < runs; i++)
+    {
+        S.seed = seed + i;
+        if (!run_once(body, ctx))
+        {
+            return (int64_t)S.seed;
+        }
+    }
+    return -1;
+}
+
+bool sched_explore_dfs(sched_body_fn body, void *ctx, int max_runs, int *explored)
+{
+    S.mode = MODE_DFS;
+    S.prefix_len = 0;
+    int runs = 0;
+    while (runs < max_runs)
+    {
+        runs++;
+        if (!run_once(body, ctx))
+        {
+            *explored = runs;
+            return false;
+        }
+
+        // Backtrack to the deepest choice with an untried alternative
+        int i = S.nsteps - 1;
+        while (i >= 0 && S.choices[i] + 1 >= S.options[i])
+        {
+            i--;
+        }
+        if (i < 0)
+        {
+            break; // Every schedule has been tried
+        }
+        memcpy(S.prefix, S.choices, i * sizeof(int));
+        S.prefix[i] = S.choices[i] + 1;
+        S.prefix_len = i + 1;
+    }
+    *explored = runs;
+    return true;
+}
+
+bool sched_replay(sched_body_fn body, void *ctx, uint64_t seed)
+{
+    S.mode = MODE_RANDOM;
+    S.prefix_len = 0;
+    S.seed = seed;
+    return run_once(body, ctx);
+}
+
+bool sched_replay_choices(sched_body_fn body, void *ctx, const int *choices, int n)
+{
+    if (n < 0 || n > SCHED_MAX_STEPS)
+    {
+        return false;
+    }
+    S.mode = MODE_DFS;
+    memcpy(S.prefix, choices, n * sizeof(int));
+    S.prefix_len = n;
+    bool ok = run_once(body, ctx);
+    S.prefix_len = 0;
+    return ok;
+}
+
+int sched_last_choices(int *out, int max)
+{
+    int n = S.nsteps < max ? S.nsteps : max;
+    memcpy(out, S.choices, n * sizeof(int));
+    return n;
+}
+
+#endif
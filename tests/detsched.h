@@ -0,0 +1,77 @@
+#ifndef DETSCHED_H
+#define DETSCHED_H
+#include <stdint.h>
+#include <stdbool.h>
+
+// Deterministic scheduler for the -DQUEUE_SCHED build (make sched-check).
+//
+// Threads started with sched_spawn() run one at a time. Every mutex, condition
+// variable and atomic operation in src/sync.h is a scheduling point where the
+// scheduler picks the next thread to run, so a run is fully determined by its
+// sequence of choices. Choices come from a seeded PRNG (random exploration) or
+// from a replayed prefix (systematic depth-first exploration). A run in which
+// no thread can make progress is reported as a deadlock with the seed or
+// choice prefix that reproduces it. A run that needs more than
+// SCHED_MAX_STEPS choices fails too, since the choices past the limit can be
+// neither explored nor replayed.
+
+#define SCHED_MAX_THREADS 8
+#define SCHED_MAX_STEPS 4096
+
+/**
+ * @brief One scenario run: create the objects under test, sched_spawn() the
+ * threads, call sched_run(), then check the outcome
+ *
+ * @return true if the outcome was correct
+ */
+typedef bool (*sched_body_fn)(void *ctx);
+
+/**
+ * @brief Adds a managed thread to the current run. Call from the body only.
+ */
+void sched_spawn(void *(*fn)(void *), void *arg);
+
+/**
+ * @brief Runs all spawned threads to completion under the scheduler
+ *
+ * @return the number of scheduling decisions made
+ */
+int sched_run(void);
+
+/**
+ * @brief Runs the body once per seed in [seed, seed + runs)
+ *
+ * @return -1 if every run passed, otherwise the first failing seed
+ */
+int64_t sched_explore_random(sched_body_fn body, void *ctx, uint64_t seed, int runs);
+
+/**
+ * @brief Enumerates schedules depth first until all have been tried or
+ * max_runs is reached
+ *
+ * @param explored receives the number of schedules run
+ * @return true if no run failed or hit the step limit
+ */
+bool sched_explore_dfs(sched_body_fn body, void *ctx, int max_runs, int *explored);
+
+/**
+ * @brief Runs the body once with the schedule produced by seed
+ */
+bool sched_replay(sched_body_fn body, void *ctx, uint64_t seed);
+
+/**
+ * @brief Runs the body once following a recorded choice sequence, such as
+ * the one printed for a failing DFS run or returned by sched_last_choices().
+ * Choices past the end of the sequence take the first alternative.
+ */
+bool sched_replay_choices(sched_body_fn body, void *ctx, const int *choices, int n);
+
+/**
+ * @brief Copies the choices made by the most recent run, so a failing
+ * schedule from sched_explore_dfs() can be kept and replayed
+ *
+ * @return the number of choices copied
+ */
+int sched_last_choices(int *out, int max);
+
+#endif
@@ -0,0 +1,131 @@
+#include <string.h>
+#include "lincheck.h"
+
+/**
+ * @brief Sequential model of the queue used while searching
+ */
+struct model
+{
+    void *items[LC_MAX_OPS]; // Present items, oldest first
+    int n;
+    bool shutdown;
+    int rank;                // A dequeue may take any of the rank oldest items
+};
+
+void lc_reset(struct lc_history *h)
+{
+    memset(h, 0, sizeof(*h));
+}
+
+int lc_begin(struct lc_history *h, enum lc_type type, void *value)
+{
+    int op = __atomic_fetch_add(&h->n, 1, __ATOMIC_RELAXED);
+    if (op >= LC_MAX_OPS)
+    {
+        return -1;
+    }
+    h->ops[op].type = type;
+    h->ops[op].value = value;
+    h->ops[op].invoke = __atomic_fetch_add(&h->clock, 1, __ATOMIC_SEQ_CST);
+    return op;
+}
+
+void lc_end(struct lc_history *h, int op, void *value)
+{
+    if (op < 0) return;
+    if (h->ops[op].type == LC_DEQ)
+    {
+        h->ops[op].value = value;
+    }
+    h->ops[op].response = __atomic_fetch_add(&h->clock, 1, __ATOMIC_SEQ_CST);
+}
+
+/**
+ * @brief Applies op to the model
+ *
+ * @return false if the op's observed result is impossible in this state
+ */
+static bool apply(struct model *m, const struct lc_op *op)
+{
+    switch (op->type)
+    {
+    case LC_ENQ:
+        if (!m->shutdown)
+        {
+            m->items[m->n++] = op->value;
+        }
+        return true;
+    case LC_DEQ:
+        if (op->value == NULL)
+        {
+            return m->shutdown && m->n == 0;
+        }
+        for (int i = 0; i < m->n && i < m->rank; i++)
+        {
+            if (m->items[i] == op->value)
+            {
+                memmove(&m->items[i], &m->items[i + 1], (m->n - i - 1) * sizeof(void *));
+                m->n--;
+                return true;
+            }
+        }
+        return false;
+    case LC_SHUTDOWN:
+        m->shutdown = true;
+        return true;
+    }
+    return false;
+}
+
+/**
+ * @brief Wing and Gong style search: repeatedly pick an operation that no
+ * remaining operation finished before, apply it, and backtrack on mismatch.
+ */
+static bool search(const struct lc_history *h, uint64_t done, const struct model *m)
+{
+    uint64_t all = (1ull << h->n) - 1;
+    if (done == all)
+    {
+        return true;
+    }
+
+    uint64_t min_response = UINT64_MAX;
+    for (int i = 0; i < h->n; i++)
+    {
+        if (!(done & (1ull << i)) && h->ops[i].response < min_response)
+        {
+            min_response = h->ops[i].response;
+        }
+    }
+
+    for (int i = 0; i < h->n; i++)
+    {
+        if ((done & (1ull << i)) || h->ops[i].invoke > min_response)
+        {
+            continue;
+        }
+        struct model next = *m;
+        if (apply(&next, &h->ops[i]) && search(h, done | (1ull << i), &next))
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool lc_check_relaxed(const struct lc_history *h, int rank)
+{
+    if (h->n > LC_MAX_OPS || rank < 1)
+    {
+        return false;
+    }
+    struct model m;
+    memset(&m, 0, sizeof(m));
+    m.rank = rank;
+    return search(h, 0, &m);
+}
+
+bool lc_check_fifo(const struct lc_history *h)
+{
+    return lc_check_relaxed(h, 1);
+}
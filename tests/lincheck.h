@@ -0,0 +1,80 @@
+#ifndef LINCHECK_H
+#define LINCHECK_H
+#include <stdint.h>
+#include <stdbool.h>
+
+/**
+ * @brief Upper bound on the number of operations in a checked history
+ */
+#define LC_MAX_OPS 48
+
+/**
+ * @brief Kinds of queue operation recorded in a history
+ */
+enum lc_type
+{
+    LC_ENQ,      // enqueue(value)
+    LC_DEQ,      // dequeue() returned value, NULL means empty after shutdown
+    LC_SHUTDOWN  // queue_shutdown()
+};
+
+/**
+ * @brief One completed operation with its logical invoke and response times
+ */
+struct lc_op
+{
+    enum lc_type type;
+    void *value;
+    uint64_t invoke;
+    uint64_t response;
+};
+
+/**
+ * @brief A history of operations recorded by many threads. Times come from a
+ * shared atomic counter so they respect real-time order across threads.
+ */
+struct lc_history
+{
+    struct lc_op ops[LC_MAX_OPS];
+    int n;
+    uint64_t clock;
+};
+
+/**
+ * @brief Clears a history
+ */
+void lc_reset(struct lc_history *h);
+
+/**
+ * @brief Records the invocation of an operation
+ *
+ * @return handle to pass to lc_end, -1 if the history is full
+ */
+int lc_begin(struct lc_history *h, enum lc_type type, void *value);
+
+/**
+ * @brief Records the response of an operation started with lc_begin
+ *
+ * @param value the result for LC_DEQ, ignored otherwise
+ */
+void lc_end(struct lc_history *h, int op, void *value);
+
+/**
+ * @brief Checks that the history is linearizable with respect to a bounded
+ * blocking FIFO queue with shutdown: enqueue after shutdown is dropped,
+ * dequeue returns NULL only when the queue is empty and shut down.
+ *
+ * @return true if some linearization exists
+ */
+bool lc_check_fifo(const struct lc_history *h);
+
+/**
+ * @brief Like lc_check_fifo() but a dequeue may return any of the rank
+ * oldest items present. Rank 1 is FIFO; LC_MAX_OPS makes the model a bag,
+ * which still rejects lost, duplicated and invented items and early NULLs.
+ *
+ * @return true if some linearization exists
+ */
+bool lc_check_relaxed(const struct lc_history *h, int rank);
+
+#endif
@@ -1,7 +1,28 @@
 #include "harness/unity.h"
 #include "../src/lab.h"
+#include "../src/dispatch.h"
+#include "../src/multiqueue.h"
+#include "../src/trace.h"
+#include "../src/stream.h"
+#include "../src/subscribe.h"
+#include "../src/conflate.h"
+#include "../src/qpool.h"
+#include "../src/percore.h"
+#include "../src/rpc.h"
+#include "../src/arena.h"
+#include "../src/lanes.h"
+#include "../src/clock.h"
+#include "../src/merge.h"
+#include "../src/workpool.h"
+#include "../src/sketch.h"
+#include "test-stress.h"
+#include "test-sched.h"
 #include <stdlib.h> // For malloc/free in some tests if needed
 #include <stdio.h>  // For printf in debugging if needed
+#include <pthread.h>
+#include <sched.h>
+#include <time.h>
+#include <string.h>
 
 // NOTE: Due to the multi-threaded nature of this project. Unit testing for this
 // project is limited. I have provided you with a command line tester in
@@ -232,10 +253,1283 @@ void test_init_zero_capacity(void) {
   TEST_ASSERT_NULL(q); // Assert that init fails for negative capacity
 }
 
+void test_dequeue_batch(void)
+{
+    queue_t q = queue_init(10);
+    TEST_ASSERT_NOT_NULL(q);
+    int data[5];
+    void *out[8];
+    for (int i = 0; i < 5; i++) {
+        enqueue(q, &data[i]);
+    }
+    TEST_ASSERT_EQUAL_INT(3, dequeue_batch(q, out, 3));
+    for (int i = 0; i < 3; i++) {
+        TEST_ASSERT_EQUAL_PTR(&data[i], out[i]);
+    }
+    TEST_ASSERT_EQUAL_INT(2, dequeue_batch(q, out, 8));
+    TEST_ASSERT_EQUAL_PTR(&data[3], out[0]);
+    TEST_ASSERT_EQUAL_PTR(&data[4], out[1]);
+    queue_shutdown(q);
+    TEST_ASSERT_EQUAL_INT(0, dequeue_batch(q, out, 8));
+    queue_destroy(q);
+}
+
+void test_consumer_batch_order_and_flush(void)
+{
+    queue_t q = queue_init(4);
+    TEST_ASSERT_NOT_NULL(q);
+    queue_set_consumer_batch(q, 4);
+    int data[4];
+    for (int i = 0; i < 4; i++) {
+        enqueue(q, &data[i]);
+    }
+    // The first dequeue pulls everything into this thread's cache
+    TEST_ASSERT_EQUAL_PTR(&data[0], dequeue(q));
+    TEST_ASSERT_TRUE(is_empty(q));
+    // Refill to capacity, then hand the cached items back in front
+    int more = 0;
+    enqueue(q, &more);
+    TEST_ASSERT_EQUAL_INT(3, queue_consumer_flush(q));
+    TEST_ASSERT_FALSE(is_empty(q));
+    queue_set_consumer_batch(q, 0);
+    TEST_ASSERT_EQUAL_PTR(&data[1], dequeue(q));
+    TEST_ASSERT_EQUAL_PTR(&data[2], dequeue(q));
+    TEST_ASSERT_EQUAL_PTR(&data[3], dequeue(q));
+    TEST_ASSERT_EQUAL_PTR(&more, dequeue(q));
+    TEST_ASSERT_TRUE(is_empty(q));
+    queue_destroy(q);
+}
+
+void test_consumer_batch_drains_after_shutdown(void)
+{
+    queue_t q = queue_init(8);
+    TEST_ASSERT_NOT_NULL(q);
+    queue_set_consumer_batch(q, 8);
+    int data[3];
+    for (int i = 0; i < 3; i++) {
+        enqueue(q, &data[i]);
+    }
+    TEST_ASSERT_EQUAL_PTR(&data[0], dequeue(q));
+    queue_shutdown(q);
+    TEST_ASSERT_EQUAL_PTR(&data[1], dequeue(q));
+    TEST_ASSERT_EQUAL_PTR(&data[2], dequeue(q));
+    TEST_ASSERT_NULL(dequeue(q));
+    queue_destroy(q);
+}
+
+static void *take_one(void *arg)
+{
+    return dequeue((queue_t)arg);
+}
+
+void test_consumer_batch_returns_on_thread_exit(void)
+{
+    queue_t q = queue_init(8);
+    TEST_ASSERT_NOT_NULL(q);
+    queue_set_consumer_batch(q, 8);
+    int data[3];
+    for (int i = 0; i < 3; i++) {
+        enqueue(q, &data[i]);
+    }
+    pthread_t t;
+    void *got = NULL;
+    pthread_create(&t, NULL, take_one, q);
+    pthread_join(t, &got);
+    TEST_ASSERT_EQUAL_PTR(&data[0], got);
+    // The exiting thread pushed its two leftovers back
+    queue_set_consumer_batch(q, 0);
+    TEST_ASSERT_EQUAL_PTR(&data[1], dequeue(q));
+    TEST_ASSERT_EQUAL_PTR(&data[2], dequeue(q));
+    TEST_ASSERT_TRUE(is_empty(q));
+    queue_destroy(q);
+}
+
+/**
+ * @brief A consumer that takes one item, keeping the rest of its batch
+ * cached, and only exits once released
+ */
+struct parked_consumer
+{
+    queue_t q;
+    void *got;
+    bool taken;
+    bool release;
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+};
+
+static void *take_one_and_park(void *arg)
+{
+    struct parked_consumer *p = (struct parked_consumer *)arg;
+    p->got = dequeue(p->q);
+    pthread_mutex_lock(&p->mutex);
+    p->taken = true;
+    pthread_cond_broadcast(&p->cond);
+    while (!p->release) {
+        pthread_cond_wait(&p->cond, &p->mutex);
+    }
+    pthread_mutex_unlock(&p->mutex);
+    return NULL; // Thread exit hands the cache back, if its queue still exists
+}
+
+static void park_start(struct parked_consumer *p, pthread_t *t)
+{
+    pthread_mutex_init(&p->mutex, NULL);
+    pthread_cond_init(&p->cond, NULL);
+    pthread_create(t, NULL, take_one_and_park, p);
+    pthread_mutex_lock(&p->mutex);
+    while (!p->taken) {
+        pthread_cond_wait(&p->cond, &p->mutex);
+    }
+    pthread_mutex_unlock(&p->mutex);
+}
+
+static void park_release(struct parked_consumer *p, pthread_t t)
+{
+    pthread_mutex_lock(&p->mutex);
+    p->release = true;
+    pthread_cond_broadcast(&p->cond);
+    pthread_mutex_unlock(&p->mutex);
+    pthread_join(t, NULL);
+    pthread_mutex_destroy(&p->mutex);
+    pthread_cond_destroy(&p->cond);
+}
+
+void test_consumer_batch_destroy_before_exit(void)
+{
+    struct parked_consumer p = {.q = queue_init(8)};
+    TEST_ASSERT_NOT_NULL(p.q);
+    queue_set_consumer_batch(p.q, 8);
+    int data[3];
+    for (int i = 0; i < 3; i++) {
+        enqueue(p.q, &data[i]);
+    }
+    pthread_t t;
+    park_start(&p, &t);
+    TEST_ASSERT_EQUAL_PTR(&data[0], p.got);
+    // The parked thread still caches two items; destroy disowns them, so
+    // its exit must not touch the freed queue
+    queue_destroy(p.q);
+    park_release(&p, t);
+}
+
+void test_consumer_batch_requeue_over_capacity(void)
+{
+    struct parked_consumer p = {.q = queue_init(2)};
+    TEST_ASSERT_NOT_NULL(p.q);
+    queue_set_consumer_batch(p.q, 2);
+    int data[6];
+    enqueue(p.q, &data[0]);
+    enqueue(p.q, &data[1]);
+    pthread_t t;
+    park_start(&p, &t);
+    TEST_ASSERT_EQUAL_PTR(&data[0], p.got);
+    // Refill while data[1] is cached, then let the thread hand it back
+    enqueue(p.q, &data[2]);
+    enqueue(p.q, &data[3]);
+    park_release(&p, t);
+    TEST_ASSERT_EQUAL_INT(3, queue_size(p.q));
+
+    queue_set_consumer_batch(p.q, 0);
+    for (int i = 1; i < 4; i++) {
+        TEST_ASSERT_EQUAL_PTR(&data[i], dequeue(p.q));
+    }
+    // Back within capacity, the queue wraps around normally again
+    enqueue(p.q, &data[4]);
+    enqueue(p.q, &data[5]);
+    TEST_ASSERT_EQUAL_PTR(&data[4], dequeue(p.q));
+    TEST_ASSERT_EQUAL_PTR(&data[5], dequeue(p.q));
+    TEST_ASSERT_TRUE(is_empty(p.q));
+    queue_destroy(p.q);
+}
+
+
+void test_queue_size(void)
+{
+    queue_t q = queue_init(4);
+    TEST_ASSERT_NOT_NULL(q);
+    int d1 = 1, d2 = 2;
+    TEST_ASSERT_EQUAL_INT(0, queue_size(q));
+    enqueue(q, &d1);
+    enqueue(q, &d2);
+    TEST_ASSERT_EQUAL_INT(2, queue_size(q));
+    dequeue(q);
+    TEST_ASSERT_EQUAL_INT(1, queue_size(q));
+    queue_destroy(q);
+}
+
+void test_dispatch_prefers_shorter_queue(void)
+{
+    queue_t qs[2] = {queue_init(8), queue_init(8)};
+    int data[4];
+    enqueue(qs[0], &data[0]);
+    enqueue(qs[0], &data[1]);
+
+    // With two queues, two-choices always compares both
+    dispatcher_t d = dispatcher_init(qs, 2, DISPATCH_TWO_CHOICES);
+    TEST_ASSERT_NOT_NULL(d);
+    TEST_ASSERT_EQUAL_INT(1, dispatch(d, &data[2]));
+    dispatcher_destroy(d);
+
+    d = dispatcher_init(qs, 2, DISPATCH_SHORTEST);
+    TEST_ASSERT_EQUAL_INT(1, dispatch(d, &data[3]));
+    TEST_ASSERT_EQUAL_INT(2, queue_size(qs[1]));
+    dispatcher_destroy(d);
+
+    TEST_ASSERT_NULL(dispatcher_init(qs, 0, DISPATCH_ROUND_ROBIN));
+    queue_destroy(qs[0]);
+    queue_destroy(qs[1]);
+}
+
+void test_multiqueue_no_loss(void)
+{
+    multiqueue_t mq = multiqueue_init(64, 2, 2);
+    TEST_ASSERT_NOT_NULL(mq);
+    int data[50];
+    bool seen[50] = {false};
+    for (int i = 0; i < 50; i++) {
+        multiqueue_enqueue(mq, &data[i]);
+    }
+    TEST_ASSERT_EQUAL_INT(50, multiqueue_size(mq));
+    for (int i = 0; i < 50; i++) {
+        int *item = (int *)multiqueue_dequeue(mq);
+        TEST_ASSERT_NOT_NULL(item);
+        TEST_ASSERT_FALSE(seen[item - data]);
+        seen[item - data] = true;
+    }
+    TEST_ASSERT_TRUE(multiqueue_is_empty(mq));
+    multiqueue_shutdown(mq);
+    TEST_ASSERT_TRUE(multiqueue_is_shutdown(mq));
+    TEST_ASSERT_NULL(multiqueue_dequeue(mq));
+    multiqueue_destroy(mq);
+}
+
+void test_multiqueue_shutdown_drains(void)
+{
+    multiqueue_t mq = multiqueue_init(4, 1, 1);
+    TEST_ASSERT_NOT_NULL(mq);
+    int d1 = 1, d2 = 2;
+    multiqueue_enqueue(mq, &d1);
+    multiqueue_shutdown(mq);
+    multiqueue_enqueue(mq, &d2); // Ignored after shutdown
+    TEST_ASSERT_EQUAL_PTR(&d1, multiqueue_dequeue(mq));
+    TEST_ASSERT_NULL(multiqueue_dequeue(mq));
+    multiqueue_destroy(mq);
+    TEST_ASSERT_NULL(multiqueue_init(0, 1, 1));
+}
+
+void test_trace_round_trip(void)
+{
+    trace_t t = trace_init(3);
+    TEST_ASSERT_NOT_NULL(t);
+    queue_t q = queue_init(4);
+    queue_set_trace(q, t, 7);
+    int d1 = 1, d2 = 2;
+    void *out[2];
+    enqueue(q, &d1);
+    enqueue(q, &d2);
+    TEST_ASSERT_EQUAL_INT(2, dequeue_batch(q, out, 2));
+    queue_set_trace(q, NULL, 0);
+    enqueue(q, &d1); // Not recorded
+    TEST_ASSERT_EQUAL_size_t(0, trace_dropped(t));
+
+    FILE *f = tmpfile();
+    TEST_ASSERT_NOT_NULL(f);
+    TEST_ASSERT_EQUAL_INT(3, trace_write(t, f));
+    rewind(f);
+    struct trace_rec *recs = NULL;
+    TEST_ASSERT_EQUAL_INT(3, trace_read(f, &recs));
+    fclose(f);
+
+    TEST_ASSERT_EQUAL_UINT8(TRACE_ENQ, recs[0].op);
+    TEST_ASSERT_EQUAL_UINT32(1, recs[0].depth);
+    TEST_ASSERT_EQUAL_UINT32(2, recs[1].depth);
+    TEST_ASSERT_EQUAL_UINT8(TRACE_DEQ, recs[2].op);
+    TEST_ASSERT_EQUAL_UINT8(2, recs[2].count);
+    TEST_ASSERT_EQUAL_UINT32(0, recs[2].depth);
+    TEST_ASSERT_EQUAL_UINT16(7, recs[2].queue);
+    TEST_ASSERT_TRUE(recs[0].ts_ns <= recs[2].ts_ns);
+    free(recs);
+
+    // One more record does not fit
+    trace_record(t, 0, TRACE_ENQ, 1, 1);
+    TEST_ASSERT_EQUAL_size_t(1, trace_dropped(t));
+    trace_destroy(t);
+    queue_destroy(q);
+}
+
+void test_trace_splits_large_batches(void)
+{
+    trace_t t = trace_init(16);
+    queue_t q = queue_init(600);
+    queue_set_trace(q, t, 0);
+    static void *items[600];
+    TEST_ASSERT_EQUAL_INT(600, enqueue_batch(q, items, 600));
+    TEST_ASSERT_EQUAL_INT(600, dequeue_batch(q, items, 600));
+
+    FILE *f = tmpfile();
+    TEST_ASSERT_NOT_NULL(f);
+    TEST_ASSERT_EQUAL_INT(6, trace_write(t, f));
+    rewind(f);
+    struct trace_rec *recs = NULL;
+    TEST_ASSERT_EQUAL_INT(6, trace_read(f, &recs));
+    fclose(f);
+    // Replay sees every item go in and come out
+    int in = 0, out = 0;
+    for (int i = 0; i < 6; i++)
+    {
+        if (recs[i].op == TRACE_ENQ) in += recs[i].count;
+        else out += recs[i].count;
+    }
+    TEST_ASSERT_EQUAL_INT(600, in);
+    TEST_ASSERT_EQUAL_INT(600, out);
+    // Records sharing a timestamp keep the order they were recorded in
+    const uint32_t depths[6] = {255, 510, 600, 345, 90, 0};
+    for (int i = 0; i < 6; i++)
+    {
+        TEST_ASSERT_EQUAL_UINT32(depths[i], recs[i].depth);
+    }
+    free(recs);
+    trace_destroy(t);
+    queue_destroy(q);
+}
+
+void test_queue_capacity(void)
+{
+    queue_t q = queue_init(7);
+    TEST_ASSERT_NOT_NULL(q);
+    TEST_ASSERT_EQUAL_INT(7, queue_capacity(q));
+    TEST_ASSERT_EQUAL_INT(0, queue_capacity(NULL));
+    queue_destroy(q);
+}
+
+void test_waiting_consumers(void)
+{
+    queue_t q = queue_init(2);
+    TEST_ASSERT_NOT_NULL(q);
+    TEST_ASSERT_EQUAL_INT(0, queue_waiting_consumers(q));
+    pthread_t t;
+    pthread_create(&t, NULL, take_one, q);
+    // Wait for the consumer to block on the empty queue
+    while (queue_waiting_consumers(q) == 0) {
+        sched_yield();
+    }
+    TEST_ASSERT_EQUAL_INT(1, queue_waiting_consumers(q));
+    TEST_ASSERT_EQUAL_INT(0, queue_waiting_producers(q));
+    int data = 1;
+    enqueue(q, &data);
+    void *got = NULL;
+    pthread_join(t, &got);
+    TEST_ASSERT_EQUAL_PTR(&data, got);
+    TEST_ASSERT_EQUAL_INT(0, queue_waiting_consumers(q));
+    queue_destroy(q);
+}
+
+void test_enqueue_batch(void)
+{
+    queue_t q = queue_init(4);
+    TEST_ASSERT_NOT_NULL(q);
+    int data[3];
+    void *in[3] = {&data[0], &data[1], &data[2]};
+    TEST_ASSERT_EQUAL_INT(3, enqueue_batch(q, in, 3));
+    TEST_ASSERT_EQUAL_INT(3, queue_size(q));
+    for (int i = 0; i < 3; i++) {
+        TEST_ASSERT_EQUAL_PTR(&data[i], dequeue(q));
+    }
+    queue_shutdown(q);
+    TEST_ASSERT_EQUAL_INT(0, enqueue_batch(q, in, 3));
+    queue_destroy(q);
+}
+
+void test_batch_controller(void)
+{
+    queue_t q = queue_init(64);
+    TEST_ASSERT_NOT_NULL(q);
+    TEST_ASSERT_EQUAL_INT(1, queue_batch_size(q));
+    // A generous target: a deep backlog grows the batch one step per dequeue
+    TEST_ASSERT_EQUAL_INT(0, queue_set_batch_target(q, 1000000000ull, 8));
+    int data[64];
+    void *out[64];
+    for (int i = 0; i < 64; i++) {
+        enqueue(q, &data[i]);
+    }
+    TEST_ASSERT_EQUAL_INT(2, dequeue_batch(q, out, 64));
+    TEST_ASSERT_EQUAL_INT(2, queue_batch_size(q));
+    TEST_ASSERT_EQUAL_INT(3, dequeue_batch(q, out, 64));
+    for (int i = 0; i < 5; i++) {
+        dequeue_batch(q, out, 64); // 4, 5, 6, 7, 8 items
+    }
+    TEST_ASSERT_EQUAL_INT(8, queue_batch_size(q)); // Capped at max_batch
+
+    // A target every item misses halves the batch on each dequeue
+    TEST_ASSERT_EQUAL_INT(0, queue_set_batch_target(q, 1, 8));
+    enqueue(q, &data[0]);
+    enqueue(q, &data[1]);
+    struct timespec s = {0, 1000000};
+    nanosleep(&s, NULL);
+    TEST_ASSERT_TRUE(dequeue_batch(q, out, 64) >= 1);
+    TEST_ASSERT_TRUE(queue_batch_size(q) <= 4);
+
+    TEST_ASSERT_EQUAL_INT(0, queue_set_batch_target(q, 0, 0));
+    TEST_ASSERT_EQUAL_INT(1, queue_batch_size(q));
+    queue_destroy(q);
+}
+
+void test_queue_stats_little(void)
+{
+    queue_t q = queue_init(8);
+    TEST_ASSERT_NOT_NULL(q);
+    struct queue_stats st;
+    TEST_ASSERT_EQUAL_INT(-1, queue_stats_sample(q, 1, &st));
+    TEST_ASSERT_EQUAL_INT(0, queue_set_stats(q, true));
+    int data[4];
+    for (int i = 0; i < 4; i++) {
+        enqueue(q, &data[i]);
+    }
+    struct timespec s = {0, 2000000};
+    nanosleep(&s, NULL);
+    for (int i = 0; i < 4; i++) {
+        TEST_ASSERT_EQUAL_PTR(&data[i], dequeue(q));
+    }
+    TEST_ASSERT_EQUAL_INT(0, queue_stats_sample(q, 1, &st));
+    TEST_ASSERT_EQUAL_UINT64(4, st.arrivals);
+    TEST_ASSERT_EQUAL_UINT64(4, st.departures);
+    TEST_ASSERT_TRUE(st.mean_sojourn_ns >= 2000000);
+    TEST_ASSERT_TRUE(st.mean_depth > 0 && st.mean_depth <= 4);
+    // The window starts and ends empty, so depth-time equals total sojourn
+    TEST_ASSERT_TRUE(st.little_error > -0.01 && st.little_error < 0.01);
+    TEST_ASSERT_TRUE(st.busy_fraction == 1.0); // Nobody blocked on empty
+
+    // Disabling the batch controller keeps the stamps the analytics need
+    TEST_ASSERT_EQUAL_INT(0, queue_set_batch_target(q, 1000000, 4));
+    TEST_ASSERT_EQUAL_INT(0, queue_set_batch_target(q, 0, 0));
+    enqueue(q, &data[0]);
+    dequeue(q);
+    TEST_ASSERT_EQUAL_INT(0, queue_stats_sample(q, 0, &st));
+    TEST_ASSERT_EQUAL_UINT64(1, st.departures);
+    TEST_ASSERT_TRUE(st.utilization == 0); // Needs the consumer count
+
+    TEST_ASSERT_EQUAL_INT(0, queue_set_stats(q, false));
+    TEST_ASSERT_EQUAL_INT(-1, queue_stats_sample(q, 1, &st));
+    queue_destroy(q);
+}
+
+void test_queue_stats_idle_consumer(void)
+{
+    queue_t q = queue_init(2);
+    TEST_ASSERT_NOT_NULL(q);
+    TEST_ASSERT_EQUAL_INT(0, queue_set_stats(q, true));
+    pthread_t t;
+    pthread_create(&t, NULL, take_one, q);
+    while (queue_waiting_consumers(q) == 0) {
+        sched_yield();
+    }
+    struct timespec s = {0, 2000000};
+    nanosleep(&s, NULL);
+    int data = 1;
+    enqueue(q, &data);
+    pthread_join(t, NULL);
+    struct queue_stats st;
+    TEST_ASSERT_EQUAL_INT(0, queue_stats_sample(q, 1, &st));
+    // The only consumer spent most of the window blocked on empty
+    TEST_ASSERT_TRUE(st.mean_idle_consumers > 0.5);
+    TEST_ASSERT_TRUE(st.busy_fraction < 0.5);
+    TEST_ASSERT_TRUE(st.service_rate > 0);
+    queue_destroy(q);
+}
+
+struct sub_count
+{
+    long items;
+    long calls;
+    int largest;
+};
+
+static void count_handler(void **items, int n, void *ctx)
+{
+    struct sub_count *c = (struct sub_count *)ctx;
+    (void)items;
+    __atomic_fetch_add(&c->items, n, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&c->calls, 1, __ATOMIC_RELAXED);
+    int largest = __atomic_load_n(&c->largest, __ATOMIC_RELAXED);
+    while (n > largest &&
+           !__atomic_compare_exchange_n(&c->largest, &largest, n, false,
+                                        __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+    }
+}
+
+void test_subscribe_batches_and_drains(void)
+{
+    queue_t q = queue_init(128);
+    TEST_ASSERT_NOT_NULL(q);
+    struct sub_count c = {0, 0, 0};
+    TEST_ASSERT_NULL(queue_subscribe(q, count_handler, &c, 0, 1));
+    int data[200];
+    for (int i = 0; i < 100; i++) {
+        enqueue(q, &data[i]);
+    }
+    subscription_t s = queue_subscribe(q, count_handler, &c, 8, 2);
+    TEST_ASSERT_NOT_NULL(s);
+    for (int i = 100; i < 200; i++) {
+        enqueue(q, &data[i]);
+    }
+    queue_unsubscribe(s); // Everything enqueued before this is handled
+    TEST_ASSERT_TRUE(is_shutdown(q));
+    TEST_ASSERT_EQUAL_INT64(200, c.items);
+    TEST_ASSERT_TRUE(c.largest <= 8);
+    TEST_ASSERT_TRUE(c.calls >= 200 / 8);
+    queue_destroy(q);
+}
+
+void test_conflate_latest_value(void)
+{
+    TEST_ASSERT_NULL(conflate_init(0));
+    conflate_t c = conflate_init(sizeof(int));
+    TEST_ASSERT_NOT_NULL(c);
+    int v = -1;
+    TEST_ASSERT_EQUAL_UINT64(0, conflate_read(c, &v));
+    for (int i = 1; i <= 5; i++) {
+        TEST_ASSERT_EQUAL_UINT64(i, conflate_publish(c, &i));
+    }
+    // Readers only ever see the newest value
+    TEST_ASSERT_EQUAL_UINT64(5, conflate_read(c, &v));
+    TEST_ASSERT_EQUAL_INT(5, v);
+    TEST_ASSERT_EQUAL_UINT64(5, conflate_wait(c, 2, &v));
+    conflate_close(c);
+    TEST_ASSERT_EQUAL_UINT64(0, conflate_wait(c, 5, &v));
+    TEST_ASSERT_EQUAL_UINT64(5, conflate_read(c, &v));
+    conflate_destroy(c);
+}
+
+#define BIG_WORDS 37 // Larger than CONFLATE_SMALL_VALUE, not a whole cache line
+
+struct big_value
+{
+    uint64_t w[BIG_WORDS];
+    uint8_t tail; // Size is not a multiple of 8 bytes
+};
+
+static void *conflate_writer(void *arg)
+{
+    conflate_t c = (conflate_t)arg;
+    struct big_value b;
+    for (uint64_t n = 1; n <= 20000; n++) {
+        for (int i = 0; i < BIG_WORDS; i++) {
+            b.w[i] = n;
+        }
+        b.tail = (uint8_t)n;
+        conflate_publish(c, &b);
+    }
+    conflate_close(c);
+    return NULL;
+}
+
+void test_conflate_no_torn_reads(void)
+{
+    size_t sizes[2] = {sizeof(uint64_t) * 4, sizeof(struct big_value)}; // One slot, three slots
+    for (int k = 0; k < 2; k++) {
+        conflate_t c = conflate_init(sizes[k]);
+        TEST_ASSERT_NOT_NULL(c);
+        pthread_t t;
+        pthread_create(&t, NULL, conflate_writer, c);
+        struct big_value b;
+        uint64_t seen = 0, version;
+        int words = k == 0 ? 4 : BIG_WORDS;
+        while ((version = conflate_wait(c, seen, &b)) != 0) {
+            TEST_ASSERT_TRUE(version > seen);
+            TEST_ASSERT_EQUAL_UINT64(version, b.w[0]);
+            for (int i = 1; i < words; i++) {
+                TEST_ASSERT_EQUAL_UINT64(b.w[0], b.w[i]);
+            }
+            if (k == 1) {
+                TEST_ASSERT_EQUAL_UINT8((uint8_t)version, b.tail);
+            }
+            seen = version;
+        }
+        pthread_join(t, NULL);
+        TEST_ASSERT_EQUAL_UINT64(20000, conflate_read(c, &b));
+        conflate_destroy(c);
+    }
+}
+
+void test_queue_reset(void)
+{
+    queue_t q = queue_init(2);
+    TEST_ASSERT_NOT_NULL(q);
+    int data[2];
+    enqueue(q, &data[0]);
+    enqueue(q, &data[1]);
+    queue_set_consumer_batch(q, 4);
+    TEST_ASSERT_EQUAL_INT(0, queue_set_stats(q, true));
+    queue_shutdown(q);
+    TEST_ASSERT_EQUAL_INT(0, queue_reset(q));
+    TEST_ASSERT_FALSE(is_shutdown(q));
+    TEST_ASSERT_TRUE(is_empty(q));
+    struct queue_stats st;
+    TEST_ASSERT_EQUAL_INT(-1, queue_stats_sample(q, 1, &st));
+    // Usable to full capacity again, in FIFO order
+    enqueue(q, &data[1]);
+    enqueue(q, &data[0]);
+    TEST_ASSERT_EQUAL_PTR(&data[1], dequeue(q));
+    TEST_ASSERT_EQUAL_PTR(&data[0], dequeue(q));
+    queue_destroy(q);
+}
+
+static void *pool_churn(void *arg)
+{
+    queue_pool_t p = (queue_pool_t)arg;
+    queue_t held[QUEUE_POOL_CACHE + 2];
+    for (int i = 0; i < QUEUE_POOL_CACHE + 2; i++) {
+        held[i] = queue_pool_get(p);
+    }
+    for (int i = 0; i < QUEUE_POOL_CACHE + 2; i++) {
+        queue_pool_put(p, held[i]);
+    }
+    return NULL;
+}
+
+void test_queue_pool_recycles(void)
+{
+    TEST_ASSERT_NULL(queue_pool_init(0, 4));
+    queue_pool_t p = queue_pool_init(4, 16);
+    TEST_ASSERT_NOT_NULL(p);
+    queue_t q = queue_pool_get(p);
+    TEST_ASSERT_NOT_NULL(q);
+    int data = 1;
+    enqueue(q, &data);
+    queue_shutdown(q);
+    queue_pool_put(p, q);
+    // The calling thread's cache hands the same queue back, fresh
+    queue_t again = queue_pool_get(p);
+    TEST_ASSERT_EQUAL_PTR(q, again);
+    TEST_ASSERT_TRUE(is_empty(again));
+    TEST_ASSERT_FALSE(is_shutdown(again));
+    TEST_ASSERT_EQUAL_INT(4, queue_capacity(again));
+    queue_pool_put(p, again);
+
+    // Queues of another capacity are not pooled
+    TEST_ASSERT_EQUAL_INT(0, queue_pool_put(p, queue_init(8)));
+
+    // A queue a thread is still blocked on is refused and left intact
+    queue_t busy = queue_init(4);
+    pthread_t waiter;
+    pthread_create(&waiter, NULL, take_one, busy);
+    while (queue_waiting_consumers(busy) == 0) {
+        sched_yield();
+    }
+    TEST_ASSERT_EQUAL_INT(-1, queue_pool_put(p, busy));
+    queue_shutdown(busy);
+    pthread_join(waiter, NULL);
+    TEST_ASSERT_EQUAL_INT(0, queue_pool_put(p, busy));
+
+    // Queues cached by a thread that exits go back to the shared list
+    pthread_t t;
+    pthread_create(&t, NULL, pool_churn, p);
+    pthread_join(t, NULL);
+    queue_t held[QUEUE_POOL_CACHE];
+    for (int i = 0; i < QUEUE_POOL_CACHE; i++) {
+        held[i] = queue_pool_get(p);
+        TEST_ASSERT_NOT_NULL(held[i]);
+    }
+    for (int i = 0; i < QUEUE_POOL_CACHE; i++) {
+        queue_pool_put(p, held[i]);
+    }
+    queue_pool_destroy(p);
+}
+
+#define MESH_CORES 3
+#define MESH_MSGS 500
+
+struct mesh_count
+{
+    long received[MESH_CORES]; // Written only by the receiving core
+    long replies[MESH_CORES];
+};
+
+static void mesh_handler(percore_t p, int self, int from, void *msg, void *ctx)
+{
+    struct mesh_count *c = (struct mesh_count *)ctx;
+    if ((intptr_t)msg == 2) {
+        c->replies[self]++;
+        return;
+    }
+    c->received[self]++;
+    // Replies are sent from the handler, some after every main has returned
+    percore_send(p, self, from, (void *)(intptr_t)2);
+}
+
+static void mesh_main(percore_t p, int self, void *ctx)
+{
+    (void)ctx;
+    for (int i = 0; i < MESH_MSGS; i++) {
+        for (int to = 0; to < percore_count(p); to++) {
+            if (to != self) {
+                percore_send(p, self, to, (void *)(intptr_t)1);
+            }
+        }
+        percore_poll(p, self, 8);
+    }
+}
+
+void test_percore_mesh_delivers_all(void)
+{
+    struct mesh_count c;
+    memset(&c, 0, sizeof(c));
+    TEST_ASSERT_NULL(percore_init(0, 4, NULL, mesh_handler, &c));
+    percore_t p = percore_init(MESH_CORES, 4, NULL, mesh_handler, &c); // Tiny rings force backpressure
+    TEST_ASSERT_NOT_NULL(p);
+    TEST_ASSERT_EQUAL_INT(0, percore_run(p, mesh_main, NULL));
+    for (int i = 0; i < MESH_CORES; i++) {
+        TEST_ASSERT_EQUAL_INT64(MESH_MSGS * (MESH_CORES - 1), c.received[i]);
+        TEST_ASSERT_EQUAL_INT64(MESH_MSGS * (MESH_CORES - 1), c.replies[i]);
+    }
+    percore_destroy(p);
+}
+
+static void *rpc_double(void *request, void *ctx)
+{
+    (void)ctx;
+    return (void *)((intptr_t)request * 2);
+}
+
+void test_rpc_pipelined_calls(void)
+{
+    TEST_ASSERT_NULL(rpc_init(4, 0, rpc_double, NULL, 1, 1));
+    rpc_t r = rpc_init(4, 8, rpc_double, NULL, 2, 4);
+    TEST_ASSERT_NOT_NULL(r);
+    TEST_ASSERT_EQUAL_INT(42, (intptr_t)rpc_call(r, (void *)21));
+
+    // Eight calls in flight, replies collected newest first
+    rpc_call_t calls[8];
+    for (intptr_t i = 0; i < 8; i++) {
+        calls[i] = rpc_send(r, (void *)(i + 1));
+        TEST_ASSERT_NOT_NULL(calls[i]);
+    }
+    for (int i = 7; i >= 0; i--) {
+        TEST_ASSERT_EQUAL_INT(2 * (i + 1), (intptr_t)rpc_wait(r, calls[i]));
+    }
+
+    // A batch larger than the number of reply slots goes out in groups
+    void *req[50], *rep[50];
+    for (intptr_t i = 0; i < 50; i++) {
+        req[i] = (void *)i;
+    }
+    TEST_ASSERT_EQUAL_INT(50, rpc_call_batch(r, req, rep, 50));
+    for (int i = 0; i < 50; i++) {
+        TEST_ASSERT_EQUAL_INT(2 * i, (intptr_t)rep[i]);
+    }
+    rpc_destroy(r);
+}
+
+void test_arena_recycles_sealed_region(void)
+{
+    TEST_ASSERT_NULL(arena_init(5000, 1)); // Not a power of two
+    arena_t a = arena_init(4096, 1);
+    TEST_ASSERT_NOT_NULL(a);
+    TEST_ASSERT_NULL(arena_alloc(a, 4096)); // Never fits next to the header
+    char *p1 = (char *)arena_alloc(a, 10);
+    char *p2 = (char *)arena_alloc(a, 10);
+    TEST_ASSERT_NOT_NULL(p1);
+    TEST_ASSERT_EQUAL_PTR(p1 + 16, p2); // Bump allocated, 16 byte aligned
+    arena_release(a, p1);
+    arena_release(a, p2);
+    // Everything is released but the region is still open, so it stays ours
+    char *p3 = (char *)arena_alloc(a, 10);
+    TEST_ASSERT_EQUAL_PTR(p2 + 16, p3);
+    arena_seal(a);
+    arena_release(a, p3); // Last release of a sealed region recycles it
+    // With max_regions 1 this only returns because the region came back
+    char *p4 = (char *)arena_alloc(a, 10);
+    TEST_ASSERT_EQUAL_PTR(p1, p4);
+    arena_release(a, p4);
+    arena_destroy(a);
+}
+
+struct arena_run
+{
+    arena_t a;
+    queue_t q;
+};
+
+static void *arena_producer(void *arg)
+{
+    struct arena_run *r = (struct arena_run *)arg;
+    void *batch[10];
+    for (int i = 0; i < 5000; i += 10) {
+        for (int j = 0; j < 10; j++) {
+            int *v = (int *)arena_alloc(r->a, 64);
+            *v = i + j;
+            batch[j] = v;
+        }
+        enqueue_batch(r->q, batch, 10); // Seals one region per batch
+    }
+    queue_shutdown(r->q);
+    return NULL; // Thread exit seals any region left open
+}
+
+void test_arena_queue_payloads(void)
+{
+    struct arena_run r = {arena_init(4096, 3), queue_init(8)};
+    TEST_ASSERT_NOT_NULL(r.a);
+    queue_set_arena(r.q, r.a);
+    pthread_t t;
+    pthread_create(&t, NULL, arena_producer, &r);
+    int *v, expect = 0;
+    // 5000 payloads fit in three regions only if regions are recycled
+    while ((v = (int *)dequeue(r.q)) != NULL) {
+        TEST_ASSERT_EQUAL_INT(expect++, *v);
+        arena_release(r.a, v);
+    }
+    pthread_join(t, NULL);
+    TEST_ASSERT_EQUAL_INT(5000, expect);
+    arena_destroy(r.a);
+    queue_destroy(r.q);
+}
+
+static void *lane_one_take(void *arg)
+{
+    return laneq_dequeue((laneq_t)arg, 1);
+}
+
+void test_laneq_prefers_hinted_lane(void)
+{
+    TEST_ASSERT_NULL(laneq_init(0, 4, 0));
+    laneq_t lq = laneq_init(2, 4, 2000000); // Steal after 2ms
+    TEST_ASSERT_NOT_NULL(lq);
+    int a = 1, b = 2, c = 3;
+    struct timespec t0, t1;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    laneq_enqueue(lq, &a, 1);
+    laneq_enqueue(lq, &b, 0);
+    laneq_enqueue(lq, &c, 3); // Wraps to lane 1
+    // Lane 0 gets its own item at once even though lane 1's is older
+    TEST_ASSERT_EQUAL_PTR(&b, laneq_dequeue(lq, 0));
+    // Lane 1's items are only handed to lane 0 after the steal delay
+    TEST_ASSERT_EQUAL_PTR(&a, laneq_dequeue(lq, 0));
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    long waited = (t1.tv_sec - t0.tv_sec) * 1000000000L + (t1.tv_nsec - t0.tv_nsec);
+    TEST_ASSERT_TRUE(waited >= 2000000);
+    TEST_ASSERT_EQUAL_PTR(&c, laneq_dequeue(lq, 1));
+    uint64_t local, stolen;
+    laneq_stats(lq, &local, &stolen);
+    TEST_ASSERT_EQUAL_UINT64(2, local);
+    TEST_ASSERT_EQUAL_UINT64(1, stolen);
+
+    // A consumer blocked on an empty queue is released by shutdown
+    pthread_t t;
+    pthread_create(&t, NULL, lane_one_take, lq);
+    laneq_shutdown(lq);
+    void *got = &a;
+    pthread_join(t, &got);
+    TEST_ASSERT_NULL(got);
+    laneq_destroy(lq);
+}
+
+void test_clock_tracks_monotonic(void)
+{
+    const char *src = clock_source();
+    TEST_ASSERT_TRUE(strcmp(src, "tsc") == 0 || strcmp(src, "monotonic") == 0);
+    // Never steps backwards
+    uint64_t prev = clock_now_ns();
+    for (int i = 0; i < 100000; i++)
+    {
+        uint64_t now = clock_now_ns();
+        TEST_ASSERT_TRUE(now >= prev);
+        prev = now;
+    }
+    // Shares CLOCK_MONOTONIC's timebase and rate
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    int64_t m0 = (int64_t)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+    int64_t c0 = (int64_t)clock_now_ns();
+    struct timespec nap = {0, 20000000};
+    nanosleep(&nap, NULL);
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    int64_t m1 = (int64_t)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+    int64_t c1 = (int64_t)clock_now_ns();
+    TEST_ASSERT_TRUE(llabs(c0 - m0) < 1000000);
+    TEST_ASSERT_TRUE(llabs((c1 - c0) - (m1 - m0)) < 1000000);
+}
+
+static uint64_t clock_latest;
+
+static void *clock_reader(void *arg)
+{
+    int *backwards = (int *)arg;
+    uint64_t stop = clock_now_ns() + 1200000000ull; // Spans a resync
+    uint64_t now;
+    do
+    {
+        uint64_t seen = __atomic_load_n(&clock_latest, __ATOMIC_ACQUIRE);
+        now = clock_now_ns();
+        if (now < seen)
+        {
+            (*backwards)++;
+        }
+        while (seen < now &&
+               !__atomic_compare_exchange_n(&clock_latest, &seen, now, false,
+                                            __ATOMIC_RELEASE, __ATOMIC_ACQUIRE))
+            ;
+    } while (now < stop);
+    return NULL;
+}
+
+void test_clock_monotonic_across_threads(void)
+{
+    // A reading must not be below one another thread already returned,
+    // including around the resync
+    pthread_t t[4];
+    int backwards[4] = {0};
+    for (int i = 0; i < 4; i++)
+    {
+        pthread_create(&t[i], NULL, clock_reader, &backwards[i]);
+    }
+    for (int i = 0; i < 4; i++)
+    {
+        pthread_join(t[i], NULL);
+        TEST_ASSERT_EQUAL_INT(0, backwards[i]);
+    }
+}
+
+void test_merge_orders_lanes_by_time(void)
+{
+    TEST_ASSERT_NULL(merge_init(0, 4, 0));
+    merge_t m = merge_init(3, 8, 0);
+    TEST_ASSERT_NOT_NULL(m);
+    uint64_t stamps[3][4] = {{1, 4, 7, 10}, {2, 3, 8, 9}, {5, 6, 11, 12}};
+    for (int lane = 0; lane < 3; lane++)
+    {
+        for (int i = 0; i < 4; i++)
+        {
+            TEST_ASSERT_EQUAL_INT(0, merge_push(m, lane, &stamps[lane][i], stamps[lane][i]));
+        }
+        merge_close_lane(m, lane);
+    }
+    // Closed lanes refuse items, and a lane never goes back in time
+    TEST_ASSERT_EQUAL_INT(-1, merge_push(m, 0, &stamps[0][0], 20));
+    for (uint64_t want = 1; want <= 12; want++)
+    {
+        uint64_t ts = 0;
+        uint64_t *item = (uint64_t *)merge_pop(m, &ts);
+        TEST_ASSERT_NOT_NULL(item);
+        TEST_ASSERT_EQUAL_UINT64(want, ts);
+        TEST_ASSERT_EQUAL_UINT64(want, *item);
+    }
+    TEST_ASSERT_NULL(merge_pop(m, NULL));
+    merge_destroy(m);
+}
+
+void test_merge_waits_for_watermarks(void)
+{
+    merge_t m = merge_init(2, 4, 5000000); // Idle after 5ms
+    TEST_ASSERT_NOT_NULL(m);
+    int a = 1, b = 2;
+    TEST_ASSERT_EQUAL_INT(-1, merge_push(m, 2, &a, 10));
+    merge_push(m, 0, &a, 10);
+    // Lane 1 promises nothing before 11, so lane 0's item goes at once
+    merge_advance(m, 1, 11);
+    TEST_ASSERT_EQUAL_PTR(&a, merge_pop(m, NULL));
+    TEST_ASSERT_EQUAL_INT(-1, merge_push(m, 1, &b, 5));
+
+    // Lane 1 goes quiet, the merge only waits for it up to the idle timeout
+    merge_push(m, 0, &a, 20);
+    uint64_t t0 = clock_now_ns();
+    uint64_t ts = 0;
+    TEST_ASSERT_EQUAL_PTR(&a, merge_pop(m, &ts));
+    TEST_ASSERT_EQUAL_UINT64(20, ts);
+    TEST_ASSERT_TRUE(clock_now_ns() - t0 >= 4000000);
+
+    // What the idle lane sends afterwards still arrives, counted as late
+    merge_push(m, 1, &b, 15);
+    merge_close_lane(m, 0);
+    merge_close_lane(m, 1);
+    TEST_ASSERT_EQUAL_PTR(&b, merge_pop(m, &ts));
+    TEST_ASSERT_EQUAL_UINT64(15, ts);
+    TEST_ASSERT_NULL(merge_pop(m, NULL));
+    uint64_t emitted, late;
+    merge_stats(m, &emitted, &late);
+    TEST_ASSERT_EQUAL_UINT64(3, emitted);
+    TEST_ASSERT_EQUAL_UINT64(1, late);
+    merge_destroy(m);
+}
+
+void test_try_enqueue(void)
+{
+    queue_t q = queue_init(1);
+    int a = 1, b = 2;
+    TEST_ASSERT_EQUAL_INT(0, try_enqueue(q, &a));
+    TEST_ASSERT_EQUAL_INT(-1, try_enqueue(q, &b)); // Full, returns at once
+    TEST_ASSERT_EQUAL_PTR(&a, dequeue(q));
+    queue_shutdown(q);
+    TEST_ASSERT_EQUAL_INT(-1, try_enqueue(q, &b));
+    queue_destroy(q);
+}
+
+struct blocker
+{
+    queue_t started;
+    queue_t release;
+};
+
+static void block_task(void *arg)
+{
+    struct blocker *b = (struct blocker *)arg;
+    enqueue(b->started, b);
+    dequeue(b->release);
+}
+
+static void record_thread(void *arg)
+{
+    *(pthread_t *)arg = pthread_self();
+}
+
+void test_workpool_caller_runs(void)
+{
+    TEST_ASSERT_NULL(workpool_init(0, 1, WORKPOOL_CALLER_RUNS));
+    workpool_t p = workpool_init(1, 1, WORKPOOL_CALLER_RUNS);
+    TEST_ASSERT_NOT_NULL(p);
+    struct blocker b = {queue_init(1), queue_init(1)};
+    pthread_t ran_on[3];
+
+    // Occupy the only worker, then fill the only queue slot
+    TEST_ASSERT_EQUAL_INT(0, workpool_submit(p, block_task, &b, false));
+    dequeue(b.started);
+    TEST_ASSERT_EQUAL_INT(0, workpool_submit(p, record_thread, &ran_on[0], false));
+    // A full queue makes the submitter run the task
+    TEST_ASSERT_EQUAL_INT(1, workpool_submit(p, record_thread, &ran_on[1], false));
+    TEST_ASSERT_TRUE(pthread_equal(ran_on[1], pthread_self()));
+    // So does a tiny task while no worker is idle
+    TEST_ASSERT_EQUAL_INT(1, workpool_submit(p, record_thread, &ran_on[2], true));
+    TEST_ASSERT_TRUE(pthread_equal(ran_on[2], pthread_self()));
+
+    enqueue(b.release, &b);
+    workpool_destroy(p); // Runs the queued task before returning
+    TEST_ASSERT_FALSE(pthread_equal(ran_on[0], pthread_self()));
+    queue_destroy(b.started);
+    queue_destroy(b.release);
+}
+
+void test_workpool_stats(void)
+{
+    workpool_t p = workpool_init(2, 4, WORKPOOL_BLOCK);
+    pthread_t t;
+    for (int i = 0; i < 100; i++)
+    {
+        // Blocking pools never run tasks on the submitter
+        TEST_ASSERT_EQUAL_INT(0, workpool_submit(p, record_thread, &t, i % 2));
+    }
+    struct workpool_stats st;
+    workpool_stats(p, &st);
+    TEST_ASSERT_EQUAL_UINT64(100, st.queued);
+    TEST_ASSERT_EQUAL_UINT64(0, st.ran_full + st.ran_busy);
+    workpool_destroy(p);
+
+    // After shutdown neither policy takes or runs a task
+    for (int policy = WORKPOOL_BLOCK; policy <= WORKPOOL_CALLER_RUNS; policy++)
+    {
+        p = workpool_init(1, 1, (enum workpool_policy)policy);
+        workpool_shutdown(p);
+        TEST_ASSERT_EQUAL_INT(-1, workpool_submit(p, record_thread, &t, false));
+        workpool_stats(p, &st);
+        TEST_ASSERT_EQUAL_UINT64(0, st.queued + st.ran_full + st.ran_busy);
+        workpool_destroy(p);
+    }
+}
+
+void test_sketch_finds_heavy_hitters(void)
+{
+    TEST_ASSERT_NULL(sketch_init(0, 1000, 0));
+    sketch_t s = sketch_init(4, 1000, 0); // 1000ns window on a made up clock
+    TEST_ASSERT_NOT_NULL(s);
+    // Key 7 takes a third of the traffic, the rest is spread over 3000 keys
+    for (uint64_t i = 0; i < 30000; i++)
+    {
+        sketch_add(s, i % 3 == 0 ? 7 : 100 + i % 3000, 1, 10);
+    }
+    struct sketch_entry top[4];
+    TEST_ASSERT_EQUAL_INT(4, sketch_top(s, top, 4, 10));
+    TEST_ASSERT_EQUAL_UINT64(7, top[0].key);
+    TEST_ASSERT_TRUE(top[0].count >= 10000 && top[0].count < 11000);
+    TEST_ASSERT_TRUE(sketch_estimate(s, 105, 10) >= 3); // Never below the pane's count
+
+    // Half a window later the previous pane counts for half
+    uint64_t half = sketch_estimate(s, 7, 1500);
+    TEST_ASSERT_TRUE(half >= 5000 && half < 5600);
+    // Two windows on, nothing is left
+    TEST_ASSERT_EQUAL_UINT64(0, sketch_estimate(s, 7, 3100));
+    TEST_ASSERT_EQUAL_INT(0, sketch_top(s, top, 4, 3100));
+    sketch_destroy(s);
+}
+
+void test_queue_hot_keys(void)
+{
+    queue_t q = queue_init(16);
+    struct sketch_entry top[2];
+    TEST_ASSERT_EQUAL_INT(-1, queue_hot_keys(q, top, 2));
+    TEST_ASSERT_EQUAL_INT(0, queue_set_sketch(q, 2, 1000000000));
+    int x = 0;
+    for (int i = 0; i < 10; i++)
+    {
+        enqueue_keyed(q, &x, 42);
+    }
+    enqueue_keyed(q, &x, 1);
+    enqueue(q, &x);
+    TEST_ASSERT_EQUAL_INT(2, queue_hot_keys(q, top, 2));
+    TEST_ASSERT_EQUAL_UINT64(42, top[0].key);
+    TEST_ASSERT_EQUAL_UINT64(10, top[0].count);
+    TEST_ASSERT_EQUAL_UINT64(1, top[1].key);
+    TEST_ASSERT_EQUAL_INT(1, queue_hot_producers(q, top, 2));
+    TEST_ASSERT_EQUAL_UINT64(queue_producer_id(), top[0].key);
+    TEST_ASSERT_EQUAL_UINT64(12, top[0].count);
+    TEST_ASSERT_TRUE(top[0].rate > 0);
+    TEST_ASSERT_EQUAL_INT(0, queue_set_sketch(q, 0, 0));
+    TEST_ASSERT_EQUAL_INT(-1, queue_hot_producers(q, top, 2));
+    queue_destroy(q);
+}
+
+void test_queue_hot_producers_batch(void)
+{
+    queue_t q = queue_init(16);
+    TEST_ASSERT_EQUAL_INT(0, queue_set_sketch(q, 2, 1000000000));
+    int x = 0;
+    void *items[4] = {&x, &x, &x, &x};
+    enqueue(q, &x);
+    TEST_ASSERT_EQUAL_INT(4, enqueue_batch(q, items, 4));
+    enqueue(q, &x);
+    // Batches count alongside single enqueues in the same window
+    struct sketch_entry top[2];
+    TEST_ASSERT_EQUAL_INT(1, queue_hot_producers(q, top, 2));
+    TEST_ASSERT_EQUAL_UINT64(queue_producer_id(), top[0].key);
+    TEST_ASSERT_EQUAL_UINT64(6, top[0].count);
+    queue_destroy(q);
+}
+
+static void *double_it(void *item, void *ctx)
+{
+    (void)ctx;
+    int *v = (int *)item;
+    *v *= 2;
+    return v;
+}
+
+static bool keep_big(void *item, void *ctx)
+{
+    return *(int *)item >= *(int *)ctx;
+}
+
+static void sum_sink(void *item, void *ctx)
+{
+    __atomic_fetch_add((long *)ctx, *(int *)item, __ATOMIC_RELAXED);
+}
+
+static void batch_sink(void *item, void *ctx)
+{
+    int *sizes = (int *)ctx;
+    struct stream_batch *b = (struct stream_batch *)item;
+    sizes[sizes[0] + 1] = b->n;
+    sizes[0]++;
+    free(b);
+}
+
+static void *window_sum(void **items, int n, void *ctx)
+{
+    int *out = (int *)ctx;
+    int *slot = &out[++out[0]];
+    for (int i = 0; i < n; i++) {
+        *slot += *(int *)items[i];
+    }
+    return slot;
+}
+
+void test_stream_map_filter(void)
+{
+    stream_t s = stream_init(8);
+    TEST_ASSERT_NOT_NULL(s);
+    int min = 10;
+    long sum = 0;
+    TEST_ASSERT_EQUAL_INT(0, stream_map(s, double_it, NULL));
+    TEST_ASSERT_EQUAL_INT(0, stream_filter(s, keep_big, &min));
+    TEST_ASSERT_EQUAL_INT(0, stream_sink(s, sum_sink, &sum));
+    TEST_ASSERT_EQUAL_INT(0, stream_start(s));
+    int data[10];
+    for (int i = 0; i < 10; i++) {
+        data[i] = i;
+        stream_push(s, &data[i]);
+    }
+    stream_close(s);
+    TEST_ASSERT_EQUAL_INT(70, sum); // 10 + 12 + 14 + 16 + 18
+    stream_destroy(s);
+}
+
+void test_stream_batch_flushes_on_close(void)
+{
+    stream_t s = stream_init(8);
+    TEST_ASSERT_NOT_NULL(s);
+    int sizes[8] = {0};
+    TEST_ASSERT_EQUAL_INT(0, stream_batch(s, 4, 0));
+    TEST_ASSERT_EQUAL_INT(0, stream_sink(s, batch_sink, sizes));
+    TEST_ASSERT_EQUAL_INT(0, stream_start(s));
+    int data[10];
+    for (int i = 0; i < 10; i++) {
+        stream_push(s, &data[i]);
+    }
+    TEST_ASSERT_EQUAL_INT(2, sizes[0]);
+    stream_close(s);
+    TEST_ASSERT_EQUAL_INT(3, sizes[0]);
+    TEST_ASSERT_EQUAL_INT(4, sizes[1]);
+    TEST_ASSERT_EQUAL_INT(4, sizes[2]);
+    TEST_ASSERT_EQUAL_INT(2, sizes[3]);
+    stream_destroy(s);
+}
+
+void test_stream_parallel_no_loss(void)
+{
+    stream_t s = stream_init(4);
+    TEST_ASSERT_NOT_NULL(s);
+    long sum = 0;
+    TEST_ASSERT_EQUAL_INT(0, stream_parallel(s, 3));
+    TEST_ASSERT_EQUAL_INT(0, stream_map(s, double_it, NULL));
+    TEST_ASSERT_EQUAL_INT(0, stream_parallel(s, 2));
+    TEST_ASSERT_EQUAL_INT(0, stream_sink(s, sum_sink, &sum));
+    TEST_ASSERT_EQUAL_INT(0, stream_start(s));
+    TEST_ASSERT_EQUAL_INT(-1, stream_map(s, double_it, NULL));
+    int data[1000];
+    long expect = 0;
+    for (int i = 0; i < 1000; i++) {
+        data[i] = i;
+        expect += 2 * i;
+        stream_push(s, &data[i]);
+    }
+    stream_close(s);
+    TEST_ASSERT_EQUAL_INT64(expect, sum);
+    stream_destroy(s);
+}
+
+void test_stream_window(void)
+{
+    stream_t s = stream_init(8);
+    TEST_ASSERT_NOT_NULL(s);
+    int sums[4] = {0};
+    long total = 0;
+    TEST_ASSERT_EQUAL_INT(0, stream_window(s, 3, 0, window_sum, sums));
+    TEST_ASSERT_EQUAL_INT(0, stream_sink(s, sum_sink, &total));
+    TEST_ASSERT_EQUAL_INT(0, stream_start(s));
+    int data[7] = {1, 2, 3, 4, 5, 6, 7};
+    for (int i = 0; i < 7; i++) {
+        stream_push(s, &data[i]);
+    }
+    stream_destroy(s); // Closes the stream, emitting the last window
+    TEST_ASSERT_EQUAL_INT(3, sums[0]); // Windows emitted
+    TEST_ASSERT_EQUAL_INT(6, sums[1]);
+    TEST_ASSERT_EQUAL_INT(15, sums[2]);
+    TEST_ASSERT_EQUAL_INT(7, sums[3]);
+    TEST_ASSERT_EQUAL_INT(28, total);
+}
 
 // ::: Main Test Runner :::
 
 int main(void) {
+  clock_init();
   UNITY_BEGIN();
   // Existing Tests
   RUN_TEST(test_create_destroy);
@@ -253,6 +1547,68 @@ int main(void) {
   RUN_TEST(test_shutdown_empty_queue);
   RUN_TEST(test_enqueue_after_shutdown);
   RUN_TEST(test_init_zero_capacity);
+  RUN_TEST(test_dequeue_batch);
+  RUN_TEST(test_consumer_batch_order_and_flush);
+  RUN_TEST(test_consumer_batch_drains_after_shutdown);
+  RUN_TEST(test_consumer_batch_returns_on_thread_exit);
+  RUN_TEST(test_consumer_batch_destroy_before_exit);
+  RUN_TEST(test_consumer_batch_requeue_over_capacity);
+  RUN_TEST(test_queue_size);
+  RUN_TEST(test_queue_capacity);
+  RUN_TEST(test_waiting_consumers);
+  RUN_TEST(test_dispatch_prefers_shorter_queue);
+  RUN_TEST(test_multiqueue_no_loss);
+  RUN_TEST(test_multiqueue_shutdown_drains);
+  RUN_TEST(test_trace_round_trip);
+  RUN_TEST(test_trace_splits_large_batches);
+  RUN_TEST(test_enqueue_batch);
+  RUN_TEST(test_batch_controller);
+  RUN_TEST(test_queue_stats_little);
+  RUN_TEST(test_queue_stats_idle_consumer);
+  RUN_TEST(test_subscribe_batches_and_drains);
+  RUN_TEST(test_conflate_latest_value);
+  RUN_TEST(test_conflate_no_torn_reads);
+  RUN_TEST(test_queue_reset);
+  RUN_TEST(test_queue_pool_recycles);
+  RUN_TEST(test_percore_mesh_delivers_all);
+  RUN_TEST(test_rpc_pipelined_calls);
+  RUN_TEST(test_arena_recycles_sealed_region);
+  RUN_TEST(test_arena_queue_payloads);
+  RUN_TEST(test_laneq_prefers_hinted_lane);
+  RUN_TEST(test_clock_tracks_monotonic);
+  RUN_TEST(test_clock_monotonic_across_threads);
+  RUN_TEST(test_merge_orders_lanes_by_time);
+  RUN_TEST(test_merge_waits_for_watermarks);
+  RUN_TEST(test_try_enqueue);
+  RUN_TEST(test_workpool_caller_runs);
+  RUN_TEST(test_workpool_stats);
+  RUN_TEST(test_sketch_finds_heavy_hitters);
+  RUN_TEST(test_queue_hot_keys);
+  RUN_TEST(test_queue_hot_producers_batch);
+  RUN_TEST(test_stream_map_filter);
+  RUN_TEST(test_stream_batch_flushes_on_close);
+  RUN_TEST(test_stream_parallel_no_loss);
+  RUN_TEST(test_stream_window);
+
+  // Multi-threaded tests (test-stress.c)
+  RUN_TEST(test_stress_queue);
+  RUN_TEST(test_stress_queue_consumer_batch);
+  RUN_TEST(test_stress_multiqueue);
+  RUN_TEST(test_stress_shutdown_race);
+  RUN_TEST(test_lincheck_rejects_bad_history);
+  RUN_TEST(test_lincheck_queue);
+  RUN_TEST(test_lincheck_queue_shutdown);
+  RUN_TEST(test_lincheck_queue_consumer_batch);
+  RUN_TEST(test_lincheck_multiqueue);
+
+#ifdef QUEUE_SCHED
+  // Schedule exploration (test-sched.c)
+  RUN_TEST(test_sched_finds_lost_update);
+  RUN_TEST(test_sched_step_limit_fails);
+  RUN_TEST(test_sched_handoff_full_queue);
+  RUN_TEST(test_sched_shutdown_wakes_consumers);
+  RUN_TEST(test_sched_blocked_producers);
+#endif
 
   return UNITY_END();
 }
@@ -0,0 +1,209 @@
+#ifdef QUEUE_SCHED
+#include "harness/unity.h"
+#include "../src/lab.h"
+#include "../src/sync.h"
+#include "detsched.h"
+#include "test-sched.h"
+#include <string.h>
+
+// Small scenarios run under the deterministic scheduler. Each one is
+// explored both with random seeds and depth first. A failure prints the seed
+// or choice prefix that reproduces it.
+
+#define RANDOM_RUNS 500
+#define DFS_RUNS 5000
+
+static void explore(sched_body_fn body, void *ctx)
+{
+    int64_t bad = sched_explore_random(body, ctx, 1, RANDOM_RUNS);
+    TEST_ASSERT_EQUAL_INT64(-1, bad);
+    int explored = 0;
+    TEST_ASSERT_TRUE(sched_explore_dfs(body, ctx, DFS_RUNS, &explored));
+    TEST_ASSERT_TRUE(explored > 1);
+}
+
+// ::: Harness self check :::
+
+static int counter;
+
+static void *racy_increment(void *arg)
+{
+    (void)arg;
+    int v = sync_load(&counter, __ATOMIC_RELAXED);
+    sync_store(&counter, v + 1, __ATOMIC_RELAXED);
+    return NULL;
+}
+
+static bool lost_update_body(void *ctx)
+{
+    (void)ctx;
+    counter = 0;
+    sched_spawn(racy_increment, NULL);
+    sched_spawn(racy_increment, NULL);
+    sched_run();
+    return counter == 2;
+}
+
+void test_sched_finds_lost_update(void)
+{
+    int explored = 0;
+    TEST_ASSERT_FALSE(sched_explore_dfs(lost_update_body, NULL, DFS_RUNS, &explored));
+    // The failing DFS schedule reproduces from its choices
+    static int choices[SCHED_MAX_STEPS];
+    int n = sched_last_choices(choices, SCHED_MAX_STEPS);
+    TEST_ASSERT_FALSE(sched_replay_choices(lost_update_body, NULL, choices, n));
+    TEST_ASSERT_FALSE(sched_replay_choices(lost_update_body, NULL, choices, n));
+    int64_t seed = sched_explore_random(lost_update_body, NULL, 1, RANDOM_RUNS);
+    TEST_ASSERT_TRUE(seed >= 0);
+    // The same seed fails the same way every time
+    TEST_ASSERT_FALSE(sched_replay(lost_update_body, NULL, (uint64_t)seed));
+    TEST_ASSERT_FALSE(sched_replay(lost_update_body, NULL, (uint64_t)seed));
+}
+
+static void *long_increment(void *arg)
+{
+    (void)arg;
+    for (int i = 0; i < SCHED_MAX_STEPS; i++)
+    {
+        sync_store(&counter, sync_load(&counter, __ATOMIC_RELAXED) + 1, __ATOMIC_RELAXED);
+    }
+    return NULL;
+}
+
+static bool long_body(void *ctx)
+{
+    (void)ctx;
+    counter = 0;
+    sched_spawn(long_increment, NULL);
+    sched_spawn(long_increment, NULL);
+    sched_run();
+    return true; // Only the step limit can fail this
+}
+
+void test_sched_step_limit_fails(void)
+{
+    // Choices past the limit are not recorded, so the space cannot be
+    // reported as explored
+    int explored = 0;
+    TEST_ASSERT_FALSE(sched_explore_dfs(long_body, NULL, DFS_RUNS, &explored));
+    TEST_ASSERT_EQUAL_INT(1, explored);
+    TEST_ASSERT_NOT_EQUAL(-1, sched_explore_random(long_body, NULL, 1, 1));
+}
+
+// ::: Queue scenarios :::
+
+struct scenario
+{
+    queue_t q;
+    int values[2];
+    void *got[2][3]; // Items seen by each consumer
+    int ngot[2];
+};
+
+static struct scenario sc;
+
+static void *produce_two_then_shutdown(void *arg)
+{
+    (void)arg;
+    enqueue(sc.q, &sc.values[0]);
+    enqueue(sc.q, &sc.values[1]);
+    queue_shutdown(sc.q);
+    return NULL;
+}
+
+static void *produce_one_then_shutdown(void *arg)
+{
+    (void)arg;
+    enqueue(sc.q, &sc.values[0]);
+    queue_shutdown(sc.q);
+    return NULL;
+}
+
+static void *produce_one(void *arg)
+{
+    enqueue(sc.q, &sc.values[(intptr_t)arg]);
+    return NULL;
+}
+
+static void *consume_until_null(void *arg)
+{
+    int id = (int)(intptr_t)arg;
+    void *itm;
+    while ((itm = dequeue(sc.q)) != NULL && sc.ngot[id] < 3)
+    {
+        sc.got[id][sc.ngot[id]++] = itm;
+    }
+    return NULL;
+}
+
+static void *consume_two(void *arg)
+{
+    int id = (int)(intptr_t)arg;
+    for (int i = 0; i < 2; i++)
+    {
+        sc.got[id][sc.ngot[id]++] = dequeue(sc.q);
+    }
+    return NULL;
+}
+
+static void reset(int capacity)
+{
+    memset(&sc, 0, sizeof(sc));
+    sc.q = queue_init(capacity);
+}
+
+static bool handoff_body(void *ctx)
+{
+    (void)ctx;
+    reset(1);
+    sched_spawn(produce_two_then_shutdown, NULL);
+    sched_spawn(consume_until_null, (void *)0);
+    sched_run();
+    bool ok = sc.ngot[0] == 2 && sc.got[0][0] == &sc.values[0] && sc.got[0][1] == &sc.values[1];
+    queue_destroy(sc.q);
+    return ok;
+}
+
+void test_sched_handoff_full_queue(void)
+{
+    explore(handoff_body, NULL);
+}
+
+static bool shutdown_body(void *ctx)
+{
+    (void)ctx;
+    reset(2);
+    sched_spawn(produce_one_then_shutdown, NULL);
+    sched_spawn(consume_until_null, (void *)0);
+    sched_spawn(consume_until_null, (void *)1);
+    sched_run();
+    bool ok = sc.ngot[0] + sc.ngot[1] == 1;
+    queue_destroy(sc.q);
+    return ok;
+}
+
+void test_sched_shutdown_wakes_consumers(void)
+{
+    explore(shutdown_body, NULL);
+}
+
+static bool blocked_producers_body(void *ctx)
+{
+    (void)ctx;
+    reset(1);
+    sched_spawn(produce_one, (void *)0);
+    sched_spawn(produce_one, (void *)1);
+    sched_spawn(consume_two, (void *)0);
+    sched_run();
+    bool ok = sc.ngot[0] == 2 && sc.got[0][0] != sc.got[0][1] &&
+              sc.got[0][0] != NULL && sc.got[0][1] != NULL;
+    queue_destroy(sc.q);
+    return ok;
+}
+
+void test_sched_blocked_producers(void)
+{
+    explore(blocked_producers_body, NULL);
+}
+
+#endif
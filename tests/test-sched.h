@@ -0,0 +1,11 @@
+#ifndef TEST_SCHED_H
+#define TEST_SCHED_H
+
+// Schedule exploration tests, only built with -DQUEUE_SCHED (make sched-check)
+void test_sched_finds_lost_update(void);
+void test_sched_step_limit_fails(void);
+void test_sched_handoff_full_queue(void);
+void test_sched_shutdown_wakes_consumers(void);
+void test_sched_blocked_producers(void);
+
+#endif
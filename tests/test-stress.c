@@ -0,0 +1,416 @@
+#include "harness/unity.h"
+#include "../src/lab.h"
+#include "../src/multiqueue.h"
+#include "lincheck.h"
+#include "test-stress.h"
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Unlike test-lab.c these tests run many producers and consumers at once.
+// Every item is tagged with its producer and sequence number so consumers can
+// check for loss, duplication and per-producer FIFO order. Small histories
+// are also checked for linearizability against a sequential FIFO model, or a
+// bag for engines that do not promise FIFO order between threads.
+
+#define STRESS_PRODUCERS 4
+#define STRESS_CONSUMERS 4
+#define STRESS_ITEMS 5000   // Per producer
+#define LIN_ROUNDS 200      // Bounded histories checked per scenario
+
+/**
+ * @brief The operations a stress run needs from a queue engine
+ */
+struct engine
+{
+    const char *name;
+    void *(*init)(int capacity);
+    bool (*enqueue)(void *q, void *data); // false if shut down
+    void *(*dequeue)(void *q);
+    void (*shutdown)(void *q);
+    void (*destroy)(void *q);
+    bool fifo; // Each consumer sees every producer's items in order
+};
+
+struct item
+{
+    int producer;
+    int seq;
+};
+
+struct stress_run
+{
+    const struct engine *e;
+    void *q;
+    struct item items[STRESS_PRODUCERS][STRESS_ITEMS];
+    int accepted[STRESS_PRODUCERS][STRESS_ITEMS];
+    int consumed[STRESS_PRODUCERS][STRESS_ITEMS];
+    int order_errors;
+};
+
+struct stress_arg
+{
+    struct stress_run *run;
+    int id;
+};
+
+static void *queue_engine_init(int capacity) { return queue_init(capacity); }
+static bool queue_engine_enqueue(void *q, void *data) { return enqueue_batch((queue_t)q, &data, 1) == 1; }
+static void *queue_engine_dequeue(void *q) { return dequeue((queue_t)q); }
+static void queue_engine_shutdown(void *q) { queue_shutdown((queue_t)q); }
+static void queue_engine_destroy(void *q) { queue_destroy((queue_t)q); }
+
+static void *batch_engine_init(int capacity)
+{
+    queue_t q = queue_init(capacity);
+    queue_set_consumer_batch(q, 8);
+    return q;
+}
+
+static void *mq_engine_init(int capacity)
+{
+    return multiqueue_init(capacity, STRESS_PRODUCERS + STRESS_CONSUMERS, 2);
+}
+static bool mq_engine_enqueue(void *q, void *data) { return multiqueue_enqueue((multiqueue_t)q, data) == 0; }
+static void *mq_engine_dequeue(void *q) { return multiqueue_dequeue((multiqueue_t)q); }
+static void mq_engine_shutdown(void *q) { multiqueue_shutdown((multiqueue_t)q); }
+static void mq_engine_destroy(void *q) { multiqueue_destroy((multiqueue_t)q); }
+
+static const struct engine queue_engine = {
+    "queue_t", queue_engine_init, queue_engine_enqueue, queue_engine_dequeue,
+    queue_engine_shutdown, queue_engine_destroy, true};
+
+// Cached items are handed out later than they left the shared buffer, but
+// each consumer still sees a producer's items in order
+static const struct engine batch_engine = {
+    "queue_t batch", batch_engine_init, queue_engine_enqueue, queue_engine_dequeue,
+    queue_engine_shutdown, queue_engine_destroy, true};
+
+static const struct engine mq_engine = {
+    "multiqueue", mq_engine_init, mq_engine_enqueue, mq_engine_dequeue,
+    mq_engine_shutdown, mq_engine_destroy, false};
+
+static void *stress_producer(void *args)
+{
+    struct stress_arg *a = (struct stress_arg *)args;
+    struct stress_run *r = a->run;
+    for (int i = 0; i < STRESS_ITEMS; i++)
+    {
+        r->items[a->id][i].producer = a->id;
+        r->items[a->id][i].seq = i;
+        r->accepted[a->id][i] = r->e->enqueue(r->q, &r->items[a->id][i]);
+    }
+    return NULL;
+}
+
+static void *stress_consumer(void *args)
+{
+    struct stress_arg *a = (struct stress_arg *)args;
+    struct stress_run *r = a->run;
+    int last[STRESS_PRODUCERS];
+    for (int i = 0; i < STRESS_PRODUCERS; i++)
+    {
+        last[i] = -1;
+    }
+
+    struct item *itm;
+    while ((itm = (struct item *)r->e->dequeue(r->q)) != NULL)
+    {
+        __atomic_add_fetch(&r->consumed[itm->producer][itm->seq], 1, __ATOMIC_RELAXED);
+        if (itm->seq <= last[itm->producer])
+        {
+            __atomic_add_fetch(&r->order_errors, 1, __ATOMIC_RELAXED);
+        }
+        last[itm->producer] = itm->seq;
+    }
+    return NULL;
+}
+
+/**
+ * @brief Runs producers to completion, shuts down, and checks that every
+ * item was consumed exactly once
+ */
+static void run_stress(const struct engine *e, int capacity)
+{
+    struct stress_run *r = (struct stress_run *)calloc(1, sizeof(struct stress_run));
+    TEST_ASSERT_NOT_NULL(r);
+    r->e = e;
+    r->q = e->init(capacity);
+    TEST_ASSERT_NOT_NULL(r->q);
+
+    pthread_t producers[STRESS_PRODUCERS];
+    pthread_t consumers[STRESS_CONSUMERS];
+    struct stress_arg pargs[STRESS_PRODUCERS];
+    struct stress_arg cargs[STRESS_CONSUMERS];
+    for (int i = 0; i < STRESS_CONSUMERS; i++)
+    {
+        cargs[i] = (struct stress_arg){r, i};
+        pthread_create(&consumers[i], NULL, stress_consumer, &cargs[i]);
+    }
+    for (int i = 0; i < STRESS_PRODUCERS; i++)
+    {
+        pargs[i] = (struct stress_arg){r, i};
+        pthread_create(&producers[i], NULL, stress_producer, &pargs[i]);
+    }
+    for (int i = 0; i < STRESS_PRODUCERS; i++)
+    {
+        pthread_join(producers[i], NULL);
+    }
+    e->shutdown(r->q);
+    for (int i = 0; i < STRESS_CONSUMERS; i++)
+    {
+        pthread_join(consumers[i], NULL);
+    }
+
+    for (int p = 0; p < STRESS_PRODUCERS; p++)
+    {
+        for (int i = 0; i < STRESS_ITEMS; i++)
+        {
+            TEST_ASSERT_EQUAL_INT_MESSAGE(1, r->accepted[p][i], e->name);
+            TEST_ASSERT_EQUAL_INT_MESSAGE(1, r->consumed[p][i], e->name);
+        }
+    }
+    if (e->fifo)
+    {
+        TEST_ASSERT_EQUAL_INT_MESSAGE(0, r->order_errors, e->name);
+    }
+    e->destroy(r->q);
+    free(r);
+}
+
+void test_stress_queue(void)
+{
+    run_stress(&queue_engine, 3);
+    run_stress(&queue_engine, 128);
+}
+
+void test_stress_queue_consumer_batch(void)
+{
+    run_stress(&batch_engine, 3);
+    run_stress(&batch_engine, 128);
+}
+
+void test_stress_multiqueue(void)
+{
+    run_stress(&mq_engine, 3);
+    run_stress(&mq_engine, 128);
+}
+
+/**
+ * @brief Producers may still be running or blocked when shutdown is called.
+ * Every item the engine accepted must come out exactly once, nothing
+ * refused may come out, and nothing may hang.
+ */
+static void run_shutdown_race(const struct engine *e)
+{
+    for (int round = 0; round < 20; round++)
+    {
+        struct stress_run *r = (struct stress_run *)calloc(1, sizeof(struct stress_run));
+        TEST_ASSERT_NOT_NULL(r);
+        r->e = e;
+        r->q = e->init(4);
+
+        pthread_t producers[STRESS_PRODUCERS];
+        pthread_t consumers[STRESS_CONSUMERS];
+        struct stress_arg pargs[STRESS_PRODUCERS];
+        struct stress_arg cargs[STRESS_CONSUMERS];
+        for (int i = 0; i < STRESS_PRODUCERS; i++)
+        {
+            pargs[i] = (struct stress_arg){r, i};
+            pthread_create(&producers[i], NULL, stress_producer, &pargs[i]);
+        }
+        for (int i = 0; i < STRESS_CONSUMERS; i++)
+        {
+            cargs[i] = (struct stress_arg){r, i};
+            pthread_create(&consumers[i], NULL, stress_consumer, &cargs[i]);
+        }
+        e->shutdown(r->q);
+        for (int i = 0; i < STRESS_PRODUCERS; i++)
+        {
+            pthread_join(producers[i], NULL);
+        }
+        for (int i = 0; i < STRESS_CONSUMERS; i++)
+        {
+            pthread_join(consumers[i], NULL);
+        }
+
+        for (int p = 0; p < STRESS_PRODUCERS; p++)
+        {
+            for (int i = 0; i < STRESS_ITEMS; i++)
+            {
+                TEST_ASSERT_EQUAL_INT_MESSAGE(r->accepted[p][i], r->consumed[p][i], e->name);
+            }
+        }
+        if (e->fifo)
+        {
+            TEST_ASSERT_EQUAL_INT_MESSAGE(0, r->order_errors, e->name);
+        }
+        e->destroy(r->q);
+        free(r);
+    }
+}
+
+void test_stress_shutdown_race(void)
+{
+    run_shutdown_race(&queue_engine);
+    run_shutdown_race(&batch_engine);
+    run_shutdown_race(&mq_engine);
+}
+
+void test_lincheck_rejects_bad_history(void)
+{
+    // enq(a) then enq(b) strictly in order, but b comes out first
+    static struct lc_history h;
+    int a = 1, b = 2;
+    lc_reset(&h);
+    lc_end(&h, lc_begin(&h, LC_ENQ, &a), NULL);
+    lc_end(&h, lc_begin(&h, LC_ENQ, &b), NULL);
+    lc_end(&h, lc_begin(&h, LC_DEQ, NULL), &b);
+    TEST_ASSERT_FALSE(lc_check_fifo(&h));
+
+    lc_reset(&h);
+    lc_end(&h, lc_begin(&h, LC_ENQ, &a), NULL);
+    lc_end(&h, lc_begin(&h, LC_DEQ, NULL), &a);
+    lc_end(&h, lc_begin(&h, LC_DEQ, NULL), NULL); // NULL before shutdown
+    TEST_ASSERT_FALSE(lc_check_fifo(&h));
+
+    // A bag accepts any order but still rejects an item dequeued twice
+    lc_reset(&h);
+    lc_end(&h, lc_begin(&h, LC_ENQ, &a), NULL);
+    lc_end(&h, lc_begin(&h, LC_ENQ, &b), NULL);
+    lc_end(&h, lc_begin(&h, LC_DEQ, NULL), &b);
+    TEST_ASSERT_TRUE(lc_check_relaxed(&h, LC_MAX_OPS));
+    lc_end(&h, lc_begin(&h, LC_DEQ, NULL), &b);
+    TEST_ASSERT_FALSE(lc_check_relaxed(&h, LC_MAX_OPS));
+}
+
+#define LIN_THREADS 3
+#define LIN_OPS 4 // Per thread
+
+struct lin_run
+{
+    const struct engine *e;
+    void *q;
+    struct lc_history h;
+    int values[LIN_THREADS][LIN_OPS];
+};
+
+struct lin_arg
+{
+    struct lin_run *run;
+    int id;
+};
+
+/**
+ * @brief Each thread alternates enqueue and dequeue. At most one item per
+ * thread is outstanding, so the scenario can never block forever.
+ */
+static void *lin_worker(void *args)
+{
+    struct lin_arg *a = (struct lin_arg *)args;
+    struct lin_run *r = a->run;
+    for (int i = 0; i < LIN_OPS; i++)
+    {
+        void *v = &r->values[a->id][i];
+        int op = lc_begin(&r->h, LC_ENQ, v);
+        r->e->enqueue(r->q, v);
+        lc_end(&r->h, op, NULL);
+        op = lc_begin(&r->h, LC_DEQ, NULL);
+        lc_end(&r->h, op, r->e->dequeue(r->q));
+    }
+    return NULL;
+}
+
+/**
+ * @brief Two threads enqueue and dequeue while the other shuts down
+ */
+static void *lin_shutdown_worker(void *args)
+{
+    struct lin_arg *a = (struct lin_arg *)args;
+    struct lin_run *r = a->run;
+    if (a->id == 0)
+    {
+        int op = lc_begin(&r->h, LC_SHUTDOWN, NULL);
+        r->e->shutdown(r->q);
+        lc_end(&r->h, op, NULL);
+        return NULL;
+    }
+    for (int i = 0; i < LIN_OPS; i++)
+    {
+        void *v = &r->values[a->id][i];
+        int op = lc_begin(&r->h, LC_ENQ, v);
+        r->e->enqueue(r->q, v);
+        lc_end(&r->h, op, NULL);
+        op = lc_begin(&r->h, LC_DEQ, NULL);
+        void *got = r->e->dequeue(r->q);
+        lc_end(&r->h, op, got);
+        if (!got)
+        {
+            break;
+        }
+    }
+    return NULL;
+}
+
+/**
+ * @brief Checks LIN_ROUNDS histories against FIFO for FIFO engines and
+ * against a bag otherwise
+ */
+static void run_lincheck(const struct engine *e, void *(*worker)(void *), int capacity)
+{
+    struct lin_run *r = (struct lin_run *)calloc(1, sizeof(struct lin_run));
+    TEST_ASSERT_NOT_NULL(r);
+    for (int round = 0; round < LIN_ROUNDS; round++)
+    {
+        lc_reset(&r->h);
+        r->e = e;
+        r->q = e->init(capacity);
+        TEST_ASSERT_NOT_NULL(r->q);
+        pthread_t threads[LIN_THREADS];
+        struct lin_arg args[LIN_THREADS];
+        for (int i = 0; i < LIN_THREADS; i++)
+        {
+            args[i] = (struct lin_arg){r, i};
+            pthread_create(&threads[i], NULL, worker, &args[i]);
+        }
+        for (int i = 0; i < LIN_THREADS; i++)
+        {
+            pthread_join(threads[i], NULL);
+        }
+        TEST_ASSERT_TRUE_MESSAGE(lc_check_relaxed(&r->h, e->fifo ? 1 : LC_MAX_OPS), e->name);
+        e->destroy(r->q);
+    }
+    free(r);
+}
+
+void test_lincheck_queue(void)
+{
+    run_lincheck(&queue_engine, lin_worker, LIN_THREADS * LIN_OPS);
+    run_lincheck(&queue_engine, lin_worker, 2);
+}
+
+void test_lincheck_queue_shutdown(void)
+{
+    run_lincheck(&queue_engine, lin_shutdown_worker, 2);
+}
+
+// A consumer's cache hands out items after other threads dequeued newer
+// ones, so batch mode is only a bag between threads. It is not checked
+// with shutdown: after queue_shutdown() only the thread holding cached
+// items serves them, others already get NULL.
+static const struct engine batch_bag_engine = {
+    "queue_t batch", batch_engine_init, queue_engine_enqueue, queue_engine_dequeue,
+    queue_engine_shutdown, queue_engine_destroy, false};
+
+void test_lincheck_queue_consumer_batch(void)
+{
+    run_lincheck(&batch_bag_engine, lin_worker, LIN_THREADS * LIN_OPS);
+    run_lincheck(&batch_bag_engine, lin_worker, 2);
+}
+
+void test_lincheck_multiqueue(void)
+{
+    run_lincheck(&mq_engine, lin_worker, LIN_THREADS * LIN_OPS);
+    run_lincheck(&mq_engine, lin_worker, 2);
+    run_lincheck(&mq_engine, lin_shutdown_worker, 2);
+}
@@ -0,0 +1,15 @@
+#ifndef TEST_STRESS_H
+#define TEST_STRESS_H
+
+// Multi-threaded stress and linearizability tests, run from test-lab.c
+void test_stress_queue(void);
+void test_stress_queue_consumer_batch(void);
+void test_stress_multiqueue(void);
+void test_stress_shutdown_race(void);
+void test_lincheck_rejects_bad_history(void);
+void test_lincheck_queue(void);
+void test_lincheck_queue_shutdown(void);
+void test_lincheck_queue_consumer_batch(void);
+void test_lincheck_multiqueue(void);
+
+#endif